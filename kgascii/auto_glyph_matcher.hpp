@@ -0,0 +1,154 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_AUTO_GLYPH_MATCHER_HPP
+#define KGASCII_AUTO_GLYPH_MATCHER_HPP
+
+#include <map>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <boost/lexical_cast.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <kgascii/dynamic_glyph_matcher.hpp>
+#include <kgascii/pca_glyph_matcher.hpp>
+#include <kgascii/matcher_benchmark.hpp>
+#include <kgascii/internal/glyph_matcher_registration.hpp>
+
+namespace KG { namespace Ascii {
+
+// Picks the matcher giving the best quality within a per-frame time budget.
+// Every candidate is measured on a synthetic sample of the given font and
+// compared with a reference matcher; the one with the highest agreement
+// whose cost for a whole frame fits the budget wins.
+// Options:
+//  budget_us - time available for a single frame in microseconds,
+//  cells     - number of text cells in a frame (default 79x49),
+//  threads   - number of threads sharing the frame (default 1),
+//  ref       - reference algorithm name (default sed),
+//  method, precision, cache, makecache, autocache - passed to the pca candidates.
+// Every pca feature count is tried as a float matcher and, for 8-bit
+// fonts, quantized to 8 and 16 bits on the same components.
+// If no candidate fits the budget the cheapest one is used.
+template<class TFontImage>
+class AutoGlyphMatcherFactory
+{
+public:
+    typedef DynamicGlyphMatcher<TFontImage> DynamicGlyphMatcherT;
+    typedef PcaGlyphMatcherFactory<TFontImage> PcaFactoryT;
+    typedef Internal::GlyphMatcherRegistry<TFontImage> GlyphMatcherRegistryT;
+    typedef std::map<std::string, std::string> OptionsT;
+
+    boost::shared_ptr<DynamicGlyphMatcherT> operator()(boost::shared_ptr<const TFontImage> font, const OptionsT& options) const
+    {
+        double budget = getOption<double>(options, "budget_us", 40000.0) * 1e-6;
+        double cells = getOption<double>(options, "cells", 79.0 * 49.0);
+        double threads = std::max(getOption<double>(options, "threads", 1.0), 1.0);
+        std::string ref_name = getOption<std::string>(options, "ref", "sed");
+
+        MatcherBenchmark<TFontImage> bench(font, SAMPLE_ROWS, SAMPLE_COLS);
+        boost::posix_time::time_duration min_time = boost::posix_time::milliseconds(MEASURE_TIME_MS);
+
+        TextSurface reference;
+        bench.generateReference(ConstMatcherPtrT(createRegistered(ref_name, font, OptionsT())), reference);
+
+        std::vector<boost::shared_ptr<DynamicGlyphMatcherT> > candidates;
+        static const char* const plain_candidates[] = { "sed", "md", "mi", "ramp" };
+        for (size_t i = 0; i < sizeof(plain_candidates) / sizeof(plain_candidates[0]); ++i) {
+            candidates.push_back(createRegistered(plain_candidates[i], font, OptionsT()));
+        }
+        //a single decomposition, made only if some components are not cached, serves all feature counts
+        static const size_t pca_features[] = { 4, 6, 8, 12, 16, 24 };
+        const size_t pca_feature_cnt = sizeof(pca_features) / sizeof(pca_features[0]);
+        boost::shared_ptr<const typename PcaFactoryT::EigendecompositionT> decomposition;
+        for (size_t i = 0; i < pca_feature_cnt; ++i) {
+            boost::shared_ptr<const typename PcaFactoryT::PrincipalComponentsT> components = 
+                PcaFactoryT::createComponents(font, options, pca_features[i], decomposition, pca_features[pca_feature_cnt - 1]);
+            //fonts with few components would repeat the same candidate
+            if (components->featureCount() == pca_features[i]) {
+                candidates.push_back(PcaFactoryT::create(components));
+                if (PcaFactoryT::quantizable()) {
+                    candidates.push_back(PcaFactoryT::template createQuantized<boost::int8_t>(components));
+                    candidates.push_back(PcaFactoryT::template createQuantized<boost::int16_t>(components));
+                }
+            }
+        }
+        //the components do not need it, release it before benchmarking
+        decomposition.reset();
+
+        boost::shared_ptr<DynamicGlyphMatcherT> best;
+        double best_agreement = -1;
+        double best_cost = 0;
+        boost::shared_ptr<DynamicGlyphMatcherT> cheapest;
+        double cheapest_cost = 0;
+        TextSurface text;
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            typename MatcherBenchmark<TFontImage>::Result res = 
+                bench.evaluate(ConstMatcherPtrT(candidates[i]), reference, text, min_time);
+            double frame_cost = res.cellCost * cells / threads;
+            if (!cheapest || frame_cost < cheapest_cost) {
+                cheapest = candidates[i];
+                cheapest_cost = frame_cost;
+            }
+            if (frame_cost > budget)
+                continue;
+            if (res.agreement > best_agreement || (res.agreement == best_agreement && frame_cost < best_cost)) {
+                best = candidates[i];
+                best_agreement = res.agreement;
+                best_cost = frame_cost;
+            }
+        }
+        return best ? best : cheapest;
+    }
+
+private:
+    typedef boost::shared_ptr<const DynamicGlyphMatcherT> ConstMatcherPtrT;
+
+    static const unsigned SAMPLE_ROWS = 16;
+    static const unsigned SAMPLE_COLS = 32;
+    static const unsigned MEASURE_TIME_MS = 20;
+
+    static boost::shared_ptr<DynamicGlyphMatcherT> createRegistered(const std::string& name, 
+            boost::shared_ptr<const TFontImage> font, const OptionsT& options)
+    {
+        typedef typename GlyphMatcherRegistryT::CreatorFuncT CreatorFuncT;
+        const CreatorFuncT* func = GlyphMatcherRegistryT::findFactory(name);
+        if (!func || name == "auto")
+            throw std::runtime_error("unknown algo name");
+        return (*func)(font, options);
+    }
+
+    template<class T>
+    static T getOption(const OptionsT& options, const char* name, const T& def_value)
+    {
+        OptionsT::const_iterator it = options.find(name);
+        if (it == options.end())
+            return def_value;
+        try {
+            return boost::lexical_cast<T>(it->second);
+        } catch (boost::bad_lexical_cast&) { 
+            return def_value;
+        }
+    }
+};
+
+} } // namespace KG::Ascii
+
+#endif // KGASCII_AUTO_GLYPH_MATCHER_HPP
@@ -0,0 +1,158 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_BRIGHTNESSRAMPGLYPHMATCHER_HPP
+#define KGASCII_BRIGHTNESSRAMPGLYPHMATCHER_HPP
+
+#include <map>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <boost/gil/gil_all.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <kgascii/symbol.hpp>
+#include <kgascii/dynamic_glyph_matcher.hpp>
+
+namespace KG { namespace Ascii {
+
+// Picks the glyph with the closest mean brightness.
+// Glyph means are sorted once, so a match costs a single pass over the
+// cell and a binary search; meant as a cheap first pass, not as
+// a replacement for the shape aware matchers.
+template<class TFontImage>
+class BrightnessRampGlyphMatcher: boost::noncopyable
+{
+public:
+    typedef TFontImage FontImageT;
+    typedef typename FontImageT::PixelT PixelT;
+    typedef typename FontImageT::ImageT ImageT;
+    typedef typename FontImageT::ViewT ViewT;
+    typedef typename FontImageT::ConstViewT ConstViewT;
+
+    class BrightnessRampContext
+    {
+        friend class BrightnessRampGlyphMatcher;
+    public:
+        typedef BrightnessRampGlyphMatcher GlyphMatcherT;
+
+    private:
+        explicit BrightnessRampContext(const BrightnessRampGlyphMatcher* matcher)
+            :image_(matcher->cellWidth(), matcher->cellHeight())
+        {
+        }
+
+    private:
+        ImageT image_;
+    };
+    typedef BrightnessRampContext ContextT;
+
+public:
+    explicit BrightnessRampGlyphMatcher(boost::shared_ptr<const FontImageT> f)
+        :font_(f)
+    {
+        ramp_.reserve(font_->glyphCount());
+        for (size_t ci = 0; ci < font_->glyphCount(); ++ci) {
+            ramp_.push_back(std::make_pair(calculateSum(font_->getGlyph(ci)), ci));
+        }
+        std::sort(ramp_.begin(), ramp_.end());
+    }
+
+public:
+    boost::shared_ptr<const FontImageT> font() const
+    {
+        return font_;
+    }
+
+    unsigned cellWidth() const
+    {
+        return font_->glyphWidth();
+    }
+
+    unsigned cellHeight() const
+    {
+        return font_->glyphHeight();
+    }
+
+    BrightnessRampContext createContext() const
+    {
+        return BrightnessRampContext(this);
+    }
+
+    template<class TSomeView>
+    Symbol match(BrightnessRampContext& ctx, const TSomeView& imgv) const
+    {
+        assert(imgv.width() <= ctx.image_.width());
+        assert(imgv.height() <= ctx.image_.height());
+
+        if (ramp_.empty())
+            return Symbol();
+
+        //pixels outside of a partial cell are black and do not add to the sum
+        ViewT image_view = subimage_view(view(ctx.image_), 0, 0, imgv.width(), imgv.height());
+        copy_and_convert_pixels(imgv, image_view);
+        double sum = calculateSum(image_view);
+
+        typename RampT::const_iterator it = std::lower_bound(
+                ramp_.begin(), ramp_.end(), std::make_pair(sum, size_t(0)));
+        if (it == ramp_.end()) {
+            --it;
+        } else if (it != ramp_.begin() && sum - (it - 1)->first < it->first - sum) {
+            --it;
+        }
+        return font_->getSymbol(it->second);
+    }
+
+private:
+    typedef std::vector<std::pair<double, size_t> > RampT;
+
+    template<class TView>
+    static double calculateSum(const TView& view)
+    {
+        double sum = 0;
+        for (int y = 0; y < view.height(); ++y) {
+            typename TView::x_iterator it = view.row_begin(y);
+            for (int x = 0; x < view.width(); ++x) {
+                sum += get_color(*it++, boost::gil::gray_color_t());
+            }
+        }
+        return sum;
+    }
+
+private:
+    boost::shared_ptr<const FontImageT> font_;
+    RampT ramp_;
+};
+
+template<class TFontImage>
+class BrightnessRampGlyphMatcherFactory
+{
+public:
+    typedef BrightnessRampGlyphMatcher<TFontImage> GlyphMatcherT;
+    typedef DynamicGlyphMatcher<TFontImage> DynamicGlyphMatcherT;
+
+    boost::shared_ptr<DynamicGlyphMatcherT> operator()(boost::shared_ptr<const TFontImage> font, const std::map<std::string, std::string>&) const
+    {
+        boost::shared_ptr<GlyphMatcherT> matcher(new GlyphMatcherT(font));
+        boost::shared_ptr<DynamicGlyphMatcherT> dynamic_matcher(new DynamicGlyphMatcherT(matcher));
+        return dynamic_matcher;
+    }
+};
+
+} } // namespace KG::Ascii
+
+#endif // KGASCII_BRIGHTNESSRAMPGLYPHMATCHER_HPP
@@ -18,8 +18,13 @@
 #ifndef KGASCII_DYNAMICASCIIFIER_HPP
 #define KGASCII_DYNAMICASCIIFIER_HPP
 
+#include <string>
+#include <stdexcept>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <kgascii/sequential_asciifier.hpp>
 #include <kgascii/parallel_asciifier.hpp>
 
@@ -32,6 +37,8 @@ public:
     typedef TGlyphMatcher GlyphMatcherT;
     typedef TView ViewT;
     typedef typename TGlyphMatcher::ContextT ContextT;
+    typedef GenerateFuture::CallbackT CallbackT;
+    typedef boost::function<boost::shared_ptr<const GlyphMatcherT> ()> MatcherBuilderT;
 
 public:
     explicit DynamicAsciifier(boost::shared_ptr<const GlyphMatcherT> ctx)
@@ -39,9 +46,14 @@ public:
         setSequential(ctx);
     }
 
-    explicit DynamicAsciifier(boost::shared_ptr<const GlyphMatcherT> ctx, unsigned thr_cnt)
+    explicit DynamicAsciifier(boost::shared_ptr<const GlyphMatcherT> ctx, unsigned thr_cnt, unsigned rows_per_task=1)
     {
-        setParallel(ctx, thr_cnt);
+        setParallel(ctx, thr_cnt, rows_per_task);
+    }
+
+    ~DynamicAsciifier()
+    {
+        joinBuilder();
     }
 
 public:
@@ -61,8 +73,57 @@ public:
         strategy_->generate(imgv, text);
     }
 
+    void generate(const ViewT& imgv, TextSurface& text, const TextRegion& reg)
+    {
+        strategy_->generate(imgv, text, reg);
+    }
+
+    GenerateFuture generateAsync(const ViewT& imgv, TextSurface& text, const CallbackT& cb=CallbackT())
+    {
+        return strategy_->generateAsync(imgv, text, text.region(), cb);
+    }
+
+    GenerateFuture generateAsync(const ViewT& imgv, TextSurface& text, const TextRegion& reg, const CallbackT& cb=CallbackT())
+    {
+        return strategy_->generateAsync(imgv, text, reg, cb);
+    }
+
+    // Switches to another matcher keeping the current strategy, its worker
+    // threads included, see ParallelAsciifier::setMatcher(). Safe to call
+    // while frames are being converted. A matcher with a different cell
+    // size is fine too, but frames submitted afterwards have to be laid out
+    // for it.
+    void setMatcher(boost::shared_ptr<const GlyphMatcherT> ctx)
+    {
+        strategy_->setMatcher(ctx);
+    }
+
+    // Builds a matcher on a background thread and switches to it once it is
+    // built; conversion goes on with the current matcher in the meantime.
+    // A build still running is waited for first, so swaps take effect in
+    // the order they were requested.
+    void setMatcherAsync(const MatcherBuilderT& builder)
+    {
+        joinBuilder();
+        builderError_.clear();
+        builderThread_ = boost::thread(boost::bind(&DynamicAsciifier::buildMatcher, this, builder));
+    }
+
+    // Waits until the matcher requested last is in use, throws if it could
+    // not be built.
+    void waitMatcher()
+    {
+        joinBuilder();
+        if (!builderError_.empty()) {
+            std::string error;
+            error.swap(builderError_);
+            throw std::runtime_error(error);
+        }
+    }
+
     void setSequential()
     {
+        joinBuilder();
         setSequential(matcher());
     }
 
@@ -73,24 +134,44 @@ public:
         setStrategy(impl);
     }
 
-    void setParallel(unsigned thr_cnt)
+    void setParallel(unsigned thr_cnt, unsigned rows_per_task=1)
     {
-        setParallel(matcher(), thr_cnt);
+        joinBuilder();
+        setParallel(matcher(), thr_cnt, rows_per_task);
     }
 
-    void setParallel(boost::shared_ptr<const GlyphMatcherT> ctx, unsigned thr_cnt)
+    void setParallel(boost::shared_ptr<const GlyphMatcherT> ctx, unsigned thr_cnt, unsigned rows_per_task=1)
     {
         typedef ParallelAsciifier<GlyphMatcherT, ViewT> ParallelAsciifierT;
-        boost::shared_ptr<ParallelAsciifierT> impl(new ParallelAsciifierT(ctx, thr_cnt));
+        boost::shared_ptr<ParallelAsciifierT> impl(new ParallelAsciifierT(ctx, thr_cnt, rows_per_task));
         setStrategy(impl);
     }
 
     template<class TAsciifier>
     void setStrategy(boost::shared_ptr<TAsciifier> impl)
     {
+        //a background build must not publish into the strategy being replaced
+        joinBuilder();
         strategy_ = Strategy<TAsciifier>::create(impl);
     }
 
+private:
+    void buildMatcher(MatcherBuilderT builder)
+    {
+        try {
+            setMatcher(builder());
+        } catch (const std::exception& e) {
+            builderError_ = e.what();
+        }
+    }
+
+    void joinBuilder()
+    {
+        if (builderThread_.joinable()) {
+            builderThread_.join();
+        }
+    }
+
 private:
     class StrategyBase: boost::noncopyable
     {
@@ -101,7 +182,13 @@ private:
 
         virtual unsigned threadCount() const = 0;
 
+        virtual void setMatcher(boost::shared_ptr<const GlyphMatcherT> ctx) const = 0;
+
         virtual void generate(const ViewT& imgv, TextSurface& text) const = 0;
+
+        virtual void generate(const ViewT& imgv, TextSurface& text, const TextRegion& reg) const = 0;
+
+        virtual GenerateFuture generateAsync(const ViewT& imgv, TextSurface& text, const TextRegion& reg, const CallbackT& cb) const = 0;
     };
 
     template<class TAsciifier>
@@ -129,17 +216,34 @@ private:
             return impl_->threadCount();
         }
 
+        virtual void setMatcher(boost::shared_ptr<const GlyphMatcherT> ctx) const
+        {
+            impl_->setMatcher(ctx);
+        }
+
         virtual void generate(const ViewT& imgv, TextSurface& text) const
         {
             impl_->generate(imgv, text);
         }
 
+        virtual void generate(const ViewT& imgv, TextSurface& text, const TextRegion& reg) const
+        {
+            impl_->generate(imgv, text, reg);
+        }
+
+        virtual GenerateFuture generateAsync(const ViewT& imgv, TextSurface& text, const TextRegion& reg, const CallbackT& cb) const
+        {
+            return impl_->generateAsync(imgv, text, reg, cb);
+        }
+
     private:
         boost::shared_ptr<TAsciifier> impl_;
     };
 
 private:
     boost::shared_ptr<const StrategyBase> strategy_;
+    boost::thread builderThread_;
+    std::string builderError_;
 };
 
 } } // namespace KG::Ascii
@@ -18,12 +18,15 @@
 #ifndef KGASCII_FONT_HPP
 #define KGASCII_FONT_HPP
 
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
 #include <boost/gil/gil_all.hpp>
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/random_access_index.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index/member.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/throw_exception.hpp>
 #include <boost/serialization/access.hpp>
 #include <boost/serialization/split_member.hpp>
 #include <boost/noncopyable.hpp>
@@ -43,6 +46,13 @@ public:
 
 public:
     Font()
+        :pixelSize_(0)
+        ,glyphWidth_(0)
+        ,glyphHeight_(0)
+        ,capacity_(0)
+        ,reserved_(false)
+        ,indexedCount_(0)
+        ,indexBase_(0)
     {
     }
 
@@ -108,55 +118,126 @@ public:
 
     size_t glyphCount() const
     {
-        return glyphs_.size();
+        return symbols_.size();
     }
 
     Symbol getSymbol(size_t i) const
     {
-        return glyphs_.at(i).sym;
+        return symbols_.at(i);
     }
 
     ConstViewT getGlyph(size_t i) const
     {
-        return glyphs_.at(i).surf;
+        checkIndex(i);
+        return glyphView(boost::gil::const_view(data_), i);
     }
 
     ViewT getGlyph(size_t i)
     {
-        return glyphs_.at(i).surf;
+        checkIndex(i);
+        return glyphView(boost::gil::view(data_), i);
     }
 
     bool contains(Symbol sym) const
     {
-        return (findGlyphRecord(sym) != 0);
+        return findGlyph(sym) != NO_GLYPH;
     }
 
     ConstViewT getGlyph(Symbol sym) const
     {
-        if (const GlyphRecord* gr = findGlyphRecord(sym))
-            return gr->surf;
+        size_t i = findGlyph(sym);
+        if (i != NO_GLYPH)
+            return getGlyph(i);
         BOOST_THROW_EXCEPTION(std::out_of_range("Invalid symbol"));
     }
 
     ViewT getGlyph(Symbol sym)
     {
-        if (const GlyphRecord* gr = findGlyphRecord(sym))
-            return gr->surf;
+        size_t i = findGlyph(sym);
+        if (i != NO_GLYPH)
+            return getGlyph(i);
         BOOST_THROW_EXCEPTION(std::out_of_range("Invalid symbol"));
     }
 
     void clear()
     {
-        glyphs_.clear();
+        symbols_.clear();
+        data_ = ImageT();
+        capacity_ = 0;
+        reserved_ = false;
+        indexedCount_ = 0;
+        indexBase_ = 0;
+        pageTable_.clear();
+        pages_.clear();
+        sortedIndex_.clear();
     }
 
+    // Makes room for cnt glyphs in the glyph storage. The views returned
+    // by addGlyph() and getGlyph() stay valid as long as the font does not
+    // outgrow its capacity, so the loaders reserve the exact glyph count.
+    // Adding more glyphs than reserved asserts in debug builds.
+    void reserve(size_t cnt)
+    {
+        grow(cnt);
+        reserved_ = true;
+    }
+
+    // Appends an empty glyph for sym and returns its view, which the caller
+    // fills. Growing the storage past its capacity moves all glyphs, so
+    // views returned earlier by addGlyph() or getGlyph() go stale; call
+    // reserve() first to keep them.
+    // Only symbols indexed by finalize() are checked here, duplicates among
+    // the glyphs added since are reported by finalize().
     ViewT addGlyph(Symbol sym)
     {
-        GlyphRecord gr(sym, glyphWidth_, glyphHeight_);
-        std::pair<typename GlyphContainer::iterator, bool> result = glyphs_.push_back(gr);
-        if (!result.second)
+        if (findIndexedGlyph(sym) != NO_GLYPH)
             BOOST_THROW_EXCEPTION(std::runtime_error("Insertion error"));
-        return result.first->surf;
+        if (symbols_.size() == capacity_) {
+            assert(!reserved_ && "more glyphs added than reserved");
+            grow(std::max<size_t>(2 * capacity_, MIN_CAPACITY));
+        }
+        symbols_.push_back(sym);
+        return getGlyph(symbols_.size() - 1);
+    }
+
+    // Rebuilds the symbol index once all glyphs are added. Symbols added
+    // afterwards are still found, but by a linear search over them.
+    // The font loading functions call it themselves.
+    void finalize()
+    {
+        std::vector<std::pair<unsigned, boost::uint32_t> > entries(symbols_.size());
+        for (size_t i = 0; i < symbols_.size(); ++i) {
+            entries[i] = std::make_pair(symbols_[i].value(), i);
+        }
+        std::sort(entries.begin(), entries.end());
+        for (size_t i = 1; i < entries.size(); ++i) {
+            if (entries[i].first == entries[i - 1].first)
+                BOOST_THROW_EXCEPTION(std::runtime_error("Duplicate symbol"));
+        }
+
+        indexBase_ = 0;
+        pageTable_.clear();
+        pages_.clear();
+        sortedIndex_.clear();
+        if (!entries.empty()) {
+            unsigned span = entries.back().first - entries.front().first;
+            if (span < PAGED_INDEX_MAX_RANGE) {
+                indexBase_ = entries.front().first;
+                pageTable_.assign((span >> INDEX_PAGE_BITS) + 1, NO_GLYPH);
+                for (size_t i = 0; i < entries.size(); ++i) {
+                    unsigned offset = entries[i].first - indexBase_;
+                    boost::uint32_t& first = pageTable_[offset >> INDEX_PAGE_BITS];
+                    if (first == NO_GLYPH) {
+                        first = pages_.size();
+                        pages_.resize(pages_.size() + INDEX_PAGE_SIZE, NO_GLYPH);
+                    }
+                    pages_[first + (offset & (INDEX_PAGE_SIZE - 1))] = entries[i].second;
+                }
+            } else {
+                sortedIndex_.swap(entries);
+            }
+        }
+        indexedCount_ = symbols_.size();
     }
 
     bool save(const std::string& file_path) const;
@@ -166,64 +247,82 @@ public:
 private:
     friend class boost::serialization::access;
 
-    struct GlyphRecord;
-
-    const GlyphRecord* findGlyphRecord(Symbol sym) const
+    void checkIndex(size_t i) const
     {
-        typedef typename GlyphContainer::template nth_index<1>::type SymbolIndex;
-        const SymbolIndex& sym_index = glyphs_.template get<1>();
-        typename SymbolIndex::const_iterator it = sym_index.find(sym);
-        if (it != sym_index.end())
-            return &(*it);
-        return 0;
+        if (i >= symbols_.size())
+            BOOST_THROW_EXCEPTION(std::out_of_range("Invalid glyph index"));
     }
 
-    template<class Archive>
-    void serialize(Archive& ar, const unsigned int version);
-
-private:
-    struct GlyphRecord
+    void grow(size_t cnt)
     {
-        Symbol sym;
-        ImageT data;
-        ViewT surf;
-
-        GlyphRecord()
-        {
+        if (cnt <= capacity_)
+            return;
+        ImageT data(glyphWidth_, glyphHeight_ * cnt);
+        boost::gil::fill_pixels(boost::gil::view(data), PixelT());
+        if (data_.width() > 0 && data_.height() > 0) {
+            boost::gil::copy_pixels(boost::gil::const_view(data_),
+                    boost::gil::subimage_view(boost::gil::view(data), 0, 0, data_.width(), data_.height()));
         }
+        data_.swap(data);
+        capacity_ = cnt;
+    }
+
+    template<class TView>
+    TView glyphView(const TView& block, size_t i) const
+    {
+        if (glyphWidth_ == 0 || glyphHeight_ == 0)
+            return TView();
+        return boost::gil::subimage_view(block, 0, i * glyphHeight_, glyphWidth_, glyphHeight_);
+    }
 
-        GlyphRecord(Symbol s, unsigned w, unsigned h)
-            :sym(s)
-            ,data(w, h)
-            ,surf(boost::gil::view(data))
-        {
+    size_t findIndexedGlyph(Symbol sym) const
+    {
+        unsigned value = sym.value();
+        if (!pageTable_.empty()) {
+            unsigned offset = value - indexBase_;
+            size_t page = offset >> INDEX_PAGE_BITS;
+            if (page < pageTable_.size() && pageTable_[page] != NO_GLYPH) {
+                boost::uint32_t i = pages_[pageTable_[page] + (offset & (INDEX_PAGE_SIZE - 1))];
+                if (i != NO_GLYPH)
+                    return i;
+            }
+        } else if (!sortedIndex_.empty()) {
+            typename std::vector<std::pair<unsigned, boost::uint32_t> >::const_iterator it = std::lower_bound(
+                    sortedIndex_.begin(), sortedIndex_.end(), std::make_pair(value, boost::uint32_t(0)));
+            if (it != sortedIndex_.end() && it->first == value)
+                return it->second;
         }
+        return NO_GLYPH;
+    }
 
-        GlyphRecord(const GlyphRecord& t)
-            :sym(t.sym)
-            ,data(t.data)
-            ,surf(boost::gil::view(data))
-        {
+    size_t findGlyph(Symbol sym) const
+    {
+        size_t i = findIndexedGlyph(sym);
+        if (i != NO_GLYPH)
+            return i;
+        for (i = indexedCount_; i < symbols_.size(); ++i) {
+            if (symbols_[i] == sym)
+                return i;
         }
+        return NO_GLYPH;
+    }
 
-        template<class Archive>
-        void load(Archive& ar, const unsigned int version);
+    template<class Archive>
+    void load(Archive& ar, const unsigned int version);
 
-        template<class Archive>
-        void save(Archive& ar, const unsigned int version) const;
+    template<class Archive>
+    void save(Archive& ar, const unsigned int version) const;
 
-        BOOST_SERIALIZATION_SPLIT_MEMBER()
-    };
+    BOOST_SERIALIZATION_SPLIT_MEMBER()
 
-    typedef boost::multi_index_container<
-            GlyphRecord,
-            boost::multi_index::indexed_by<
-                    boost::multi_index::random_access<>,
-                    boost::multi_index::ordered_unique<
-                            boost::multi_index::member<GlyphRecord, Symbol, &GlyphRecord::sym>
-                            >
-                    >
-            > GlyphContainer;
+private:
+    static const boost::uint32_t NO_GLYPH = 0xffffffff;
+    //glyphs allocated by the first addGlyph() without reserve()
+    static const size_t MIN_CAPACITY = 128;
+    static const unsigned INDEX_PAGE_BITS = 8;
+    static const unsigned INDEX_PAGE_SIZE = 1u << INDEX_PAGE_BITS;
+    //wider symbol ranges (beyond Unicode) are searched in sortedIndex_
+    static const size_t PAGED_INDEX_MAX_RANGE = 0x110000;
 
 private:
     std::string familyName_;
@@ -231,9 +330,39 @@ private:
     unsigned pixelSize_;
     unsigned glyphWidth_;
     unsigned glyphHeight_;
-    GlyphContainer glyphs_;
+    //symbols in glyph order
+    std::vector<Symbol> symbols_;
+    //glyph images stacked top to bottom, room for capacity_ glyphs
+    ImageT data_;
+    size_t capacity_;
+    //capacity_ was set by reserve(), views may be held up to it
+    bool reserved_;
+    //symbols_[0, indexedCount_) are covered by the index built by finalize()
+    size_t indexedCount_;
+    //glyph index of symbol indexBase_ + i is in the page pageTable_[i / page size]
+    //of pages_ (an offset, NO_GLYPH if the page is empty) at i % page size
+    unsigned indexBase_;
+    std::vector<boost::uint32_t> pageTable_;
+    std::vector<boost::uint32_t> pages_;
+    //(symbol, glyph index) sorted by symbol, used when the pages would not fit
+    std::vector<std::pair<unsigned, boost::uint32_t> > sortedIndex_;
 };
 
+template<class TImage>
+const boost::uint32_t Font<TImage>::NO_GLYPH;
+
+template<class TImage>
+const size_t Font<TImage>::MIN_CAPACITY;
+
+template<class TImage>
+const unsigned Font<TImage>::INDEX_PAGE_BITS;
+
+template<class TImage>
+const unsigned Font<TImage>::INDEX_PAGE_SIZE;
+
+template<class TImage>
+const size_t Font<TImage>::PAGED_INDEX_MAX_RANGE;
+
 } } // namespace KG::Ascii
 
 #endif // KGASCII_FONT_HPP
@@ -23,10 +23,22 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/gil/gil_all.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/type_traits/integral_constant.hpp>
+#include <boost/type_traits/is_same.hpp>
 #include <kgascii/symbol.hpp>
 
 namespace KG { namespace Ascii {
 
+namespace Internal {
+
+// Fonts keeping all glyphs in one image, stacked from top to bottom in
+// glyph index order and returned by glyphBlock(), specialize this to let
+// FontImage use their pixels in place when the image types match.
+template<class TFont>
+struct HasGlyphBlock: boost::false_type {};
+
+} // namespace Internal
+
 template<
     class TFont,
     class TImage=typename TFont::ImageT
@@ -43,21 +55,18 @@ public:
 public:
     explicit FontImage(boost::shared_ptr<const FontT> f)
         :font_(f)
+        ,owner_(f)
     {
-        familyName_ = font_->familyName();
-        styleName_ = font_->styleName();
-        pixelSize_ = font_->pixelSize();
-        glyphWidth_ = font_->glyphWidth();
-        glyphHeight_ = font_->glyphHeight();
-        size_t glyph_count = font_->glyphCount();
-        data_.recreate(glyphWidth_, glyphHeight_ * glyph_count);
-        glyphs_.reserve(glyph_count);
-        for (size_t i = 0; i < glyph_count; ++i) {
-            ViewT glyph_surface = subimage_view(view(data_), 0, glyphHeight_ * i, glyphWidth_, glyphHeight_);
-            GlyphRecord gr = { font_->getSymbol(i), glyph_surface };
-            copy_and_convert_pixels(font_->getGlyph(i), glyph_surface);
-            glyphs_.push_back(gr);
-        }
+        setup(*f);
+    }
+
+    // Image of a font of another type, e.g. a MappedFont, which is kept
+    // alive by the image; font() is null for it.
+    template<class TSourceFont>
+    explicit FontImage(boost::shared_ptr<const TSourceFont> f)
+        :owner_(f)
+    {
+        setup(*f);
     }
 
 public:
@@ -111,6 +120,46 @@ public:
         return glyphs_.at(i).surf;
     }
 
+private:
+    template<class TSourceFont>
+    void setup(const TSourceFont& font)
+    {
+        familyName_ = font.familyName();
+        styleName_ = font.styleName();
+        pixelSize_ = font.pixelSize();
+        glyphWidth_ = font.glyphWidth();
+        glyphHeight_ = font.glyphHeight();
+        setupGlyphs(font, boost::integral_constant<bool, 
+                Internal::HasGlyphBlock<TSourceFont>::value && boost::is_same<typename TSourceFont::ImageT, ImageT>::value>());
+    }
+
+    template<class TSourceFont>
+    void setupGlyphs(const TSourceFont& font, boost::false_type)
+    {
+        size_t glyph_count = font.glyphCount();
+        data_.recreate(glyphWidth_, glyphHeight_ * glyph_count);
+        glyphs_.reserve(glyph_count);
+        for (size_t i = 0; i < glyph_count; ++i) {
+            ViewT glyph_surface = subimage_view(view(data_), 0, glyphHeight_ * i, glyphWidth_, glyphHeight_);
+            GlyphRecord gr = { font.getSymbol(i), glyph_surface };
+            copy_and_convert_pixels(font.getGlyph(i), glyph_surface);
+            glyphs_.push_back(gr);
+        }
+    }
+
+    template<class TSourceFont>
+    void setupGlyphs(const TSourceFont& font, boost::true_type)
+    {
+        //the views point into the font, which owner_ keeps alive
+        size_t glyph_count = font.glyphCount();
+        const ConstViewT& block = font.glyphBlock();
+        glyphs_.reserve(glyph_count);
+        for (size_t i = 0; i < glyph_count; ++i) {
+            GlyphRecord gr = { font.getSymbol(i), subimage_view(block, 0, glyphHeight_ * i, glyphWidth_, glyphHeight_) };
+            glyphs_.push_back(gr);
+        }
+    }
+
 private:
     struct GlyphRecord
     {
@@ -120,6 +169,7 @@ private:
 
 private:
     boost::shared_ptr<const FontT> font_;
+    boost::shared_ptr<const void> owner_;
     std::string familyName_;
     std::string styleName_;
     unsigned pixelSize_;
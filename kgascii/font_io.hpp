@@ -18,6 +18,7 @@
 #ifndef KGASCII_FONT_IO_HPP
 #define KGASCII_FONT_IO_HPP
 
+#include <algorithm>
 #include <fstream>
 #include <stdexcept>
 #include <vector>
@@ -25,6 +26,10 @@
 #include <boost/exception/info.hpp>
 #include <boost/exception/errinfo_api_function.hpp>
 #include <boost/throw_exception.hpp>
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/random_access_index.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/member.hpp>
 #include <boost/serialization/nvp.hpp>
 #include <boost/serialization/split_free.hpp>
 #include <boost/archive/text_iarchive.hpp>
@@ -33,10 +38,16 @@
 #include <boost/range/iterator_range.hpp>
 #include <boost/range/begin.hpp>
 #include <boost/range/end.hpp>
+#include <boost/range/distance.hpp>
 #include <boost/range/algorithm/lower_bound.hpp>
 #include <boost/range/algorithm/upper_bound.hpp>
 #include <boost/range/adaptor/filtered.hpp>
+#include <boost/bind.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
 #include <kgascii/font.hpp>
+#include <kgascii/internal/font_file.hpp>
 
 namespace boost { namespace serialization {
 
@@ -88,44 +99,106 @@ namespace KG { namespace Ascii {
 
 struct FontIOError: virtual std::exception, virtual boost::exception {};
 
+namespace Internal {
+
+// Text font files (.dsc) store the glyphs as a container of these records,
+// the layout Font used before it kept all glyphs in a single image.
 template<class TImage>
-template<class TArchive>
-void Font<TImage>::serialize(TArchive& ar, const unsigned int version)
+struct TextGlyphRecord
 {
-    using namespace boost::serialization;
-    (void)version;
-    ar & make_nvp("family-name", familyName_);
-    ar & make_nvp("style-name", styleName_);
-    ar & make_nvp("pixel-size", pixelSize_);
-    ar & make_nvp("glyph-width", glyphWidth_);
-    ar & make_nvp("glyph-height", glyphHeight_);
-    ar & make_nvp("glyphs", glyphs_);
-}
+    Symbol sym;
+    TImage data;
+
+    template<class TArchive>
+    void serialize(TArchive& ar, const unsigned int)
+    {
+        using namespace boost::serialization;
+        ar & make_nvp("sym", sym);
+        ar & make_nvp("data", data);
+    }
+};
+
+template<class TImage>
+struct TextGlyphContainer
+{
+    typedef boost::multi_index_container<
+            TextGlyphRecord<TImage>,
+            boost::multi_index::indexed_by<
+                    boost::multi_index::random_access<>,
+                    boost::multi_index::ordered_unique<
+                            boost::multi_index::member<TextGlyphRecord<TImage>, Symbol, &TextGlyphRecord<TImage>::sym>
+                            >
+                    >
+            > type;
+};
+
+} // namespace Internal
 
 template<class TImage>
 template<class TArchive>
-void Font<TImage>::GlyphRecord::load(TArchive& ar, const unsigned int version)
+void Font<TImage>::save(TArchive& ar, const unsigned int version) const
 {
     using namespace boost::serialization;
     (void)version;
-    ar >> make_nvp("sym", sym);
-    ar >> make_nvp("data", data);
-    surf = view(data);
+    ar << make_nvp("family-name", familyName_);
+    ar << make_nvp("style-name", styleName_);
+    ar << make_nvp("pixel-size", pixelSize_);
+    ar << make_nvp("glyph-width", glyphWidth_);
+    ar << make_nvp("glyph-height", glyphHeight_);
+
+    typename Internal::TextGlyphContainer<TImage>::type glyphs;
+    for (size_t i = 0; i < glyphCount(); ++i) {
+        Internal::TextGlyphRecord<TImage> gr;
+        gr.sym = getSymbol(i);
+        gr.data.recreate(glyphWidth_, glyphHeight_);
+        boost::gil::copy_pixels(getGlyph(i), boost::gil::view(gr.data));
+        glyphs.push_back(gr);
+    }
+    ar << make_nvp("glyphs", glyphs);
 }
 
 template<class TImage>
 template<class TArchive>
-void Font<TImage>::GlyphRecord::save(TArchive& ar, const unsigned int version) const
+void Font<TImage>::load(TArchive& ar, const unsigned int version)
 {
     using namespace boost::serialization;
     (void)version;
-    ar << make_nvp("sym", sym);
-    ar << make_nvp("data", data);
+    unsigned glyph_width, glyph_height;
+    ar >> make_nvp("family-name", familyName_);
+    ar >> make_nvp("style-name", styleName_);
+    ar >> make_nvp("pixel-size", pixelSize_);
+    ar >> make_nvp("glyph-width", glyph_width);
+    ar >> make_nvp("glyph-height", glyph_height);
+    setGlyphSize(glyph_width, glyph_height);
+    clear();
+
+    typename Internal::TextGlyphContainer<TImage>::type glyphs;
+    ar >> make_nvp("glyphs", glyphs);
+    reserve(glyphs.size());
+    for (size_t i = 0; i < glyphs.size(); ++i) {
+        typename ImageT::const_view_t glyph = boost::gil::const_view(glyphs[i].data);
+        if (glyph.width() != static_cast<ptrdiff_t>(glyph_width) || glyph.height() != static_cast<ptrdiff_t>(glyph_height))
+            BOOST_THROW_EXCEPTION(FontIOError() << boost::errinfo_api_function("load"));
+        boost::gil::copy_pixels(glyph, addGlyph(glyphs[i].sym));
+    }
+    finalize();
 }
 
+// Files named *.kgf are written in the binary format, see
+// Internal::FontFileHeader; other names get a text archive (.dsc).
 template<class TImage>
 bool Font<TImage>::save(const std::string& file_path) const
 {
+    if (Internal::hasFontFileExtension(file_path)) {
+        std::ofstream ofs(file_path.c_str(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+        if (!ofs.good())
+            BOOST_THROW_EXCEPTION(FontIOError() << boost::errinfo_api_function("ofstream"));
+        Internal::writeFontFile(*this, ofs);
+        if (!ofs.good())
+            BOOST_THROW_EXCEPTION(FontIOError() << boost::errinfo_api_function("ofstream::write"));
+        return true;
+    }
+
     std::ofstream ofs(file_path.c_str(), std::ios_base::out | std::ios_base::trunc);
     if (!ofs.good())
         BOOST_THROW_EXCEPTION(FontIOError() << boost::errinfo_api_function("ofstream"));
@@ -136,9 +209,30 @@ bool Font<TImage>::save(const std::string& file_path) const
     return true;
 }
 
+// Both formats are accepted, binary files are recognized by their
+// contents whatever their name.
 template<class TImage>
 bool Font<TImage>::load(const std::string& file_path)
 {
+    {
+        std::ifstream bfs(file_path.c_str(), std::ios_base::in | std::ios_base::binary);
+        if (!bfs.good())
+            BOOST_THROW_EXCEPTION(FontIOError() << boost::errinfo_api_function("ifstream"));
+        char magic[sizeof(Internal::FONT_FILE_MAGIC)];
+        bfs.read(magic, sizeof(magic));
+        if (Internal::hasFontFileMagic(magic, bfs.gcount())) {
+            bfs.clear();
+            bfs.seekg(0, std::ios_base::end);
+            std::vector<char> data(static_cast<size_t>(bfs.tellg()));
+            bfs.seekg(0, std::ios_base::beg);
+            bfs.read(&data[0], data.size());
+            if (!bfs.good())
+                BOOST_THROW_EXCEPTION(FontIOError() << boost::errinfo_api_function("ifstream::read"));
+            Internal::readFontFile(*this, &data[0], data.size());
+            return true;
+        }
+    }
+
     std::ifstream ifs(file_path.c_str(), std::ios_base::in);
     if (!ifs.good())
         BOOST_THROW_EXCEPTION(FontIOError() << boost::errinfo_api_function("ifstream"));
@@ -151,8 +245,8 @@ bool Font<TImage>::load(const std::string& file_path)
 
 namespace Internal {
 
-template<class TFont, class TLoader, typename TSymbolsRange>
-void doLoad(TFont& font, TLoader& loader, const TSymbolsRange& symbols)
+template<class TFont, class TLoader>
+void prepareLoad(TFont& font, TLoader& loader)
 {
     font.setFamilyName(loader.familyName());
     font.setStyleName(loader.styleName());
@@ -160,6 +254,14 @@ void doLoad(TFont& font, TLoader& loader, const TSymbolsRange& symbols)
     font.setGlyphSize(loader.glyphWidth(), loader.glyphHeight());
 
     font.clear();
+}
+
+template<class TFont, class TLoader, typename TSymbolsRange>
+void doLoad(TFont& font, TLoader& loader, const TSymbolsRange& symbols)
+{
+    prepareLoad(font, loader);
+    //filtered ranges are walked twice, but that is cheap next to loading
+    font.reserve(boost::distance(symbols));
     for (typename boost::range_iterator<const TSymbolsRange>::type
          sit = boost::const_begin(symbols), sit_end = boost::const_end(symbols); 
          sit != sit_end; ++sit) 
@@ -168,6 +270,78 @@ void doLoad(TFont& font, TLoader& loader, const TSymbolsRange& symbols)
         if (!loader.loadGlyph(sym, font.addGlyph(sym)))
             BOOST_THROW_EXCEPTION(FontIOError() << boost::errinfo_api_function("loadGlyph"));
     }
+    font.finalize();
+}
+
+template<class TLoader, class TView>
+void loadGlyphRange(TLoader& loader, const std::vector<Symbol>& symbols, const std::vector<TView>& glyphs,
+        size_t begin, size_t end, boost::mutex& error_mutex, boost::exception_ptr& error)
+{
+    try {
+        for (size_t i = begin; i < end; ++i) {
+            if (!loader.loadGlyph(symbols[i], glyphs[i]))
+                BOOST_THROW_EXCEPTION(FontIOError() << boost::errinfo_api_function("loadGlyph"));
+        }
+    } catch (...) {
+        boost::unique_lock<boost::mutex> lock(error_mutex);
+        if (!error)
+            error = boost::current_exception();
+    }
+}
+
+// The glyphs are added to the font up front, with the storage reserved so
+// that their views stay valid, then every thread rasterizes a disjoint
+// range of them with a loader of its own. The calling thread takes the
+// first range with the original loader.
+template<class TFont, class TLoader, typename TSymbolsRange>
+void doParallelLoad(TFont& font, TLoader& loader, const TSymbolsRange& symbols, unsigned thread_cnt)
+{
+    typedef typename TFont::ViewT ViewT;
+
+    prepareLoad(font, loader);
+
+    std::vector<Symbol> glyph_symbols;
+    std::vector<ViewT> glyphs;
+    for (typename boost::range_iterator<const TSymbolsRange>::type
+         sit = boost::const_begin(symbols), sit_end = boost::const_end(symbols); 
+         sit != sit_end; ++sit) 
+    {
+        glyph_symbols.push_back(*sit);
+    }
+    font.reserve(glyph_symbols.size());
+    for (size_t i = 0; i < glyph_symbols.size(); ++i) {
+        glyphs.push_back(font.addGlyph(glyph_symbols[i]));
+    }
+
+    size_t glyph_cnt = glyph_symbols.size();
+    if (thread_cnt == 0) {
+        thread_cnt = std::max(boost::thread::hardware_concurrency(), 1u);
+    }
+    thread_cnt = static_cast<unsigned>(std::max<size_t>(std::min<size_t>(thread_cnt, glyph_cnt), 1));
+
+    std::vector<boost::shared_ptr<TLoader> > loaders;
+    for (unsigned i = 1; i < thread_cnt; ++i) {
+        boost::shared_ptr<TLoader> worker_loader = loader.clone();
+        if (!worker_loader)
+            BOOST_THROW_EXCEPTION(FontIOError() << boost::errinfo_api_function("clone"));
+        loaders.push_back(worker_loader);
+    }
+
+    boost::mutex error_mutex;
+    boost::exception_ptr error;
+    boost::thread_group workers;
+    for (unsigned i = 1; i < thread_cnt; ++i) {
+        workers.create_thread(boost::bind(&loadGlyphRange<TLoader, ViewT>, 
+                boost::ref(*loaders[i - 1]), boost::cref(glyph_symbols), boost::cref(glyphs),
+                i * glyph_cnt / thread_cnt, (i + 1) * glyph_cnt / thread_cnt,
+                boost::ref(error_mutex), boost::ref(error)));
+    }
+    loadGlyphRange(loader, glyph_symbols, glyphs, 0, glyph_cnt / thread_cnt, error_mutex, error);
+    workers.join_all();
+
+    if (error)
+        boost::rethrow_exception(error);
+    font.finalize();
 }
 
 } // namespace Internal
@@ -197,6 +371,36 @@ bool load(Font<TImage>& font, TLoader& loader, Symbol ci_min, Symbol ci_max)
     return true;
 }
 
+// The loadParallel() functions do the same as load(), but rasterize the
+// glyphs on thread_cnt threads (0 = one per core). The loader has to
+// provide clone(), which opens the same font in an independent loader.
+
+template<class TImage, class TLoader>
+bool loadParallel(Font<TImage>& font, TLoader& loader, unsigned thread_cnt)
+{
+    Internal::doParallelLoad(font, loader, loader.symbols(), thread_cnt);
+    return true;
+}
+
+template<class TImage, class TLoader, class TPredicate>
+bool loadParallel(Font<TImage>& font, TLoader& loader, unsigned thread_cnt, TPredicate pred)
+{
+    Internal::doParallelLoad(font, loader, boost::adaptors::filter(loader.symbols(), pred), thread_cnt);
+    return true;
+}
+
+template<class TImage, class TLoader>
+bool loadParallel(Font<TImage>& font, TLoader& loader, unsigned thread_cnt, Symbol ci_min, Symbol ci_max)
+{
+    const typename TLoader::SymbolCollectionT& symbols = loader.symbols();
+    Internal::doParallelLoad(font, loader, 
+        boost::make_iterator_range(
+            boost::lower_bound(symbols, ci_min), 
+            boost::upper_bound(symbols, ci_max)),
+        thread_cnt);
+    return true;
+}
+
 } } // namespace KG::Ascii
 
 #endif // KGASCII_FONT_IO_HPP
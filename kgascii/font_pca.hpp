@@ -18,13 +18,22 @@
 #ifndef KGASCII_FONT_PCA_HPP
 #define KGASCII_FONT_PCA_HPP
 
+#include <algorithm>
 #include <fstream>
+#include <limits>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/random/mersenne_twister.hpp>
 #include <boost/serialization/nvp.hpp>
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/gil/gil_all.hpp>
 #include <Eigen/Dense>
+#include <kgutil/enum_wrapper.hpp>
+#include <kgascii/internal/half_float.hpp>
 
 
 namespace KG { namespace Ascii {
@@ -40,6 +49,58 @@ class FontEigendecomposition;
 template<class TEigendecomposition>
 class FontPrincipalComponents;
 
+struct PcaMethodValues
+{
+    enum Value
+    {
+        Auto,
+        Covariance,
+        Gram,
+        Truncated
+    };
+    template<class TValueNameMap>
+    static void fillValueNameMap(TValueNameMap map)
+    {
+        map(Auto, "auto")(Covariance, "covariance")(Gram, "gram")(Truncated, "truncated");
+    }
+};
+typedef KG::Util::EnumWrapper<PcaMethodValues> PcaMethod;
+
+namespace Internal {
+
+inline void transposedProductBlock(const Eigen::MatrixXd& lhs, const Eigen::MatrixXd& rhs, 
+        Eigen::MatrixXd& out, ptrdiff_t col_begin, ptrdiff_t col_end)
+{
+    out.middleCols(col_begin, col_end - col_begin).noalias() = 
+            lhs.transpose() * rhs.middleCols(col_begin, col_end - col_begin);
+}
+
+// out = lhs^T * rhs, split into column blocks computed on separate threads.
+inline void parallelTransposedProduct(const Eigen::MatrixXd& lhs, const Eigen::MatrixXd& rhs, 
+        Eigen::MatrixXd& out, unsigned thread_cnt)
+{
+    ptrdiff_t col_cnt = rhs.cols();
+    out.resize(lhs.cols(), col_cnt);
+    thread_cnt = static_cast<unsigned>(std::max<ptrdiff_t>(std::min<ptrdiff_t>(thread_cnt, col_cnt), 1));
+
+    boost::thread_group workers;
+    for (unsigned i = 1; i < thread_cnt; ++i) {
+        workers.create_thread(boost::bind(&transposedProductBlock, boost::cref(lhs), boost::cref(rhs), boost::ref(out),
+                i * col_cnt / thread_cnt, (i + 1) * col_cnt / thread_cnt));
+    }
+    transposedProductBlock(lhs, rhs, out, 0, col_cnt / thread_cnt);
+    workers.join_all();
+}
+
+// Replaces the columns of m with an orthonormal basis of their span.
+inline void orthonormalizeColumns(Eigen::MatrixXd& m)
+{
+    Eigen::HouseholderQR<Eigen::MatrixXd> qr(m);
+    m = qr.householderQ() * Eigen::MatrixXd::Identity(m.rows(), m.cols());
+}
+
+} // namespace Internal
+
 template<class TFontImage>
 class FontEigendecomposition
 {
@@ -51,63 +112,119 @@ public:
 public:
     explicit FontEigendecomposition(boost::shared_ptr<const FontImageT> f)
         :font_(f)
+        ,threadCount_(0)
+        ,totalEnergy_(0)
+        ,complete_(false)
     {
     }
 
-    void analyze()
+    // Finds the principal components of the glyphs, strongest first.
+    // Covariance solves the pixel covariance matrix and Gram the glyph Gram
+    // matrix, the smaller of the two is cheaper; both find all components
+    // with non-zero energy. Truncated finds only the first component_cnt
+    // ones by randomized subspace iteration, which is much faster for large
+    // cells, but approximate. Auto picks Truncated when component_cnt is
+    // small compared to the size of the problem, the cheaper exact method
+    // otherwise.
+    void analyze(PcaMethod method=PcaMethod::Auto, size_t component_cnt=0)
     {
-        size_t glyph_size = font_->glyphWidth() * font_->glyphHeight();
-        size_t samples_cnt = font_->glyphCount();
+        loadSamples();
 
-        typedef boost::gil::layout<
-                typename boost::gil::color_space_type<ConstViewT>::type,
-                typename boost::gil::channel_mapping_type<ConstViewT>::type
-                > LayoutT;
-        typedef typename float_channel_type<typename boost::gil::channel_type<ConstViewT>::type>::type FloatChannelT;
-        typedef typename boost::gil::pixel_value_type<FloatChannelT, LayoutT>::type FloatPixelT;
-        typedef typename boost::gil::type_from_x_iterator<FloatPixelT*>::view_t FloatViewT;
-
-        Eigen::VectorXf tmp_glyph_data(glyph_size * boost::gil::num_channels<FloatPixelT>::value);
-        FloatViewT tmp_glyph_view = boost::gil::interleaved_view(
-                font_->glyphWidth(), font_->glyphHeight(),
-                reinterpret_cast<FloatPixelT*>(tmp_glyph_data.data()),
-                font_->glyphWidth() * sizeof(FloatPixelT));
-
-        Eigen::MatrixXd input_samples(glyph_size, samples_cnt);
-        for (size_t ci = 0; ci < samples_cnt; ++ci) {
-            ConstViewT glyph_surface = font_->getGlyph(ci);
-            boost::gil::copy_and_convert_pixels(glyph_surface, tmp_glyph_view);
-            input_samples.col(ci) = tmp_glyph_data.template cast<double>();
+        if (method == PcaMethod::Auto) {
+            method = chooseMethod(component_cnt);
+        }
+        switch (method.value()) {
+        case PcaMethod::Covariance: analyzeCovariance(); break;
+        case PcaMethod::Gram: analyzeGram(); break;
+        default: analyzeTruncated(component_cnt); break;
         }
 
-        mean_ = input_samples.rowwise().sum() / samples_cnt;
-        assert(static_cast<size_t>(mean_.size()) == glyph_size);
-
-        samples_ = input_samples.colwise() - mean_;
-        assert(samples_.rows() == input_samples.rows());
-        assert(samples_.cols() == input_samples.cols());
+        assert(features_.rows() == mean_.size());
+        assert(features_.cols() == energies_.size());
+    }
 
-        Eigen::MatrixXd covariance(glyph_size, glyph_size);
-        covariance.setZero();
-        covariance.selfadjointView<Eigen::Lower>().rankUpdate(samples_, 1.0 / (samples_cnt - 1));
-        assert(static_cast<size_t>(covariance.rows()) == glyph_size);
-        assert(static_cast<size_t>(covariance.cols()) == glyph_size);
+    // Method used by analyze() for PcaMethod::Auto.
+    PcaMethod chooseMethod(size_t component_cnt) const
+    {
+        size_t glyph_size = font_->glyphWidth() * font_->glyphHeight();
+        size_t samples_cnt = font_->glyphCount();
+        size_t rank_max = std::min(glyph_size, samples_cnt);
+        if (component_cnt > 0 && rank_max > TRUNCATED_MIN_RANK
+                && (component_cnt + TRUNCATED_OVERSAMPLING) * TRUNCATED_MIN_RATIO <= rank_max)
+            return PcaMethod::Truncated;
+        return samples_cnt < glyph_size ? PcaMethod::Gram : PcaMethod::Covariance;
+    }
 
-        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigen_solver(covariance);
+    // Folds the glyphs that f adds to the analyzed font into the
+    // decomposition instead of analyzing f from scratch. The scatter matrix
+    // of the analyzed glyphs is kept as its components, so only a matrix
+    // of the component count plus the number of added glyphs is solved.
+    // The result equals a fresh analysis up to rounding. Truncated
+    // components lack the energy outside of them, so they are refined
+    // with a subspace iteration over all glyphs afterwards, which is still
+    // a fraction of the cost of a fresh truncated analysis.
+    // f has to contain all analyzed glyphs in their order, anywhere among
+    // the new ones. Returns false, keeping the decomposition, otherwise.
+    bool update(boost::shared_ptr<const FontImageT> f)
+    {
+        size_t glyph_size = f->glyphWidth() * f->glyphHeight();
+        if (static_cast<size_t>(mean_.size()) != glyph_size || samples_.cols() == 0)
+            return false;
 
-        Eigen::VectorXd eigvals_tmp = eigen_solver.eigenvalues().reverse();
-        energies_ = eigvals_tmp.cwiseMax(Eigen::VectorXd::Zero(glyph_size));
-        assert(static_cast<size_t>(energies_.size()) == glyph_size);
+        Eigen::MatrixXd input_samples = readSamples(*f);
+        std::vector<size_t> added;
+        if (!findAddedSamples(input_samples, added))
+            return false;
+        font_ = f;
+        if (added.empty())
+            return true;
+
+        double old_cnt = samples_.cols();
+        double added_cnt = added.size();
+        Eigen::MatrixXd added_samples(glyph_size, added.size());
+        for (size_t i = 0; i < added.size(); ++i) {
+            added_samples.col(i) = input_samples.col(added[i]);
+        }
+        Eigen::VectorXd added_mean = added_samples.rowwise().sum() / added_cnt;
+
+        //the new scatter matrix is factor * factor^T: the old scatter, the
+        //scatter of the added glyphs, and the shift between their means;
+        //components without energy (all beyond the rank for Covariance) add nothing
+        size_t component_cnt = 0;
+        double min_energy = energies_.size() > 0 ? energies_[0] * std::numeric_limits<double>::epsilon() * energies_.size() : 0.0;
+        while (component_cnt < static_cast<size_t>(energies_.size()) && energies_[component_cnt] > min_energy) {
+            ++component_cnt;
+        }
+        Eigen::MatrixXd factor(glyph_size, component_cnt + added.size() + 1);
+        factor.leftCols(component_cnt) = features_.leftCols(component_cnt) 
+                * (energies_.head(component_cnt) / energyScale()).cwiseSqrt().asDiagonal();
+        factor.middleCols(component_cnt, added.size()) = added_samples.colwise() - added_mean;
+        factor.col(component_cnt + added.size()) = (added_mean - mean_) * std::sqrt(old_cnt * added_cnt / (old_cnt + added_cnt));
 
-        features_ = eigen_solver.eigenvectors().rowwise().reverse();
-        assert(static_cast<size_t>(features_.rows()) == glyph_size);
-        assert(static_cast<size_t>(features_.cols()) == glyph_size);
+        mean_ = (mean_ * old_cnt + added_mean * added_cnt) / (old_cnt + added_cnt);
+        samples_ = input_samples.colwise() - mean_;
+        totalEnergy_ = samples_.squaredNorm() * energyScale();
+
+        size_t rank_max = std::min<size_t>(samples_.rows(), samples_.cols());
+        if (complete_) {
+            decomposeFactor(factor, rank_max);
+        } else {
+            //the energy outside of the truncated components is missing from
+            //the factor, a subspace iteration from the folded components
+            //restores the accuracy of a fresh analysis
+            size_t truncated_cnt = std::min<size_t>(energies_.size(), rank_max);
+            decomposeFactor(factor, std::min(truncated_cnt + TRUNCATED_OVERSAMPLING, rank_max));
+            Eigen::MatrixXd basis = features_;
+            iterateSubspace(basis, std::min<size_t>(truncated_cnt, basis.cols()), TRUNCATED_UPDATE_ITERATIONS);
+        }
+        return true;
     }
 
     bool saveToCache(const std::string& filename) const
     {
         size_t glyph_size = font_->glyphWidth() * font_->glyphHeight();
-        size_t samples_cnt = font_->glyphCount();
+        size_t samples_cnt = samples_.cols();
+        size_t component_cnt = energies_.size();
 
         std::ofstream ofs(filename.c_str(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
         if (!ofs)
@@ -119,6 +236,9 @@ public:
 
         oa << BOOST_SERIALIZATION_NVP(glyph_size);
         oa << BOOST_SERIALIZATION_NVP(samples_cnt);
+        oa << BOOST_SERIALIZATION_NVP(component_cnt);
+        oa << make_nvp("total_energy", totalEnergy_);
+        oa << make_nvp("complete", complete_);
         oa << make_nvp("mean", make_array(mean_.data(), mean_.size()));
         oa << make_nvp("samples", make_array(samples_.data(), samples_.size()));
         oa << make_nvp("energies", make_array(energies_.data(), energies_.size()));
@@ -128,6 +248,89 @@ public:
     }
 
     bool loadFromCache(const std::string& filename)
+    {
+        return readCache(filename, false);
+    }
+
+    // Loads a cache file written for a font missing some of the glyphs of
+    // this one and adds them with update(). Saving the result to the same
+    // file updates it in place.
+    bool updateFromCache(const std::string& filename)
+    {
+        return readCache(filename, true) && update(font_);
+    }
+
+public:
+    boost::shared_ptr<const FontImageT> font() const
+    {
+        return font_;
+    }
+
+    // Number of threads used by analyze(), 0 means one per core.
+    unsigned threadCount() const
+    {
+        return threadCount_;
+    }
+
+    void setThreadCount(unsigned cnt)
+    {
+        threadCount_ = cnt;
+    }
+
+    const Eigen::VectorXd& mean() const
+    {
+        return mean_;
+    }
+
+    const Eigen::MatrixXd& samples() const
+    {
+        return samples_;
+    }
+
+    size_t componentCount() const
+    {
+        return energies_.size();
+    }
+
+    // True when all components with non-zero energy were found.
+    bool isComplete() const
+    {
+        return complete_;
+    }
+
+    const Eigen::VectorXd& energies() const
+    {
+        return energies_;
+    }
+
+    // Sum of the energies of all components, including those that were
+    // not computed.
+    double totalEnergy() const
+    {
+        return totalEnergy_;
+    }
+
+    const Eigen::MatrixXd& features() const
+    {
+        return features_;
+    }
+
+private:
+    //components below this problem size are always found exactly
+    static const size_t TRUNCATED_MIN_RANK = 256;
+    //exact methods are used unless the subspace is this many times smaller than the problem
+    static const size_t TRUNCATED_MIN_RATIO = 4;
+    //extra subspace dimensions improving the accuracy of the last components
+    static const size_t TRUNCATED_OVERSAMPLING = 10;
+    static const unsigned TRUNCATED_ITERATIONS = 4;
+    //iterations refining truncated components after update()
+    static const unsigned TRUNCATED_UPDATE_ITERATIONS = 1;
+    //components found when Truncated is not given their number
+    static const size_t TRUNCATED_DEFAULT_COMPONENTS = 32;
+    //largest pixel difference of glyphs considered equal by update()
+    static const double SAMPLE_TOLERANCE;
+
+    bool readCache(const std::string& filename, bool font_subset)
     {
         std::ifstream ifs(filename.c_str(), std::ios_base::in | std::ios_base::binary);
         if (!ifs)
@@ -137,59 +340,212 @@ public:
 
         using namespace boost::serialization;
 
-        size_t glyph_size, samples_cnt;
+        size_t glyph_size, samples_cnt, component_cnt;
         ia >> BOOST_SERIALIZATION_NVP(glyph_size);
         if (glyph_size != font_->glyphWidth() * font_->glyphHeight())
             return false;
         ia >> BOOST_SERIALIZATION_NVP(samples_cnt);
-        if (samples_cnt != font_->glyphCount())
+        if (font_subset ? samples_cnt > font_->glyphCount() : samples_cnt != font_->glyphCount())
+            return false;
+        ia >> BOOST_SERIALIZATION_NVP(component_cnt);
+        if (component_cnt > std::min(glyph_size, samples_cnt))
             return false;
+        ia >> make_nvp("total_energy", totalEnergy_);
+        ia >> make_nvp("complete", complete_);
         mean_.resize(glyph_size);
         ia >> make_nvp("mean", make_array(mean_.data(), mean_.size()));
         samples_.resize(glyph_size, samples_cnt);
         ia >> make_nvp("samples", make_array(samples_.data(), samples_.size()));
-        energies_.resize(glyph_size);
+        energies_.resize(component_cnt);
         ia >> make_nvp("energies", make_array(energies_.data(), energies_.size()));
-        features_.resize(glyph_size, glyph_size);
+        features_.resize(glyph_size, component_cnt);
         ia >> make_nvp("features", make_array(features_.data(), features_.size()));
 
         return true;
     }
 
-public:
-    boost::shared_ptr<const FontImageT> font() const
+    void loadSamples()
     {
-        return font_;
+        Eigen::MatrixXd input_samples = readSamples(*font_);
+        size_t samples_cnt = input_samples.cols();
+
+        mean_ = input_samples.rowwise().sum() / samples_cnt;
+        assert(mean_.size() == input_samples.rows());
+
+        samples_ = input_samples.colwise() - mean_;
+        assert(samples_.rows() == input_samples.rows());
+        assert(samples_.cols() == input_samples.cols());
+
+        totalEnergy_ = samples_.squaredNorm() * energyScale();
     }
 
-    const Eigen::VectorXd& mean() const
+    static Eigen::MatrixXd readSamples(const FontImageT& font)
     {
-        return mean_;
+        size_t glyph_size = font.glyphWidth() * font.glyphHeight();
+        size_t samples_cnt = font.glyphCount();
+
+        typedef boost::gil::layout<
+                typename boost::gil::color_space_type<ConstViewT>::type,
+                typename boost::gil::channel_mapping_type<ConstViewT>::type
+                > LayoutT;
+        typedef typename float_channel_type<typename boost::gil::channel_type<ConstViewT>::type>::type FloatChannelT;
+        typedef typename boost::gil::pixel_value_type<FloatChannelT, LayoutT>::type FloatPixelT;
+        typedef typename boost::gil::type_from_x_iterator<FloatPixelT*>::view_t FloatViewT;
+
+        Eigen::VectorXf tmp_glyph_data(glyph_size * boost::gil::num_channels<FloatPixelT>::value);
+        FloatViewT tmp_glyph_view = boost::gil::interleaved_view(
+                font.glyphWidth(), font.glyphHeight(),
+                reinterpret_cast<FloatPixelT*>(tmp_glyph_data.data()),
+                font.glyphWidth() * sizeof(FloatPixelT));
+
+        Eigen::MatrixXd input_samples(glyph_size, samples_cnt);
+        for (size_t ci = 0; ci < samples_cnt; ++ci) {
+            ConstViewT glyph_surface = font.getGlyph(ci);
+            boost::gil::copy_and_convert_pixels(glyph_surface, tmp_glyph_view);
+            input_samples.col(ci) = tmp_glyph_data.template cast<double>();
+        }
+        return input_samples;
     }
 
-    const Eigen::MatrixXd& samples() const
+    // Matches the analyzed samples, in order, with the columns of
+    // input_samples and lists the columns left over. Glyphs with equal
+    // pixels are interchangeable, so the first match is as good as any.
+    bool findAddedSamples(const Eigen::MatrixXd& input_samples, std::vector<size_t>& added) const
     {
-        return samples_;
+        if (input_samples.rows() != samples_.rows() || input_samples.cols() < samples_.cols())
+            return false;
+        ptrdiff_t matched = 0;
+        for (ptrdiff_t ci = 0; ci < input_samples.cols(); ++ci) {
+            if (matched < samples_.cols() && ((samples_.col(matched) + mean_) - input_samples.col(ci)).cwiseAbs().maxCoeff() < SAMPLE_TOLERANCE) {
+                ++matched;
+            } else {
+                added.push_back(ci);
+            }
+        }
+        return matched == samples_.cols();
     }
 
-    const Eigen::VectorXd& energies() const
+    //converts squared sample norms to variances
+    double energyScale() const
     {
-        return energies_;
+        return 1.0 / std::max<ptrdiff_t>(samples_.cols() - 1, 1);
     }
 
-    const Eigen::MatrixXd& features() const
+    unsigned threads() const
     {
-        return features_;
+        return threadCount_ > 0 ? threadCount_ : std::max(boost::thread::hardware_concurrency(), 1u);
+    }
+
+    void analyzeCovariance()
+    {
+        Eigen::MatrixXd samples_t = samples_.transpose();
+        Eigen::MatrixXd covariance;
+        Internal::parallelTransposedProduct(samples_t, samples_t, covariance, threads());
+        covariance *= energyScale();
+
+        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigen_solver(covariance);
+
+        energies_ = eigen_solver.eigenvalues().reverse().cwiseMax(0.0);
+        features_ = eigen_solver.eigenvectors().rowwise().reverse();
+        complete_ = true;
+    }
+
+    void analyzeGram()
+    {
+        decomposeFactor(samples_, std::min<size_t>(samples_.rows(), samples_.cols()));
+        complete_ = true;
+    }
+
+    // Finds up to max_cnt strongest components of the scatter matrix
+    // factor * factor^T from the Gram matrix of the factor. The Gram matrix
+    // shares the non-zero eigenvalues of the scatter matrix; its
+    // eigenvectors v map to the pixel space as factor v / |factor v|.
+    void decomposeFactor(const Eigen::MatrixXd& factor, size_t max_cnt)
+    {
+        Eigen::MatrixXd gram;
+        Internal::parallelTransposedProduct(factor, factor, gram, threads());
+        gram *= energyScale();
+
+        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigen_solver(gram);
+
+        Eigen::VectorXd eigvals = eigen_solver.eigenvalues().reverse().cwiseMax(0.0);
+        //directions without energy cannot be mapped back, the covariance path yields zeros there
+        ptrdiff_t component_cnt = 0;
+        double min_energy = eigvals.size() > 0 ? eigvals[0] * std::numeric_limits<double>::epsilon() * eigvals.size() : 0.0;
+        while (component_cnt < std::min<ptrdiff_t>(eigvals.size(), max_cnt) && eigvals[component_cnt] > min_energy) {
+            ++component_cnt;
+        }
+
+        Eigen::MatrixXd coefficients = eigen_solver.eigenvectors().rowwise().reverse().leftCols(component_cnt);
+        Eigen::VectorXd norms = (eigvals.head(component_cnt) / energyScale()).cwiseSqrt();
+        coefficients *= norms.cwiseInverse().asDiagonal();
+
+        Eigen::MatrixXd factor_t = factor.transpose();
+        Internal::parallelTransposedProduct(factor_t, coefficients, features_, threads());
+        energies_ = eigvals.head(component_cnt);
+    }
+
+    // Randomized subspace iteration (Halko, Martinsson, Tropp) with a
+    // Rayleigh-Ritz step. The covariance matrix is never formed, it is
+    // applied as X (X^T q).
+    void analyzeTruncated(size_t component_cnt)
+    {
+        size_t rank_max = std::min<size_t>(samples_.rows(), samples_.cols());
+        if (component_cnt == 0) {
+            component_cnt = TRUNCATED_DEFAULT_COMPONENTS;
+        }
+        component_cnt = std::min(component_cnt, rank_max);
+        size_t subspace_dim = std::min(component_cnt + TRUNCATED_OVERSAMPLING, rank_max);
+
+        //fixed seed, so that repeated analyses give the same components
+        boost::mt19937 rng(component_cnt);
+        Eigen::MatrixXd basis(samples_.rows(), subspace_dim);
+        for (ptrdiff_t c = 0; c < basis.cols(); ++c) {
+            for (ptrdiff_t r = 0; r < basis.rows(); ++r) {
+                basis(r, c) = static_cast<double>(rng()) / rng.max() - 0.5;
+            }
+        }
+
+        iterateSubspace(basis, component_cnt, TRUNCATED_ITERATIONS);
+    }
+
+    // Subspace iterations starting from basis, followed by a Rayleigh-Ritz
+    // step keeping component_cnt components.
+    void iterateSubspace(Eigen::MatrixXd& basis, size_t component_cnt, unsigned iterations)
+    {
+        size_t rank_max = std::min<size_t>(samples_.rows(), samples_.cols());
+        Eigen::MatrixXd samples_t = samples_.transpose();
+        Eigen::MatrixXd coordinates;
+        for (unsigned i = 0; i < iterations; ++i) {
+            Internal::orthonormalizeColumns(basis);
+            Internal::parallelTransposedProduct(samples_, basis, coordinates, threads());
+            Internal::parallelTransposedProduct(samples_t, coordinates, basis, threads());
+        }
+        Internal::orthonormalizeColumns(basis);
+
+        Internal::parallelTransposedProduct(samples_, basis, coordinates, threads());
+        Eigen::MatrixXd projected = coordinates.transpose() * coordinates * energyScale();
+        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigen_solver(projected);
+
+        energies_ = eigen_solver.eigenvalues().reverse().head(component_cnt).cwiseMax(0.0);
+        features_ = basis * eigen_solver.eigenvectors().rowwise().reverse().leftCols(component_cnt);
+        complete_ = (component_cnt == rank_max);
     }
 
 private:
     boost::shared_ptr<const FontImageT> font_;
+    unsigned threadCount_;
     Eigen::VectorXd mean_;
     Eigen::MatrixXd samples_;
+    double totalEnergy_;
+    bool complete_;
     Eigen::VectorXd energies_;
     Eigen::MatrixXd features_;
 };
 
+template<class TFontImage>
+const double FontEigendecomposition<TFontImage>::SAMPLE_TOLERANCE = 1e-6;
+
 template<class TEigendecomposition>
 class FontPrincipalComponents
 {
@@ -198,32 +554,119 @@ public:
     typedef typename EigendecompositionT::FontImageT FontImageT;
 
 public:
+    // Keeps only what matching needs: the mean, the first feat_cnt basis
+    // vectors and the glyph coordinates. The decomposition is not
+    // referenced afterwards and can be released.
     FontPrincipalComponents(boost::shared_ptr<const EigendecompositionT> decomp, size_t feat_cnt)
-        :decomposition_(decomp)
+        :font_(decomp->font())
+        ,halfPrecision_(false)
     {
+        feat_cnt = std::min(feat_cnt, decomp->componentCount());
         size_t glyph_size = font()->glyphWidth() * font()->glyphHeight();
         size_t samples_cnt = font()->glyphCount();
 
-        mean_ = decomposition_->mean().template cast<float>();
+        mean_ = decomp->mean().template cast<float>();
         assert(static_cast<size_t>(mean_.size()) == glyph_size);
 
-        Eigen::VectorXd energies_dbl = decomposition_->energies().head(feat_cnt);
+        Eigen::VectorXd energies_dbl = decomp->energies().head(feat_cnt);
         energies_dbl /= energies_dbl.sum();
         energies_dbl *= energies_dbl.size();
         energies_ = energies_dbl.template cast<float>();
         assert(static_cast<size_t>(energies_.size()) == feat_cnt);
 
-        Eigen::MatrixXd features_dbl = decomposition_->features().leftCols(feat_cnt);
+        Eigen::MatrixXd features_dbl = decomp->features().leftCols(feat_cnt);
         features_ = features_dbl.template cast<float>();
         assert(static_cast<size_t>(features_.rows()) == glyph_size);
         assert(static_cast<size_t>(features_.cols()) == feat_cnt);
+        projectedMean_ = features_.transpose() * mean_;
 
-        Eigen::MatrixXd glyphs_dbl = (features_dbl * energies_dbl.asDiagonal()).transpose() * decomposition_->samples();
+        Eigen::MatrixXd glyphs_dbl = (features_dbl * energies_dbl.asDiagonal()).transpose() * decomp->samples();
         glyphs_ = glyphs_dbl.template cast<float>();
         assert(static_cast<size_t>(glyphs_.cols()) == samples_cnt);
         assert(static_cast<size_t>(glyphs_.rows()) == feat_cnt);
     }
 
+    // Empty components of the given font, to be filled by loadFromCache().
+    explicit FontPrincipalComponents(boost::shared_ptr<const FontImageT> f)
+        :font_(f)
+        ,halfPrecision_(false)
+    {
+    }
+
+    // Rounds all values to half precision; saveToCache() then stores them
+    // in half the space. Matching still computes in float, so results only
+    // differ by the rounding, and do not depend on whether the components
+    // were built or loaded.
+    void setHalfPrecision()
+    {
+        roundToHalf(mean_);
+        roundToHalf(energies_);
+        roundToHalf(features_);
+        roundToHalf(glyphs_);
+        projectedMean_ = features_.transpose() * mean_;
+        halfPrecision_ = true;
+    }
+
+    bool saveToCache(const std::string& filename) const
+    {
+        size_t glyph_size = font()->glyphWidth() * font()->glyphHeight();
+        size_t samples_cnt = font()->glyphCount();
+        size_t feature_cnt = energies_.size();
+
+        std::ofstream ofs(filename.c_str(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+        if (!ofs)
+            return false;
+
+        boost::archive::binary_oarchive oa(ofs);
+
+        using namespace boost::serialization;
+
+        oa << BOOST_SERIALIZATION_NVP(glyph_size);
+        oa << BOOST_SERIALIZATION_NVP(samples_cnt);
+        oa << BOOST_SERIALIZATION_NVP(feature_cnt);
+        oa << make_nvp("half_precision", halfPrecision_);
+        saveValues(oa, "mean", mean_.data(), mean_.size());
+        saveValues(oa, "energies", energies_.data(), energies_.size());
+        saveValues(oa, "features", features_.data(), features_.size());
+        saveValues(oa, "glyphs", glyphs_.data(), glyphs_.size());
+
+        return true;
+    }
+
+    bool loadFromCache(const std::string& filename)
+    {
+        std::ifstream ifs(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+        if (!ifs)
+            return false;
+
+        boost::archive::binary_iarchive ia(ifs);
+
+        using namespace boost::serialization;
+
+        size_t glyph_size, samples_cnt, feature_cnt;
+        ia >> BOOST_SERIALIZATION_NVP(glyph_size);
+        if (glyph_size != font()->glyphWidth() * font()->glyphHeight())
+            return false;
+        ia >> BOOST_SERIALIZATION_NVP(samples_cnt);
+        if (samples_cnt != font()->glyphCount())
+            return false;
+        ia >> BOOST_SERIALIZATION_NVP(feature_cnt);
+        if (feature_cnt > glyph_size)
+            return false;
+        ia >> make_nvp("half_precision", halfPrecision_);
+        mean_.resize(glyph_size);
+        loadValues(ia, "mean", mean_.data(), mean_.size());
+        energies_.resize(feature_cnt);
+        loadValues(ia, "energies", energies_.data(), energies_.size());
+        features_.resize(glyph_size, feature_cnt);
+        loadValues(ia, "features", features_.data(), features_.size());
+        glyphs_.resize(feature_cnt, samples_cnt);
+        loadValues(ia, "glyphs", glyphs_.data(), glyphs_.size());
+        projectedMean_ = features_.transpose() * mean_;
+
+        return true;
+    }
+
 public:
     Eigen::VectorXf combine(const Eigen::VectorXf& vec) const
     {
@@ -248,14 +691,24 @@ public:
     Eigen::VectorXf& project(const Eigen::VectorXf& vec, Eigen::VectorXf& out) const
     {
         assert(vec.size() == features_.rows());
-        out = (features_.transpose() * (vec - mean_)).cwiseProduct(energies_);
+        //written without temporaries, out is reused between calls
+        out.noalias() = features_.transpose() * vec;
+        out -= projectedMean_;
+        out.array() *= energies_.array();
         return out;
     }
 
     size_t findClosestGlyph(const Eigen::VectorXf& vec) const
     {
         size_t min_index = 0;
-        (glyphs_.colwise() - vec).colwise().squaredNorm().minCoeff(&min_index);
+        float min_dist = std::numeric_limits<float>::max();
+        for (Eigen::MatrixXf::Index i = 0; i < glyphs_.cols(); ++i) {
+            float dist = (glyphs_.col(i) - vec).squaredNorm();
+            if (dist < min_dist) {
+                min_dist = dist;
+                min_index = i;
+            }
+        }
         return min_index;
     }
 
@@ -265,14 +718,14 @@ public:
         return energies_.size();
     }
 
-    boost::shared_ptr<const EigendecompositionT> decomposition() const
+    boost::shared_ptr<const FontImageT> font() const
     {
-        return decomposition_;
+        return font_;
     }
 
-    boost::shared_ptr<const FontImageT> font() const
+    bool halfPrecision() const
     {
-        return decomposition_->font();
+        return halfPrecision_;
     }
 
     const Eigen::VectorXf& mean() const
@@ -296,11 +749,56 @@ public:
     }
 
 private:
-    boost::shared_ptr<const EigendecompositionT> decomposition_;
+    template<class TMatrix>
+    static void roundToHalf(TMatrix& values)
+    {
+        for (ptrdiff_t i = 0; i < values.size(); ++i) {
+            values.data()[i] = Internal::halfToFloat(Internal::floatToHalf(values.data()[i]));
+        }
+    }
+
+    template<class TArchive>
+    void saveValues(TArchive& oa, const char* name, const float* values, size_t cnt) const
+    {
+        using namespace boost::serialization;
+        if (!halfPrecision_) {
+            oa << make_nvp(name, make_array(values, cnt));
+            return;
+        }
+        std::vector<boost::uint16_t> half_values(cnt);
+        for (size_t i = 0; i < cnt; ++i) {
+            half_values[i] = Internal::floatToHalf(values[i]);
+        }
+        if (cnt > 0) {
+            oa << make_nvp(name, make_array(&half_values[0], cnt));
+        }
+    }
+
+    template<class TArchive>
+    void loadValues(TArchive& ia, const char* name, float* values, size_t cnt) const
+    {
+        using namespace boost::serialization;
+        if (!halfPrecision_) {
+            ia >> make_nvp(name, make_array(values, cnt));
+            return;
+        }
+        std::vector<boost::uint16_t> half_values(cnt);
+        if (cnt > 0) {
+            ia >> make_nvp(name, make_array(&half_values[0], cnt));
+        }
+        for (size_t i = 0; i < cnt; ++i) {
+            values[i] = Internal::halfToFloat(half_values[i]);
+        }
+    }
+
+private:
+    boost::shared_ptr<const FontImageT> font_;
+    bool halfPrecision_;
     Eigen::VectorXf mean_;
     Eigen::VectorXf energies_;
     Eigen::MatrixXf features_;
     Eigen::MatrixXf glyphs_;
+    Eigen::VectorXf projectedMean_;
 };
 
 } } // namespace KG::Ascii
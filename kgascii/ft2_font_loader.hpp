@@ -22,6 +22,7 @@
 #include <set>
 #include <boost/range/algorithm/transform.hpp>
 #include <boost/functional/value_factory.hpp>
+#include <boost/shared_ptr.hpp>
 #include <kgascii/internal/ft2_font_loader.hpp>
 #include <kgascii/symbol.hpp>
 
@@ -48,6 +49,17 @@ public:
         return loader_.isFontOk();
     }
 
+    // Opens the same face with the same settings in a loader of its own,
+    // for rasterizing glyphs on another thread (see loadParallel()).
+    boost::shared_ptr<FT2FontLoader> clone() const
+    {
+        assert(isFontOk());
+
+        boost::shared_ptr<FT2FontLoader> result(new FT2FontLoader);
+        result->loader_.loadFont(loader_);
+        return result;
+    }
+
     Hinting hinting() const
     {
         return loader_.hinting();
@@ -0,0 +1,257 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_GENERATE_FUTURE_HPP
+#define KGASCII_GENERATE_FUTURE_HPP
+
+#include <cstddef>
+#include <cassert>
+#include <vector>
+#include <algorithm>
+#include <boost/exception_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+namespace KG { namespace Ascii {
+
+namespace Internal {
+
+// Completion state of a single asynchronous generate() call.
+// It counts the work items of the frame that are still queued or running;
+// the frame is finished once the count drops to zero.
+class GenerateState: boost::noncopyable
+{
+public:
+    typedef boost::function<void (bool)> CallbackT;
+
+    static boost::shared_ptr<GenerateState> create(const CallbackT& cb)
+    {
+        boost::shared_ptr<GenerateState> ptr(new GenerateState(cb));
+        return ptr;
+    }
+
+    void addTask()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        pending_++;
+    }
+
+    void taskDone()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        assert(pending_ > 0);
+        if (--pending_ > 0)
+            return;
+        bool completed = !cancelled_;
+        CallbackT cb;
+        cb.swap(callback_);
+        lock.unlock();
+        //waiters are released only after the callback has run; an exception
+        //thrown by it still finishes the frame and is passed on to wait()
+        boost::exception_ptr error;
+        if (cb) {
+            try {
+                cb(completed);
+            } catch (...) {
+                error = boost::current_exception();
+            }
+        }
+        lock.lock();
+        error_ = error;
+        finished_ = true;
+        lock.unlock();
+        finishedCondition_.notify_all();
+    }
+
+    void cancel()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        if (pending_ > 0) {
+            cancelled_ = true;
+        }
+    }
+
+    bool cancelled() const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        return cancelled_;
+    }
+
+    bool finished() const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        return finished_;
+    }
+
+    void wait() const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        while (!finished_) {
+            finishedCondition_.wait(lock);
+        }
+        if (error_)
+            boost::rethrow_exception(error_);
+    }
+
+private:
+    friend class GenerateStatePool;
+
+    explicit GenerateState(const CallbackT& cb)
+        :pending_(1)
+        ,cancelled_(false)
+        ,finished_(false)
+        ,callback_(cb)
+    {
+    }
+
+    void restart(const CallbackT& cb)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        assert(finished_);
+        pending_ = 1;
+        cancelled_ = false;
+        finished_ = false;
+        error_ = boost::exception_ptr();
+        callback_ = cb;
+    }
+
+private:
+    mutable boost::mutex mutex_;
+    mutable boost::condition_variable finishedCondition_;
+    size_t pending_;
+    bool cancelled_;
+    bool finished_;
+    CallbackT callback_;
+    boost::exception_ptr error_;
+};
+
+// Recycles the states of finished frames, so that submitting a frame
+// does not allocate once the pool has grown to the number of frames
+// kept in flight at the same time.
+// A state is reused only when the pool holds its last reference, i.e.
+// no future and no queued work item refers to it any more.
+class GenerateStatePool: boost::noncopyable
+{
+public:
+    explicit GenerateStatePool(size_t max_size=16)
+        :maxSize_(max_size)
+    {
+    }
+
+    // Creates finished states up front. Workers may still hold a reference
+    // to the previous frame for a moment after it has finished, so a pool
+    // used by N workers needs N + 1 states to never allocate.
+    void reserve(size_t cnt)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        maxSize_ = std::max(maxSize_, cnt);
+        while (states_.size() < cnt) {
+            boost::shared_ptr<GenerateState> state = GenerateState::create(GenerateState::CallbackT());
+            state->taskDone();
+            states_.push_back(state);
+        }
+    }
+
+    boost::shared_ptr<GenerateState> acquire(const GenerateState::CallbackT& cb)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        for (size_t i = 0; i < states_.size(); ++i) {
+            if (states_[i].use_count() == 1) {
+                states_[i]->restart(cb);
+                return states_[i];
+            }
+        }
+        boost::shared_ptr<GenerateState> state = GenerateState::create(cb);
+        if (states_.size() < maxSize_) {
+            states_.push_back(state);
+        }
+        return state;
+    }
+
+private:
+    boost::mutex mutex_;
+    size_t maxSize_;
+    std::vector<boost::shared_ptr<GenerateState> > states_;
+};
+
+} // namespace Internal
+
+// Handle to a frame submitted with generateAsync().
+// The image view and the text surface passed to generateAsync() belong
+// to the caller and have to stay valid until the frame is finished,
+// i.e. until wait() returns or the completion callback runs.
+// A cancelled frame still finishes, but its remaining cells are skipped
+// and the contents of the text surface are unspecified.
+// The callback runs on the thread that finishes the frame: usually a worker,
+// but the thread calling generateAsync() if the workers are done before it
+// returns, and always for sequential asciifiers. It must not wait for its
+// own frame. An exception thrown by the callback is rethrown by wait().
+// A default-constructed future refers to no frame and is always ready.
+class GenerateFuture
+{
+public:
+    typedef Internal::GenerateState::CallbackT CallbackT;
+
+public:
+    GenerateFuture()
+    {
+    }
+
+    explicit GenerateFuture(boost::shared_ptr<Internal::GenerateState> st)
+        :state_(st)
+    {
+    }
+
+public:
+    bool valid() const
+    {
+        return state_.get() != 0;
+    }
+
+    bool ready() const
+    {
+        return !state_ || state_->finished();
+    }
+
+    bool cancelled() const
+    {
+        return state_ && state_->cancelled();
+    }
+
+    void wait() const
+    {
+        if (state_) {
+            state_->wait();
+        }
+    }
+
+    void cancel()
+    {
+        if (state_) {
+            state_->cancel();
+        }
+    }
+
+private:
+    boost::shared_ptr<Internal::GenerateState> state_;
+};
+
+} } // namespace KG::Ascii
+
+#endif // KGASCII_GENERATE_FUTURE_HPP
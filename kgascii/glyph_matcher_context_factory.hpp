@@ -30,6 +30,8 @@
 #include <kgascii/means_distance.hpp>
 #include <kgascii/mutual_information_glyph_matcher.hpp>
 #include <kgascii/pca_glyph_matcher.hpp>
+#include <kgascii/brightness_ramp_glyph_matcher.hpp>
+#include <kgascii/auto_glyph_matcher.hpp>
 #include <kgascii/internal/glyph_matcher_registration.hpp>
 
 namespace KG { namespace Ascii {
@@ -41,6 +43,8 @@ inline void registerGlyphMatcherFactories()
     static Internal::GlyphMatcherRegistration<TFontImage, MeansDistanceGlyphMatcherFactory> reg_md("md");
     static Internal::GlyphMatcherRegistration<TFontImage, MutualInformationGlyphMatcherFactory> reg_mi("mi");
     static Internal::GlyphMatcherRegistration<TFontImage, PcaGlyphMatcherFactory> reg_pca("pca");
+    static Internal::GlyphMatcherRegistration<TFontImage, BrightnessRampGlyphMatcherFactory> reg_ramp("ramp");
+    static Internal::GlyphMatcherRegistration<TFontImage, AutoGlyphMatcherFactory> reg_auto("auto");
 }
 
 class GlyphMatcherFactory
@@ -15,19 +15,27 @@
 // You should have received a copy of the GNU Lesser General Public License 
 // along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
 
-#ifndef KGASCII_FT2FONTLOADER_HPP
-#define KGASCII_FT2FONTLOADER_HPP
+#ifndef KGASCII_IMAGE_DIR_FONT_LOADER_HPP
+#define KGASCII_IMAGE_DIR_FONT_LOADER_HPP
 
 #include <set>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include <boost/filesystem.hpp>
 #include <boost/gil/gil_all.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/throw_exception.hpp>
 #include <kgutil/image_io.hpp>
 #include <kgascii/symbol.hpp>
 
 namespace KG { namespace Ascii {
 
+// Makes a font of the images in a directory, assigning consecutive symbols
+// from 32 up to them in directory order. All images need the same size.
+// Only the size of the first one is read up front, each image is decoded
+// straight into its glyph by loadGlyph(). The loader is safe to use from
+// several threads, clone() merely shares it.
 class ImageDirectoryFontLoader
 {
 public:
@@ -35,41 +43,35 @@ public:
 
 public:
     explicit ImageDirectoryFontLoader(const boost::filesystem::path& imgdir_path)
+        :glyphWidth_(0)
+        ,glyphHeight_(0)
     {
-        size_t img_cnt = 0;
-        unsigned font_width = 0, font_height = 0;
-
+        boost::shared_ptr<std::vector<std::string> > image_paths(new std::vector<std::string>);
         for (boost::filesystem::directory_iterator
              dir_it(imgdir_path), dir_end; dir_it != dir_end; ++dir_it) 
         {
-            boost::gil::gray8_image_t glyph_image;
-            if (!KG::Util::loadAndConvertImage(dir_it->path().string(), glyph_image))
-                BOOST_THROW_EXCEPTION(std::runtime_error("loadAndConvertImage"));
-
-            unsigned image_w = glyph_image.width();
-            unsigned image_h = glyph_image.height();
-            if (img_cnt == 0) {
-                font_width = image_w;
-                font_height = image_h;
-            } else {
-                if (image_w != font_width)
-                    BOOST_THROW_EXCEPTION(std::runtime_error("width != font_width"));
-                if (image_h != font_height)
-                    BOOST_THROW_EXCEPTION(std::runtime_error("height != font_height"));
-            }
-
-            glyphs_.push_back(glyph_image);
-            charcodes_.push_back(Symbol(32 + img_cnt));
-
-            img_cnt++;
+            image_paths->push_back(dir_it->path().string());
+        }
+        imagePaths_ = image_paths;
+
+        if (!image_paths->empty()) {
+            KG::Util::ImageInfo info;
+            if (!KG::Util::readImageInfo(image_paths->front(), info))
+                BOOST_THROW_EXCEPTION(std::runtime_error("readImageInfo"));
+            glyphWidth_ = info.width;
+            glyphHeight_ = info.height;
         }
 
         baseName_ = imgdir_path.stem().string();
-        glyphWidth_ = font_width;
-        glyphHeight_ = font_height;
     }
 
 public:
+    boost::shared_ptr<ImageDirectoryFontLoader> clone() const
+    {
+        boost::shared_ptr<ImageDirectoryFontLoader> result(new ImageDirectoryFontLoader(*this));
+        return result;
+    }
+
     std::string familyName() const
     {
         return baseName_;
@@ -97,32 +99,42 @@ public:
 
     SymbolCollectionT symbols() const
     {
-        SymbolCollectionT result(charcodes_.begin(), charcodes_.end());
+        SymbolCollectionT result;
+        for (size_t i = 0; i < imagePaths_->size(); ++i) {
+            result.insert(result.end(), Symbol(FIRST_SYMBOL + i));
+        }
         return result;
     }
 
     bool loadGlyph(Symbol charcode, const boost::gil::gray8_view_t& glyph_surf) const
     {
-        std::vector<Symbol>::const_iterator it = std::find(
-                charcodes_.begin(), charcodes_.end(), charcode);
-        if (it == charcodes_.end())
+        if (charcode.value() < FIRST_SYMBOL || charcode.value() - FIRST_SYMBOL >= imagePaths_->size())
             return false;
-
-        size_t index = std::distance(charcodes_.begin(), it);
-        copy_pixels(const_view(glyphs_[index]), glyph_surf);
-
+        const std::string& image_path = (*imagePaths_)[charcode.value() - FIRST_SYMBOL];
+
+        KG::Util::ImageInfo info;
+        if (!KG::Util::readImageInfo(image_path, info))
+            BOOST_THROW_EXCEPTION(std::runtime_error("readImageInfo"));
+        if (info.width != glyphWidth_)
+            BOOST_THROW_EXCEPTION(std::runtime_error("width != font_width"));
+        if (info.height != glyphHeight_)
+            BOOST_THROW_EXCEPTION(std::runtime_error("height != font_height"));
+
+        if (!KG::Util::loadAndConvertView(image_path, glyph_surf))
+            BOOST_THROW_EXCEPTION(std::runtime_error("loadAndConvertView"));
         return true;
     }
 
 private:
+    static const unsigned FIRST_SYMBOL = 32;
+
+private:
+    boost::shared_ptr<const std::vector<std::string> > imagePaths_;
     std::string baseName_;
     unsigned glyphWidth_;
     unsigned glyphHeight_;
-    std::vector<boost::gil::gray8_image_t> glyphs_;
-    std::vector<Symbol> charcodes_;
 };
 
 } } // namespace KG::Ascii
 
-#endif // KGASCII_FT2FONTLOADER_HPP
-
+#endif // KGASCII_IMAGE_DIR_FONT_LOADER_HPP
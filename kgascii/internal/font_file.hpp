@@ -0,0 +1,242 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_INTERNAL_FONT_FILE_HPP
+#define KGASCII_INTERNAL_FONT_FILE_HPP
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/cstdint.hpp>
+#include <boost/throw_exception.hpp>
+#include <boost/gil/gil_all.hpp>
+#include <kgascii/symbol.hpp>
+
+namespace KG { namespace Ascii { namespace Internal {
+
+// Binary font file (.kgf) layout, all integers in host byte order:
+//   header
+//   family and style names, not terminated
+//   symbol table, one uint32 per glyph in ascending order
+//   padding up to FONT_FILE_ALIGNMENT
+//   glyph block, an image one glyph wide with all glyphs stacked from top
+//   to bottom in symbol table order, rows packed without padding
+// The glyph block can be used in place once the file is mapped to memory.
+const char FONT_FILE_MAGIC[8] = { 'K', 'G', 'A', 'F', 'O', 'N', 'T', '\x1a' };
+const boost::uint32_t FONT_FILE_VERSION = 1;
+const boost::uint32_t FONT_FILE_ALIGNMENT = 64;
+const char FONT_FILE_EXTENSION[] = ".kgf";
+// larger fonts are rejected as corrupted
+const boost::uint32_t FONT_FILE_MAX_GLYPH_SIDE = 4096;
+const boost::uint32_t FONT_FILE_MAX_GLYPH_COUNT = 0x110000;
+
+struct FontFileHeader
+{
+    char magic[8];
+    boost::uint32_t version;
+    boost::uint32_t headerSize;
+    boost::uint32_t pixelSize;
+    boost::uint32_t glyphWidth;
+    boost::uint32_t glyphHeight;
+    boost::uint32_t glyphCount;
+    boost::uint32_t channelCount;
+    boost::uint32_t channelSize;
+    boost::uint32_t familyNameOffset;
+    boost::uint32_t familyNameSize;
+    boost::uint32_t styleNameOffset;
+    boost::uint32_t styleNameSize;
+    boost::uint64_t symbolTableOffset;
+    boost::uint64_t glyphDataOffset;
+    boost::uint64_t glyphDataSize;
+};
+
+inline bool hasFontFileMagic(const char* data, size_t size)
+{
+    return size >= sizeof(FONT_FILE_MAGIC) && std::memcmp(data, FONT_FILE_MAGIC, sizeof(FONT_FILE_MAGIC)) == 0;
+}
+
+// True if the file starts with the binary font file magic.
+inline bool isFontFile(const std::string& file_path)
+{
+    std::ifstream fin(file_path.c_str(), std::ios_base::in | std::ios_base::binary);
+    char magic[sizeof(FONT_FILE_MAGIC)];
+    fin.read(magic, sizeof(magic));
+    return hasFontFileMagic(magic, fin.gcount());
+}
+
+inline bool hasFontFileExtension(const std::string& file_path)
+{
+    size_t ext_len = sizeof(FONT_FILE_EXTENSION) - 1;
+    return file_path.size() >= ext_len && file_path.compare(file_path.size() - ext_len, ext_len, FONT_FILE_EXTENSION) == 0;
+}
+
+// Checks that the file of the given size holds a font with the given
+// pixel layout; throws std::runtime_error otherwise.
+template<class TPixel>
+void validateFontFileHeader(const FontFileHeader& hdr, boost::uint64_t file_size)
+{
+    typedef typename boost::gil::channel_type<TPixel>::type ChannelT;
+
+    if (!hasFontFileMagic(hdr.magic, sizeof(hdr.magic)))
+        BOOST_THROW_EXCEPTION(std::runtime_error("not a binary font file"));
+    if (hdr.version != FONT_FILE_VERSION || hdr.headerSize != sizeof(FontFileHeader))
+        BOOST_THROW_EXCEPTION(std::runtime_error("unsupported binary font file version"));
+    if (hdr.channelCount != boost::gil::num_channels<TPixel>::value || hdr.channelSize != sizeof(ChannelT))
+        BOOST_THROW_EXCEPTION(std::runtime_error("font file pixel format does not match"));
+
+    //every factor and offset is bounded first, so that the sums and the
+    //product below can not wrap
+    if (hdr.glyphWidth > FONT_FILE_MAX_GLYPH_SIDE || hdr.glyphHeight > FONT_FILE_MAX_GLYPH_SIDE
+            || hdr.glyphCount > FONT_FILE_MAX_GLYPH_COUNT
+            || hdr.symbolTableOffset > file_size || hdr.glyphDataOffset > file_size)
+        BOOST_THROW_EXCEPTION(std::runtime_error("truncated or corrupted font file"));
+
+    boost::uint64_t glyph_data_size = static_cast<boost::uint64_t>(hdr.glyphWidth) * hdr.glyphHeight 
+        * hdr.glyphCount * sizeof(TPixel);
+    if (hdr.glyphDataSize != glyph_data_size
+            || hdr.glyphDataOffset % FONT_FILE_ALIGNMENT != 0
+            || hdr.glyphDataSize > file_size - hdr.glyphDataOffset
+            || hdr.symbolTableOffset + hdr.glyphCount * sizeof(boost::uint32_t) > hdr.glyphDataOffset
+            || static_cast<boost::uint64_t>(hdr.familyNameOffset) + hdr.familyNameSize > file_size
+            || static_cast<boost::uint64_t>(hdr.styleNameOffset) + hdr.styleNameSize > file_size)
+        BOOST_THROW_EXCEPTION(std::runtime_error("truncated or corrupted font file"));
+}
+
+// Checks that the symbol table of a file whose header passed
+// validateFontFileHeader() is strictly ascending, as the binary search of
+// MappedFont needs; throws std::runtime_error otherwise.
+inline void validateFontFileSymbols(const FontFileHeader& hdr, const char* data)
+{
+    const char* table = data + hdr.symbolTableOffset;
+    boost::uint32_t prev = 0;
+    for (boost::uint32_t i = 0; i < hdr.glyphCount; ++i) {
+        boost::uint32_t sym;
+        std::memcpy(&sym, table + i * sizeof(sym), sizeof(sym));
+        if (i > 0 && sym <= prev)
+            BOOST_THROW_EXCEPTION(std::runtime_error("unsorted or duplicate symbols in font file"));
+        prev = sym;
+    }
+}
+
+// Symbol table order, i.e. the glyph indices of the font sorted by symbol.
+template<class TFont>
+std::vector<size_t> fontFileGlyphOrder(const TFont& font)
+{
+    std::vector<std::pair<unsigned, size_t> > keys(font.glyphCount());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        keys[i] = std::make_pair(font.getSymbol(i).value(), i);
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<size_t> order(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        order[i] = keys[i].second;
+    }
+    return order;
+}
+
+template<class TFont>
+void writeFontFile(const TFont& font, std::ostream& os)
+{
+    typedef typename TFont::PixelT PixelT;
+    typedef typename boost::gil::channel_type<PixelT>::type ChannelT;
+
+    std::vector<size_t> order = fontFileGlyphOrder(font);
+
+    FontFileHeader hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    std::memcpy(hdr.magic, FONT_FILE_MAGIC, sizeof(FONT_FILE_MAGIC));
+    hdr.version = FONT_FILE_VERSION;
+    hdr.headerSize = sizeof(FontFileHeader);
+    hdr.pixelSize = font.pixelSize();
+    hdr.glyphWidth = font.glyphWidth();
+    hdr.glyphHeight = font.glyphHeight();
+    hdr.glyphCount = order.size();
+    hdr.channelCount = boost::gil::num_channels<PixelT>::value;
+    hdr.channelSize = sizeof(ChannelT);
+    hdr.familyNameOffset = sizeof(FontFileHeader);
+    hdr.familyNameSize = font.familyName().size();
+    hdr.styleNameOffset = hdr.familyNameOffset + hdr.familyNameSize;
+    hdr.styleNameSize = font.styleName().size();
+    hdr.symbolTableOffset = hdr.styleNameOffset + hdr.styleNameSize;
+    boost::uint64_t table_end = hdr.symbolTableOffset + order.size() * sizeof(boost::uint32_t);
+    hdr.glyphDataOffset = (table_end + FONT_FILE_ALIGNMENT - 1) / FONT_FILE_ALIGNMENT * FONT_FILE_ALIGNMENT;
+    hdr.glyphDataSize = static_cast<boost::uint64_t>(hdr.glyphWidth) * hdr.glyphHeight * hdr.glyphCount * sizeof(PixelT);
+
+    os.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    os.write(font.familyName().data(), font.familyName().size());
+    os.write(font.styleName().data(), font.styleName().size());
+    std::vector<boost::uint32_t> symbols(order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        symbols[i] = font.getSymbol(order[i]).value();
+    }
+    if (!symbols.empty()) {
+        os.write(reinterpret_cast<const char*>(&symbols[0]), symbols.size() * sizeof(boost::uint32_t));
+    }
+    std::vector<char> padding(hdr.glyphDataOffset - table_end, 0);
+    if (!padding.empty()) {
+        os.write(&padding[0], padding.size());
+    }
+
+    std::vector<PixelT> row_buffer(hdr.glyphWidth);
+    for (size_t i = 0; i < order.size() && hdr.glyphWidth > 0; ++i) {
+        typename TFont::ConstViewT glyph = font.getGlyph(order[i]);
+        for (unsigned y = 0; y < hdr.glyphHeight; ++y) {
+            std::copy(glyph.row_begin(y), glyph.row_end(y), row_buffer.begin());
+            os.write(reinterpret_cast<const char*>(&row_buffer[0]), row_buffer.size() * sizeof(PixelT));
+        }
+    }
+}
+
+// Fills the font from a whole binary font file read into memory.
+template<class TFont>
+void readFontFile(TFont& font, const char* data, size_t size)
+{
+    typedef typename TFont::PixelT PixelT;
+
+    if (size < sizeof(FontFileHeader))
+        BOOST_THROW_EXCEPTION(std::runtime_error("truncated or corrupted font file"));
+    FontFileHeader hdr;
+    std::memcpy(&hdr, data, sizeof(hdr));
+    validateFontFileHeader<PixelT>(hdr, size);
+    validateFontFileSymbols(hdr, data);
+
+    font.setFamilyName(std::string(data + hdr.familyNameOffset, hdr.familyNameSize));
+    font.setStyleName(std::string(data + hdr.styleNameOffset, hdr.styleNameSize));
+    font.setPixelSize(hdr.pixelSize);
+    font.setGlyphSize(hdr.glyphWidth, hdr.glyphHeight);
+    font.clear();
+    font.reserve(hdr.glyphCount);
+
+    typename boost::gil::type_from_x_iterator<const PixelT*>::view_t block = boost::gil::interleaved_view(
+            hdr.glyphWidth, hdr.glyphHeight * hdr.glyphCount, 
+            reinterpret_cast<const PixelT*>(data + hdr.glyphDataOffset), hdr.glyphWidth * sizeof(PixelT));
+    for (boost::uint32_t i = 0; i < hdr.glyphCount; ++i) {
+        boost::uint32_t sym;
+        std::memcpy(&sym, data + hdr.symbolTableOffset + i * sizeof(sym), sizeof(sym));
+        boost::gil::copy_pixels(boost::gil::subimage_view(block, 0, i * hdr.glyphHeight, hdr.glyphWidth, hdr.glyphHeight),
+                font.addGlyph(Symbol(sym)));
+    }
+    font.finalize();
+}
+
+} } } // namespace KG::Ascii::Internal
+
+#endif // KGASCII_INTERNAL_FONT_FILE_HPP
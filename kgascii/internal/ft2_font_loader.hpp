@@ -96,6 +96,8 @@ public:
         ,hinting_(Hinting::Normal)
         ,autohint_(AutoHinter::Off)
         ,mode_(RenderMode::Grayscale)
+        ,faceIndex_(0)
+        ,requestedSize_(0)
     {
     }
 
@@ -117,7 +119,7 @@ public:
                 continue;
             if (FT_IS_SCALABLE(ft_face.handle())) {
                 ft_face.setPixelSizes(pixel_size, pixel_size);
-                face_ = ft_face_ptr;
+                setFace(ft_face_ptr, file_path, face_idx - 1, pixel_size);
                 return true;
             }
             if (!FT_HAS_FIXED_SIZES(ft_face.handle()))
@@ -127,7 +129,7 @@ public:
                 FT_Bitmap_Size size = ft_face->available_sizes[si];
                 if (static_cast<unsigned>(size.y_ppem / 64) == pixel_size) {
                     ft_face.setPixelSizes(pixel_size, pixel_size);
-                    face_ = ft_face_ptr;
+                    setFace(ft_face_ptr, file_path, face_idx - 1, pixel_size);
                     return true;
                 }
             }
@@ -136,6 +138,24 @@ public:
         return false;
     }
 
+    // Opens the face selected by loadFont() of another loader, with its
+    // own FT_Library, and copies the rendering settings.
+    // FreeType libraries and faces must not be used by several threads at
+    // once, so every thread rasterizing glyphs needs a loader of its own.
+    bool loadFont(const FT2FontLoader& other)
+    {
+        assert(other.isFontOk());
+
+        boost::shared_ptr<FT2pp::Face> ft_face_ptr(new FT2pp::Face(*library_, other.filePath_, other.faceIndex_));
+        ft_face_ptr->setPixelSizes(other.requestedSize_, other.requestedSize_);
+        setFace(ft_face_ptr, other.filePath_, other.faceIndex_, other.requestedSize_);
+
+        hinting_ = other.hinting_;
+        autohint_ = other.autohint_;
+        mode_ = other.mode_;
+        return true;
+    }
+
     bool isFontOk() const
     {
         return face_;
@@ -309,6 +329,15 @@ public:
     }
 
 private:
+    void setFace(boost::shared_ptr<FT2pp::Face> face, const std::string& file_path, int face_idx, unsigned pixel_size)
+    {
+        face_ = face;
+        glyph_loaded_ = false;
+        filePath_ = file_path;
+        faceIndex_ = face_idx;
+        requestedSize_ = pixel_size;
+    }
+
     int makeLoadFlags() const
     {
         int loadf = FT_LOAD_DEFAULT;
@@ -346,6 +375,9 @@ private:
     Hinting hinting_;
     AutoHinter autohint_;
     RenderMode mode_;
+    std::string filePath_;
+    int faceIndex_;
+    unsigned requestedSize_;
 };
 
 } } } // namespace KG::Ascii::Internal
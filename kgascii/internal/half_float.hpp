@@ -0,0 +1,94 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+#ifndef KGASCII_INTERNAL_HALF_FLOAT_HPP
+#define KGASCII_INTERNAL_HALF_FLOAT_HPP
+
+#include <cstring>
+#include <boost/cstdint.hpp>
+
+namespace KG { namespace Ascii { namespace Internal {
+
+// Conversions between float and IEEE 754 binary16, used to store data
+// in half the space where the precision suffices. Rounding is to nearest
+// even, values out of range become infinities.
+inline boost::uint16_t floatToHalf(float value)
+{
+    boost::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    boost::uint32_t sign = (bits >> 16) & 0x8000;
+    boost::uint32_t abs_bits = bits & 0x7fffffff;
+
+    if (abs_bits >= 0x7f800000) {
+        //infinity stays infinity, NaN stays (quiet) NaN
+        return static_cast<boost::uint16_t>(sign | 0x7c00 | (abs_bits > 0x7f800000 ? 0x200 : 0));
+    }
+    if (abs_bits >= 0x477ff000) {
+        //65520 and above round to infinity
+        return static_cast<boost::uint16_t>(sign | 0x7c00);
+    }
+    if (abs_bits < 0x38800000) {
+        //below the smallest normal half, 2^-14
+        if (abs_bits < 0x33000000)
+            return static_cast<boost::uint16_t>(sign);
+        boost::uint32_t shift = 126 - (abs_bits >> 23);
+        boost::uint32_t mantissa = (abs_bits & 0x7fffff) | 0x800000;
+        boost::uint32_t result = mantissa >> shift;
+        boost::uint32_t rest = mantissa & ((1u << shift) - 1);
+        boost::uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (result & 1)))
+            ++result;
+        return static_cast<boost::uint16_t>(sign | result);
+    }
+
+    boost::uint32_t result = (abs_bits >> 13) - ((127 - 15) << 10);
+    boost::uint32_t rest = abs_bits & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (result & 1)))
+        ++result;
+    return static_cast<boost::uint16_t>(sign | result);
+}
+
+inline float halfToFloat(boost::uint16_t value)
+{
+    boost::uint32_t sign = static_cast<boost::uint32_t>(value & 0x8000) << 16;
+    boost::uint32_t exponent = (value >> 10) & 0x1f;
+    boost::uint32_t mantissa = value & 0x3ff;
+
+    boost::uint32_t bits;
+    if (exponent == 0x1f) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+        bits = sign;
+    } else {
+        //subnormal half, normal float
+        exponent = 127 - 14;
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            --exponent;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+} } } // namespace KG::Ascii::Internal
+
+#endif // KGASCII_INTERNAL_HALF_FLOAT_HPP
@@ -0,0 +1,162 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+#ifndef KGASCII_INTERNAL_INT_VECTOR_HPP
+#define KGASCII_INTERNAL_INT_VECTOR_HPP
+
+#include <cstddef>
+#include <boost/cstdint.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define KGASCII_INT_VECTOR_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace KG { namespace Ascii { namespace Internal {
+
+// Integer vector kernels of the quantized matchers. The vectors are
+// padded with zeros to a multiple of INT_VECTOR_BLOCK elements and the
+// caller keeps the sums within the range of int32.
+// dotProduct4() computes the products of a with 4 vectors placed stride
+// elements apart, loading a only once for all of them.
+
+const size_t INT_VECTOR_BLOCK = 16;
+
+inline size_t intVectorLength(size_t n)
+{
+    return (n + INT_VECTOR_BLOCK - 1) / INT_VECTOR_BLOCK * INT_VECTOR_BLOCK;
+}
+
+#ifdef KGASCII_INT_VECTOR_SSE2
+
+inline boost::int32_t horizontalSum(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+//sign extends the low and the high 8 bytes of v to 16 bits
+inline __m128i unpackLow8(__m128i v)
+{
+    return _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+}
+
+inline __m128i unpackHigh8(__m128i v)
+{
+    return _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8);
+}
+
+inline void dotProduct4(const boost::int16_t* a, const boost::int16_t* b, size_t stride, size_t n, boost::int32_t* out)
+{
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    __m128i acc2 = _mm_setzero_si128();
+    __m128i acc3 = _mm_setzero_si128();
+    for (size_t i = 0; i < n; i += 8) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        const boost::int16_t* pb = b + i;
+        acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(va, _mm_loadu_si128(reinterpret_cast<const __m128i*>(pb))));
+        pb += stride;
+        acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(va, _mm_loadu_si128(reinterpret_cast<const __m128i*>(pb))));
+        pb += stride;
+        acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(va, _mm_loadu_si128(reinterpret_cast<const __m128i*>(pb))));
+        pb += stride;
+        acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(va, _mm_loadu_si128(reinterpret_cast<const __m128i*>(pb))));
+    }
+    out[0] = horizontalSum(acc0);
+    out[1] = horizontalSum(acc1);
+    out[2] = horizontalSum(acc2);
+    out[3] = horizontalSum(acc3);
+}
+
+inline __m128i maddInt8(__m128i va_lo, __m128i va_hi, const boost::int8_t* b)
+{
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+    return _mm_add_epi32(_mm_madd_epi16(va_lo, unpackLow8(vb)), _mm_madd_epi16(va_hi, unpackHigh8(vb)));
+}
+
+inline void dotProduct4(const boost::int16_t* a, const boost::int8_t* b, size_t stride, size_t n, boost::int32_t* out)
+{
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    __m128i acc2 = _mm_setzero_si128();
+    __m128i acc3 = _mm_setzero_si128();
+    for (size_t i = 0; i < n; i += 16) {
+        __m128i va_lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i va_hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i + 8));
+        const boost::int8_t* pb = b + i;
+        acc0 = _mm_add_epi32(acc0, maddInt8(va_lo, va_hi, pb));
+        pb += stride;
+        acc1 = _mm_add_epi32(acc1, maddInt8(va_lo, va_hi, pb));
+        pb += stride;
+        acc2 = _mm_add_epi32(acc2, maddInt8(va_lo, va_hi, pb));
+        pb += stride;
+        acc3 = _mm_add_epi32(acc3, maddInt8(va_lo, va_hi, pb));
+    }
+    out[0] = horizontalSum(acc0);
+    out[1] = horizontalSum(acc1);
+    out[2] = horizontalSum(acc2);
+    out[3] = horizontalSum(acc3);
+}
+
+inline boost::int32_t squaredDistance(const boost::int16_t* a, const boost::int16_t* b, size_t n)
+{
+    __m128i acc = _mm_setzero_si128();
+    for (size_t i = 0; i < n; i += 8) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        __m128i diff = _mm_sub_epi16(va, vb);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(diff, diff));
+    }
+    return horizontalSum(acc);
+}
+
+#else // KGASCII_INT_VECTOR_SSE2
+
+template<typename TValue>
+inline boost::int32_t dotProduct(const boost::int16_t* a, const TValue* b, size_t n)
+{
+    boost::int32_t result = 0;
+    for (size_t i = 0; i < n; ++i) {
+        result += boost::int32_t(a[i]) * b[i];
+    }
+    return result;
+}
+
+template<typename TValue>
+inline void dotProduct4(const boost::int16_t* a, const TValue* b, size_t stride, size_t n, boost::int32_t* out)
+{
+    for (size_t k = 0; k < 4; ++k) {
+        out[k] = dotProduct(a, b + k * stride, n);
+    }
+}
+
+inline boost::int32_t squaredDistance(const boost::int16_t* a, const boost::int16_t* b, size_t n)
+{
+    boost::int32_t result = 0;
+    for (size_t i = 0; i < n; ++i) {
+        boost::int32_t diff = boost::int32_t(a[i]) - b[i];
+        result += diff * diff;
+    }
+    return result;
+}
+
+#endif // KGASCII_INT_VECTOR_SSE2
+
+} } } // namespace KG::Ascii::Internal
+
+#endif // KGASCII_INTERNAL_INT_VECTOR_HPP
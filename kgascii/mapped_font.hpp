@@ -0,0 +1,201 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_MAPPED_FONT_HPP
+#define KGASCII_MAPPED_FONT_HPP
+
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/cstdint.hpp>
+#include <boost/gil/gil_all.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/throw_exception.hpp>
+#include <boost/type_traits/integral_constant.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <kgascii/symbol.hpp>
+#include <kgascii/font_image.hpp>
+#include <kgascii/font_io.hpp>
+#include <kgascii/internal/font_file.hpp>
+
+namespace KG { namespace Ascii {
+
+// Read-only font backed by a binary font file (.kgf) mapped to memory.
+// Opening it only validates the header; glyph views point straight into
+// the mapping, and FontImage uses its glyph block without copying.
+// Pages are loaded by the system on first access and shared by all
+// processes mapping the same file.
+template<class TImage=boost::gil::gray8_image_t>
+class MappedFont: boost::noncopyable
+{
+public:
+    typedef TImage ImageT;
+    typedef typename ImageT::value_type PixelT;
+    typedef typename ImageT::const_view_t ConstViewT;
+
+public:
+    explicit MappedFont(const std::string& file_path)
+        :file_(file_path.c_str(), boost::interprocess::read_only)
+        ,region_(file_, boost::interprocess::read_only)
+    {
+        const char* data = static_cast<const char*>(region_.get_address());
+        size_t size = region_.get_size();
+        if (size < sizeof(Internal::FontFileHeader))
+            BOOST_THROW_EXCEPTION(std::runtime_error("truncated or corrupted font file"));
+        std::memcpy(&header_, data, sizeof(header_));
+        Internal::validateFontFileHeader<PixelT>(header_, size);
+        Internal::validateFontFileSymbols(header_, data);
+
+        familyName_.assign(data + header_.familyNameOffset, header_.familyNameSize);
+        styleName_.assign(data + header_.styleNameOffset, header_.styleNameSize);
+        symbols_ = reinterpret_cast<const boost::uint32_t*>(data + header_.symbolTableOffset);
+        glyphBlock_ = boost::gil::interleaved_view(header_.glyphWidth, header_.glyphHeight * header_.glyphCount,
+                reinterpret_cast<const PixelT*>(data + header_.glyphDataOffset), header_.glyphWidth * sizeof(PixelT));
+    }
+
+public:
+    const std::string& familyName() const
+    {
+        return familyName_;
+    }
+
+    const std::string& styleName() const
+    {
+        return styleName_;
+    }
+
+    unsigned pixelSize() const
+    {
+        return header_.pixelSize;
+    }
+
+    unsigned glyphWidth() const
+    {
+        return header_.glyphWidth;
+    }
+
+    unsigned glyphHeight() const
+    {
+        return header_.glyphHeight;
+    }
+
+    size_t glyphCount() const
+    {
+        return header_.glyphCount;
+    }
+
+    Symbol getSymbol(size_t i) const
+    {
+        if (i >= glyphCount())
+            BOOST_THROW_EXCEPTION(std::out_of_range("Invalid glyph index"));
+        return Symbol(symbolValue(i));
+    }
+
+    ConstViewT getGlyph(size_t i) const
+    {
+        if (i >= glyphCount())
+            BOOST_THROW_EXCEPTION(std::out_of_range("Invalid glyph index"));
+        return subimage_view(glyphBlock_, 0, i * header_.glyphHeight, header_.glyphWidth, header_.glyphHeight);
+    }
+
+    bool contains(Symbol sym) const
+    {
+        return findGlyph(sym) < glyphCount();
+    }
+
+    ConstViewT getGlyph(Symbol sym) const
+    {
+        size_t i = findGlyph(sym);
+        if (i < glyphCount())
+            return getGlyph(i);
+        BOOST_THROW_EXCEPTION(std::out_of_range("Invalid symbol"));
+    }
+
+    // All glyphs stacked from top to bottom in glyph index order.
+    const ConstViewT& glyphBlock() const
+    {
+        return glyphBlock_;
+    }
+
+private:
+    boost::uint32_t symbolValue(size_t i) const
+    {
+        //the table offset carries no alignment guarantee
+        boost::uint32_t value;
+        std::memcpy(&value, symbols_ + i, sizeof(value));
+        return value;
+    }
+
+    // Binary search in the sorted symbol table, glyphCount() if not found.
+    size_t findGlyph(Symbol sym) const
+    {
+        size_t lo = 0, hi = glyphCount();
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (symbolValue(mid) < sym.value()) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo < glyphCount() && symbolValue(lo) == sym.value())
+            return lo;
+        return glyphCount();
+    }
+
+private:
+    boost::interprocess::file_mapping file_;
+    boost::interprocess::mapped_region region_;
+    Internal::FontFileHeader header_;
+    std::string familyName_;
+    std::string styleName_;
+    const boost::uint32_t* symbols_;
+    ConstViewT glyphBlock_;
+};
+
+namespace Internal {
+
+template<class TImage>
+struct HasGlyphBlock<MappedFont<TImage> >: boost::true_type {};
+
+} // namespace Internal
+
+// Image of the font in the given file. Binary fonts are mapped with
+// MappedFont, whose glyphs the image uses in place when the pixel types
+// match; other files are read with Font::load.
+template<class TFontImage>
+boost::shared_ptr<TFontImage> loadFontImage(const std::string& file_path)
+{
+    typedef typename TFontImage::FontT FontT;
+    typedef MappedFont<typename FontT::ImageT> MappedFontT;
+
+    if (Internal::isFontFile(file_path)) {
+        boost::shared_ptr<const MappedFontT> font(new MappedFontT(file_path));
+        return boost::shared_ptr<TFontImage>(new TFontImage(font));
+    }
+    boost::shared_ptr<FontT> font(new FontT);
+    if (!font->load(file_path))
+        BOOST_THROW_EXCEPTION(std::runtime_error("problem loading font " + file_path));
+    return boost::shared_ptr<TFontImage>(new TFontImage(font));
+}
+
+} } // namespace KG::Ascii
+
+#endif // KGASCII_MAPPED_FONT_HPP
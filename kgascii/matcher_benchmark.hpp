@@ -0,0 +1,199 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_MATCHER_BENCHMARK_HPP
+#define KGASCII_MATCHER_BENCHMARK_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/gil/gil_all.hpp>
+#include <kgascii/text_surface.hpp>
+#include <kgascii/sequential_asciifier.hpp>
+
+namespace KG { namespace Ascii {
+
+// Measures the speed and the quality of glyph matchers on a synthetic
+// sample made of the font's own glyphs: every cell holds one glyph or a
+// blend of two, with random contrast and noise applied.
+// Quality is expressed as the fraction of cells for which a matcher picks
+// the same symbol as a reference matcher (usually "sed").
+template<class TFontImage>
+class MatcherBenchmark: boost::noncopyable
+{
+public:
+    typedef TFontImage FontImageT;
+    typedef typename FontImageT::ImageT ImageT;
+    typedef typename FontImageT::ConstViewT ConstViewT;
+
+    struct Result
+    {
+        //seconds per text cell
+        double cellCost;
+        //fraction of cells equal to the reference
+        double agreement;
+    };
+
+public:
+    MatcherBenchmark(boost::shared_ptr<const FontImageT> font, unsigned rows, unsigned cols, unsigned seed=1)
+        :font_(font)
+        ,rows_(rows)
+        ,cols_(cols)
+    {
+        if (rows == 0 || cols == 0)
+            throw std::logic_error("empty benchmark sample");
+        if (font->glyphCount() == 0)
+            throw std::logic_error("font has no glyphs");
+        createSample(seed);
+    }
+
+public:
+    boost::shared_ptr<const FontImageT> font() const
+    {
+        return font_;
+    }
+
+    unsigned rows() const
+    {
+        return rows_;
+    }
+
+    unsigned cols() const
+    {
+        return cols_;
+    }
+
+    size_t cellCount() const
+    {
+        return size_t(rows_) * cols_;
+    }
+
+    ConstViewT sample() const
+    {
+        return const_view(sample_);
+    }
+
+    // Converts the sample repeatedly until at least min_time has passed
+    // and returns the average time spent on a single cell.
+    template<class TAsciifier>
+    double measureCost(TAsciifier& asciifier, TextSurface& text, 
+            boost::posix_time::time_duration min_time=boost::posix_time::milliseconds(100)) const
+    {
+        using namespace boost::posix_time;
+        text.resize(rows_, cols_);
+        size_t passes = 0;
+        ptime start = microsec_clock::universal_time();
+        time_duration elapsed;
+        do {
+            asciifier.generate(sample(), text);
+            passes++;
+            elapsed = microsec_clock::universal_time() - start;
+        } while (elapsed < min_time);
+        return elapsed.total_microseconds() * 1e-6 / (passes * cellCount());
+    }
+
+    template<class TGlyphMatcher>
+    Result evaluate(boost::shared_ptr<const TGlyphMatcher> matcher, const TextSurface& reference, TextSurface& text,
+            boost::posix_time::time_duration min_time=boost::posix_time::milliseconds(100)) const
+    {
+        SequentialAsciifier<TGlyphMatcher> asciifier(matcher);
+        Result res;
+        res.cellCost = measureCost(asciifier, text, min_time);
+        res.agreement = agreement(reference, text);
+        return res;
+    }
+
+    template<class TGlyphMatcher>
+    void generateReference(boost::shared_ptr<const TGlyphMatcher> matcher, TextSurface& reference) const
+    {
+        SequentialAsciifier<TGlyphMatcher> asciifier(matcher);
+        reference.resize(rows_, cols_);
+        asciifier.generate(sample(), reference);
+    }
+
+    static double agreement(const TextSurface& a, const TextSurface& b)
+    {
+        if (a.rows() != b.rows() || a.cols() != b.cols())
+            throw std::logic_error("text surface size mismatch");
+        size_t cells = size_t(a.rows()) * a.cols();
+        if (cells == 0)
+            return 1.0;
+        size_t same = 0;
+        for (unsigned r = 0; r < a.rows(); ++r) {
+            const Symbol* pa = a.row(r);
+            const Symbol* pb = b.row(r);
+            for (unsigned c = 0; c < a.cols(); ++c) {
+                if (pa[c] == pb[c])
+                    same++;
+            }
+        }
+        return double(same) / cells;
+    }
+
+private:
+    void createSample(unsigned seed)
+    {
+        using namespace boost::gil;
+
+        unsigned char_w = font_->glyphWidth();
+        unsigned char_h = font_->glyphHeight();
+        size_t glyph_cnt = font_->glyphCount();
+
+        gray8_image_t glyphs(char_w, char_h * glyph_cnt);
+        for (size_t i = 0; i < glyph_cnt; ++i) {
+            copy_and_convert_pixels(font_->getGlyph(i), subimage_view(view(glyphs), 0, char_h * i, char_w, char_h));
+        }
+
+        boost::mt19937 rng(seed);
+        gray8_image_t sample(char_w * cols_, char_h * rows_);
+        for (unsigned r = 0; r < rows_; ++r) {
+            for (unsigned c = 0; c < cols_; ++c) {
+                gray8c_view_t g1 = subimage_view(const_view(glyphs), 0, char_h * (rng() % glyph_cnt), char_w, char_h);
+                gray8c_view_t g2 = subimage_view(const_view(glyphs), 0, char_h * (rng() % glyph_cnt), char_w, char_h);
+                //every other cell is a blend of two glyphs
+                int mix = rng() % 2 ? 256 : 128 + rng() % 129;
+                int lo = rng() % 64;
+                int hi = 192 + rng() % 64;
+                gray8_view_t cell = subimage_view(view(sample), char_w * c, char_h * r, char_w, char_h);
+                for (unsigned y = 0; y < char_h; ++y) {
+                    for (unsigned x = 0; x < char_w; ++x) {
+                        int v = (g1(x, y) * mix + g2(x, y) * (256 - mix)) >> 8;
+                        v = lo + v * (hi - lo) / 255 + int(rng() % 33) - 16;
+                        cell(x, y) = std::max(0, std::min(255, v));
+                    }
+                }
+            }
+        }
+
+        sample_.recreate(sample.dimensions());
+        copy_and_convert_pixels(const_view(sample), view(sample_));
+    }
+
+private:
+    boost::shared_ptr<const FontImageT> font_;
+    unsigned rows_;
+    unsigned cols_;
+    ImageT sample_;
+};
+
+} } // namespace KG::Ascii
+
+#endif // KGASCII_MATCHER_BENCHMARK_HPP
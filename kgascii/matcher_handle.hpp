@@ -0,0 +1,65 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_MATCHER_HANDLE_HPP
+#define KGASCII_MATCHER_HANDLE_HPP
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+namespace KG { namespace Ascii {
+
+// Slot holding the glyph matcher in use, replaceable while other threads
+// read it (read-copy-update). Readers take a reference to the current
+// matcher and keep using it for as long as they hold it; a replaced
+// matcher is destroyed once its last reader lets go.
+template<class TGlyphMatcher>
+class MatcherHandle: boost::noncopyable
+{
+public:
+    typedef TGlyphMatcher GlyphMatcherT;
+    typedef boost::shared_ptr<const GlyphMatcherT> MatcherPtrT;
+
+public:
+    explicit MatcherHandle(MatcherPtrT m)
+        :matcher_(m)
+    {
+    }
+
+public:
+    MatcherPtrT get() const
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        return matcher_;
+    }
+
+    void set(MatcherPtrT m)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        //the old matcher is released after unlocking, it may be the last reference
+        matcher_.swap(m);
+    }
+
+private:
+    mutable boost::mutex mutex_;
+    MatcherPtrT matcher_;
+};
+
+} } // namespace KG::Ascii
+
+#endif // KGASCII_MATCHER_HANDLE_HPP
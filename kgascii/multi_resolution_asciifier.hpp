@@ -0,0 +1,160 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_MULTI_RESOLUTION_ASCIIFIER_HPP
+#define KGASCII_MULTI_RESOLUTION_ASCIIFIER_HPP
+
+#include <map>
+#include <cassert>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <boost/tuple/tuple_comparison.hpp>
+#include <boost/gil/gil_all.hpp>
+#include <kgutil/srgb.hpp>
+#include <kgutil/resample/resampler.hpp>
+#include <kgutil/resample/filter/bspline.hpp>
+#include <kgascii/text_surface.hpp>
+#include <kgascii/parallel_asciifier.hpp>
+
+namespace KG { namespace Ascii {
+
+// Converts a single frame into several text surfaces of different sizes.
+// Every size is resampled from the frame itself in TScaledImage, which
+// should be a linear pixel type like the frame, and only then converted
+// to the pixel type of the font; this is the order a single size is
+// converted in, so each surface matches a separate conversion of the frame.
+// All sizes are matched on one shared thread pool; a size is queued as
+// soon as its image is ready, while the smaller ones are being resampled.
+template<class TGlyphMatcher, class TFilter=KG::Util::Filter::BSplineFilter<>, 
+        class TScaledImage=boost::gil::rgb_lin16_image_t>
+class MultiResolutionAsciifier: boost::noncopyable
+{
+public:
+    typedef TGlyphMatcher GlyphMatcherT;
+    typedef typename GlyphMatcherT::FontImageT FontImageT;
+    typedef typename FontImageT::ImageT ImageT;
+    typedef typename FontImageT::ConstViewT ConstViewT;
+    typedef TFilter FilterT;
+    typedef TScaledImage ScaledImageT;
+    typedef typename ImageT::point_t PointT;
+
+public:
+    MultiResolutionAsciifier(boost::shared_ptr<const GlyphMatcherT> matcher, unsigned thr_cnt, unsigned rows_per_task=1)
+        :asciifier_(matcher, thr_cnt, rows_per_task)
+    {
+    }
+
+public:
+    boost::shared_ptr<const GlyphMatcherT> matcher() const
+    {
+        return asciifier_.matcher();
+    }
+
+    unsigned threadCount() const
+    {
+        return asciifier_.threadCount();
+    }
+
+    // The frame is scaled to exactly cols x rows cells of every surface.
+    template<class TSrcView>
+    void generate(const TSrcView& frame, std::vector<TextSurface>& texts)
+    {
+        dims_.resize(texts.size());
+        for (size_t i = 0; i < texts.size(); ++i) {
+            dims_[i] = PointT(texts[i].cols() * matcher()->cellWidth(), texts[i].rows() * matcher()->cellHeight());
+        }
+        generate(frame, texts, dims_);
+    }
+
+    // The frame is scaled to dims[i] pixels for texts[i]; cells past the
+    // edge of the image see only its covered part, as with a single size.
+    template<class TSrcView>
+    void generate(const TSrcView& frame, std::vector<TextSurface>& texts, const std::vector<PointT>& dims)
+    {
+        using namespace boost::gil;
+
+        assert(dims.size() == texts.size());
+
+        //largest first, their matching takes longest
+        order_.clear();
+        for (size_t i = 0; i < texts.size(); ++i) {
+            size_t area = size_t(texts[i].cols()) * texts[i].rows();
+            if (area > 0 && dims[i].x > 0 && dims[i].y > 0) {
+                order_.push_back(std::make_pair(area, i));
+            }
+        }
+        std::sort(order_.begin(), order_.end(), std::greater<std::pair<size_t, size_t> >());
+
+        scaled_.resize(texts.size());
+        images_.resize(texts.size());
+        futures_.clear();
+        for (size_t k = 0; k < order_.size(); ++k) {
+            size_t i = order_[k].second;
+            if (scaled_[i].dimensions() != dims[i]) {
+                scaled_[i].recreate(dims[i]);
+                images_[i].recreate(dims[i]);
+            }
+
+            if (frame.dimensions() == dims[i]) {
+                copy_and_convert_pixels(frame, view(scaled_[i]));
+            } else {
+                resampler(frame.dimensions(), dims[i]).apply(frame, view(scaled_[i]));
+            }
+            //through gray8, like the input of a single size
+            copy_and_convert_pixels(color_converted_view<gray8_pixel_t>(const_view(scaled_[i])), view(images_[i]));
+            futures_.push_back(asciifier_.generateAsync(const_view(images_[i]), texts[i]));
+        }
+
+        for (size_t k = 0; k < futures_.size(); ++k) {
+            futures_[k].wait();
+        }
+        futures_.clear();
+    }
+
+private:
+    typedef KG::Util::Resampler<FilterT> ResamplerT;
+    typedef boost::tuple<long, long, long, long> ResamplerKeyT;
+
+    // Filter weights depend on the sizes only and are kept between frames.
+    const ResamplerT& resampler(const typename ImageT::point_t& src, const typename ImageT::point_t& dst)
+    {
+        ResamplerKeyT key(src.x, src.y, dst.x, dst.y);
+        typename std::map<ResamplerKeyT, boost::shared_ptr<ResamplerT> >::iterator it = resamplers_.find(key);
+        if (it == resamplers_.end()) {
+            boost::shared_ptr<ResamplerT> res(new ResamplerT(src.x, src.y, dst.x, dst.y));
+            it = resamplers_.insert(std::make_pair(key, res)).first;
+        }
+        return *it->second;
+    }
+
+private:
+    ParallelAsciifier<GlyphMatcherT, ConstViewT> asciifier_;
+    std::vector<ScaledImageT> scaled_;
+    std::vector<ImageT> images_;
+    std::vector<PointT> dims_;
+    std::vector<std::pair<size_t, size_t> > order_;
+    std::vector<GenerateFuture> futures_;
+    std::map<ResamplerKeyT, boost::shared_ptr<ResamplerT> > resamplers_;
+};
+
+} } // namespace KG::Ascii
+
+#endif // KGASCII_MULTI_RESOLUTION_ASCIIFIER_HPP
@@ -66,7 +66,7 @@ public:
         :font_(f)
         ,histograms_(font()->glyphCount())
         ,colorBins_(bins)
-        ,colorBinSize_(256 / colorBins_)
+        ,colorBinSize_((channelRange() + colorBins_ - 1) / colorBins_)
     {
         //precompute glyph histograms
         for (size_t ci = 0; ci < font()->glyphCount(); ++ci) {
@@ -194,6 +194,14 @@ public:
         return histograms_.at(index);
     }
 
+private:
+    //number of channel values, split between the bins
+    static size_t channelRange()
+    {
+        typedef typename boost::gil::channel_type<PixelT>::type ChannelT;
+        return static_cast<size_t>(boost::gil::channel_traits<ChannelT>::max_value()) + 1;
+    }
+
 private:
     boost::shared_ptr<const FontImageT> font_;
     std::vector<Eigen::VectorXi> histograms_;
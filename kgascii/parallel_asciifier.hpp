@@ -18,12 +18,15 @@
 #ifndef KGASCII_PARALLELASCIIFIER_HPP
 #define KGASCII_PARALLELASCIIFIER_HPP
 
+#include <algorithm>
 #include <boost/noncopyable.hpp>
 #include <boost/bind.hpp>
 #include <boost/thread.hpp>
 #include <boost/shared_ptr.hpp>
 #include <kgutil/task_queue.hpp>
 #include <kgascii/text_surface.hpp>
+#include <kgascii/generate_future.hpp>
+#include <kgascii/matcher_handle.hpp>
 
 namespace KG { namespace Ascii {
 
@@ -34,10 +37,14 @@ public:
     typedef TGlyphMatcher GlyphMatcherT;
     typedef TView ViewT;
     typedef typename TGlyphMatcher::ContextT ContextT;
+    typedef GenerateFuture::CallbackT CallbackT;
 
 public:
-    ParallelAsciifier(boost::shared_ptr<const GlyphMatcherT> c, unsigned thr_cnt)
+    // Each queued task covers rows_per_task text rows; larger tasks lower
+    // the queue overhead at the cost of coarser load balancing.
+    ParallelAsciifier(boost::shared_ptr<const GlyphMatcherT> c, unsigned thr_cnt, unsigned rows_per_task=1)
         :matcher_(c)
+        ,rowsPerTask_(std::max(rows_per_task, 1u))
     {
         setupThreads(thr_cnt);
     }
@@ -50,7 +57,16 @@ public:
 public:
     boost::shared_ptr<const GlyphMatcherT> matcher() const
     {
-        return matcher_;
+        return matcher_.get();
+    }
+
+    // Replaces the matcher without stopping the workers. May be called from
+    // any thread; frames submitted afterwards use the new matcher while
+    // frames already in flight finish with the old one. Each worker creates
+    // a new context when it first meets the new matcher.
+    void setMatcher(boost::shared_ptr<const GlyphMatcherT> c)
+    {
+        matcher_.set(c);
     }
 
     unsigned threadCount() const
@@ -58,28 +74,55 @@ public:
         return group_.size();
     }
 
+    unsigned rowsPerTask() const
+    {
+        return rowsPerTask_;
+    }
+
 public:
     void generate(const ViewT& imgv, TextSurface& text)
     {
+        generateAsync(imgv, text).wait();
+    }
+
+    void generate(const ViewT& imgv, TextSurface& text, const TextRegion& reg)
+    {
+        generateAsync(imgv, text, reg).wait();
+    }
+
+    GenerateFuture generateAsync(const ViewT& imgv, TextSurface& text, const CallbackT& cb=CallbackT())
+    {
+        return generateAsync(imgv, text, text.region(), cb);
+    }
+
+    // Only the rows of the region are queued, each limited to the region's
+    // columns; the image view still covers the whole surface.
+    GenerateFuture generateAsync(const ViewT& imgv, TextSurface& text, const TextRegion& reg, const CallbackT& cb=CallbackT())
+    {
+        boost::shared_ptr<Internal::GenerateState> state = statePool_.acquire(cb);
+        //the whole frame is converted with the matcher current at submission
+        boost::shared_ptr<const GlyphMatcherT> matcher = matcher_.get();
+
+        TextRegion clip_reg = text.clip(reg);
         //single character size
-        size_t char_w = matcher_->cellWidth();
-        size_t char_h = matcher_->cellHeight();
-        //text surface size
-        size_t text_w = text.cols() * char_w;
-        size_t text_h = text.rows() * char_h;
-        //processed image region size
-        size_t roi_w = std::min<size_t>(imgv.width(), text_w);
-        size_t roi_h = std::min<size_t>(imgv.height(), text_h);
-
-        size_t y = 0, r = 0;
-        for (; y + char_h <= roi_h; y += char_h, ++r) {
-            enqueue(subimage_view(imgv, 0, y, roi_w, char_h), text.row(r));
-        }
-        if (y < roi_h) {
-            size_t dy = roi_h - y;
-            enqueue(subimage_view(imgv, 0, y, roi_w, dy), text.row(r));
+        size_t char_w = matcher->cellWidth();
+        size_t char_h = matcher->cellHeight();
+        //processed image region
+        size_t roi_x = clip_reg.col * char_w;
+        size_t roi_y = clip_reg.row * char_h;
+        size_t roi_r = std::min<size_t>(imgv.width(), (clip_reg.col + clip_reg.cols) * char_w);
+        size_t roi_b = std::min<size_t>(imgv.height(), (clip_reg.row + clip_reg.rows) * char_h);
+
+        if (roi_x < roi_r) {
+            size_t task_h = char_h * rowsPerTask_;
+            for (size_t y = roi_y, r = clip_reg.row; y < roi_b; y += task_h, r += rowsPerTask_) {
+                size_t dy = std::min(task_h, roi_b - y);
+                enqueue(subimage_view(imgv, roi_x, y, roi_r - roi_x, dy), text.row(r) + clip_reg.col, text.cols(), matcher, state);
+            }
         }
-        queue_.wait_empty();
+        //release the guard taken when the state was acquired
+        state->taskDone();
+        return GenerateFuture(state);
     }
 
 private:
@@ -91,51 +134,74 @@ private:
         for (unsigned i = 0; i < thr_cnt; ++i) {
             group_.create_thread(boost::bind(&ParallelAsciifier::threadFunc, this));
         }
+        statePool_.reserve(thr_cnt + 1);
     }
 
     void endThreads()
     {
+        //let frames still in flight finish
+        queue_.wait_empty();
         queue_.close();
         group_.join_all();
     }
 
-    void enqueue(const ViewT& surf, Symbol* outp)
+    void enqueue(const ViewT& surf, Symbol* outp, size_t out_stride, const boost::shared_ptr<const GlyphMatcherT>& matcher, 
+            const boost::shared_ptr<Internal::GenerateState>& state)
     {
-        WorkItem wi = { surf, outp };
+        WorkItem wi = { surf, outp, out_stride, matcher, state };
+        state->addTask();
         queue_.push(wi);
     }
 
 private:
     void threadFunc()
     {
-        ContextT context(matcher_->createContext());
-        //single character size
-        size_t char_w = matcher_->cellWidth();
+        boost::shared_ptr<const GlyphMatcherT> context_matcher = matcher_.get();
+        ContextT context(context_matcher->createContext());
 
         WorkItem wi = WorkItem();
         while (queue_.wait_pop(wi)) {
-            //processed image region size
-            size_t roi_w = wi.imgv.width();
-            size_t roi_h = wi.imgv.height();
-            size_t x = 0, c = 0;
-            for (; x + char_w <= roi_w; x += char_w, ++c) {
-                wi.outp[c] = matcher_->match(context, subimage_view(wi.imgv, x, 0, char_w, roi_h));
-            }
-            if (x < roi_w) {
-                size_t dx = roi_w - x;
-                wi.outp[c] = matcher_->match(context, subimage_view(wi.imgv, x, 0, dx, roi_h));
+            //stale frames are drained without matching
+            if (!wi.state->cancelled()) {
+                if (wi.matcher != context_matcher) {
+                    //a context only works with the matcher that created it
+                    context = wi.matcher->createContext();
+                    context_matcher = wi.matcher;
+                }
+                //single character size
+                size_t char_w = context_matcher->cellWidth();
+                size_t char_h = context_matcher->cellHeight();
+                //processed image region size
+                size_t roi_w = wi.imgv.width();
+                size_t roi_h = wi.imgv.height();
+                Symbol* outp = wi.outp;
+                for (size_t y = 0; y < roi_h; y += char_h, outp += wi.outStride) {
+                    size_t dy = std::min(char_h, roi_h - y);
+                    for (size_t x = 0, c = 0; x < roi_w; x += char_w, ++c) {
+                        size_t dx = std::min(char_w, roi_w - x);
+                        outp[c] = context_matcher->match(context, subimage_view(wi.imgv, x, y, dx, dy));
+                    }
+                }
             }
             queue_.done();
+            wi.state->taskDone();
+            wi.state.reset();
+            wi.matcher.reset();
         }
     }
 
 private:
-    boost::shared_ptr<const GlyphMatcherT> matcher_;
+    MatcherHandle<GlyphMatcherT> matcher_;
+    unsigned rowsPerTask_;
+    Internal::GenerateStatePool statePool_;
     boost::thread_group group_;
     struct WorkItem
     {
         ViewT imgv;
         Symbol* outp;
+        size_t outStride;
+        boost::shared_ptr<const GlyphMatcherT> matcher;
+        boost::shared_ptr<Internal::GenerateState> state;
     };
     KG::Util::TaskQueue<WorkItem> queue_;
 };
@@ -18,13 +18,21 @@
 #ifndef KGASCII_PCAGLYPHMATCHER_HPP
 #define KGASCII_PCAGLYPHMATCHER_HPP
 
+#include <algorithm>
+#include <fstream>
 #include <map>
+#include <stdexcept>
 #include <boost/lexical_cast.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/type_traits/integral_constant.hpp>
+#include <boost/gil/gil_all.hpp>
 #include <Eigen/Dense>
 #include <kgascii/font_pca.hpp>
 #include <kgascii/dynamic_glyph_matcher.hpp>
+#include <kgascii/matcher_benchmark.hpp>
+#include <kgascii/quantized_pca_glyph_matcher.hpp>
+#include <kgascii/state_cache.hpp>
 
 namespace KG { namespace Ascii {
 
@@ -138,6 +146,13 @@ public:
     typedef PcaGlyphMatcher<PrincipalComponentsT> PcaGlyphMatcherT;
     typedef DynamicGlyphMatcher<TFontImage> DynamicGlyphMatcherT;
 
+    // Options:
+    //  nf        - number of features (default 10),
+    //  energy    - without nf, the least features keeping this fraction of the glyph energy,
+    //  agree     - without nf, the least features picking the same glyph as all of them
+    //              for this fraction of a synthetic sample (at least the energy count),
+    //  quant     - 8 or 16 for an integer matcher,
+    //  method, precision, cache, makecache, autocache - see createComponents().
     boost::shared_ptr<DynamicGlyphMatcherT> operator()(boost::shared_ptr<const TFontImage> font, const std::map<std::string, std::string>& options) const
     {
         size_t nfeatures = 10;
@@ -147,21 +162,333 @@ public:
             } catch (boost::bad_lexical_cast&) { }
         }
 
+        unsigned quant = 0;
+        if (options.count("quant")) {
+            try {
+                quant = boost::lexical_cast<unsigned>(options.find("quant")->second);
+            } catch (boost::bad_lexical_cast&) { }
+        }
+
+        boost::shared_ptr<const EigendecompositionT> decomposition;
+        if (!options.count("nf")) {
+            nfeatures = chooseFeatureCount(font, options, nfeatures, decomposition);
+        }
+        boost::shared_ptr<const PrincipalComponentsT> components = createComponents(font, options, nfeatures, decomposition);
+        if (quant == 8)
+            return createQuantized<boost::int8_t>(components);
+        if (quant == 16)
+            return createQuantized<boost::int16_t>(components);
+        return create(components);
+    }
+
+    // Components with nfeatures features. Without an explicit cache file
+    // they are kept in the StateCache, unless autocache=0 is given, so a
+    // warm start never analyzes the font. Otherwise they are built from
+    // decomposition, which is created first when empty and can be passed
+    // on to further calls, asking for component_cnt components then.
+    // precision=half rounds the components to half precision, halving the
+    // size of their cache entries.
+    static boost::shared_ptr<const PrincipalComponentsT> createComponents(boost::shared_ptr<const TFontImage> font, 
+            const std::map<std::string, std::string>& options, size_t nfeatures,
+            boost::shared_ptr<const EigendecompositionT>& decomposition, size_t component_cnt=0)
+    {
+        bool half_precision = options.count("precision") && options.find("precision")->second == "half";
+        bool use_cache = useCache(options);
+
+        StateCache cache;
+        StateCache::KeyT key = 0;
+        std::string kind = cacheKind() + "-" + PcaMethod::asString(methodOption(options)) 
+                + "-" + boost::lexical_cast<std::string>(nfeatures) + (half_precision ? "-half" : "");
+        if (use_cache) {
+            key = StateCache::fontKey(*font);
+            boost::shared_ptr<PrincipalComponentsT> components(new PrincipalComponentsT(font));
+            if (loadCached(*components, cache, kind, key))
+                return components;
+        }
+
+        if (!decomposition) {
+            decomposition = createDecomposition(font, options, std::max(component_cnt, nfeatures));
+        }
+        boost::shared_ptr<PrincipalComponentsT> components(new PrincipalComponentsT(decomposition, nfeatures));
+        if (half_precision) {
+            components->setHalfPrecision();
+        }
+        if (use_cache) {
+            storeCached(*components, cache, kind, key);
+        }
+        return components;
+    }
+
+    // Feature count meeting the energy and agree targets, def_nfeatures when
+    // neither is given. The choice is kept in the StateCache like the
+    // components are; otherwise decomposition is created when empty (with
+    // all components) and can be passed on to createComponents().
+    static size_t chooseFeatureCount(boost::shared_ptr<const TFontImage> font, 
+            const std::map<std::string, std::string>& options, size_t def_nfeatures,
+            boost::shared_ptr<const EigendecompositionT>& decomposition)
+    {
+        std::string energy_str, agree_str;
+        double energy = fractionOption(options, "energy", energy_str);
+        double agree = fractionOption(options, "agree", agree_str);
+        if (energy <= 0 && agree <= 0)
+            return def_nfeatures;
+
+        bool use_cache = useCache(options);
+        StateCache cache;
+        StateCache::KeyT key = 0;
+        std::string kind = featureCountKind() + "-" + PcaMethod::asString(methodOption(options))
+                + (energy > 0 ? "-energy-" + energy_str : "") + (agree > 0 ? "-agree-" + agree_str : "");
+        size_t nfeatures = 0;
+        if (use_cache) {
+            key = StateCache::fontKey(*font);
+            if (loadFeatureCount(nfeatures, cache, kind, key))
+                return nfeatures;
+        }
+
+        if (!decomposition) {
+            decomposition = createDecomposition(font, options);
+        }
+        nfeatures = 1;
+        if (energy > 0) {
+            nfeatures = energyFeatureCount(*decomposition, energy);
+        }
+        if (agree > 0) {
+            nfeatures = agreementFeatureCount(decomposition, agree, nfeatures);
+        }
+        if (use_cache) {
+            storeFeatureCount(nfeatures, cache, kind, key);
+        }
+        return nfeatures;
+    }
+
+    // Least number of components whose energies sum up to the given
+    // fraction of the total, or all of them.
+    static size_t energyFeatureCount(const EigendecompositionT& decomposition, double fraction)
+    {
+        double target = fraction * decomposition.totalEnergy();
+        double sum = 0;
+        size_t cnt = 0;
+        while (cnt < decomposition.componentCount() && sum < target) {
+            sum += decomposition.energies()[cnt];
+            ++cnt;
+        }
+        return std::max<size_t>(cnt, 1);
+    }
+
+    // Least number of features, not below min_cnt, for which the matcher
+    // picks the same glyphs as with all components for the given fraction
+    // of the benchmark sample cells. All components are the reference
+    // rather than sed, since the energy weighting of the features makes the
+    // matcher differ from sed however many of them are used.
+    // Agreement grows with the number of features, so it is bisected.
+    static size_t agreementFeatureCount(boost::shared_ptr<const EigendecompositionT> decomposition, 
+            double fraction, size_t min_cnt)
+    {
+        MatcherBenchmark<TFontImage> bench(decomposition->font(), AGREEMENT_SAMPLE_ROWS, AGREEMENT_SAMPLE_COLS);
+        TextSurface reference;
+        boost::shared_ptr<const PrincipalComponentsT> all_components(
+                new PrincipalComponentsT(decomposition, decomposition->componentCount()));
+        bench.generateReference(boost::shared_ptr<const PcaGlyphMatcherT>(new PcaGlyphMatcherT(all_components)), reference);
+        all_components.reset();
+
+        size_t lo = std::max<size_t>(min_cnt, 1);
+        size_t hi = std::max(decomposition->componentCount(), lo);
+        TextSurface text;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            boost::shared_ptr<const PrincipalComponentsT> components(new PrincipalComponentsT(decomposition, mid));
+            bench.generateReference(boost::shared_ptr<const PcaGlyphMatcherT>(new PcaGlyphMatcherT(components)), text);
+            if (MatcherBenchmark<TFontImage>::agreement(reference, text) >= fraction) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        return lo;
+    }
+
+    // Decomposition with at least component_cnt components (all of them
+    // when 0), honouring the method, cache and makecache options; it can be
+    // shared by matchers using up to component_cnt features.
+    // A cache file made before glyphs were added to the font is updated
+    // with them and rewritten in place.
+    static boost::shared_ptr<const EigendecompositionT> createDecomposition(boost::shared_ptr<const TFontImage> font, 
+            const std::map<std::string, std::string>& options, size_t component_cnt=0)
+    {
+        PcaMethod method = methodOption(options);
+
         boost::shared_ptr<EigendecompositionT> decomposition(new EigendecompositionT(font));
         if (options.count("cache") && !options.find("cache")->second.empty()) {
-            decomposition->loadFromCache(options.find("cache")->second);
+            const std::string& cache_file = options.find("cache")->second;
+            bool loaded = decomposition->loadFromCache(cache_file) && hasComponents(*decomposition, component_cnt);
+            if (!loaded && decomposition->updateFromCache(cache_file) && hasComponents(*decomposition, component_cnt)) {
+                decomposition->saveToCache(cache_file);
+                loaded = true;
+            }
+            if (!loaded) {
+                decomposition->analyze(method, component_cnt);
+            }
         } else {
-            decomposition->analyze();
+            decomposition->analyze(method, component_cnt);
         }
         if (options.count("makecache") && !options.find("makecache")->second.empty()) {
             decomposition->saveToCache(options.find("makecache")->second);
         }
+        return decomposition;
+    }
 
-        boost::shared_ptr<PrincipalComponentsT> components(new PrincipalComponentsT(decomposition, nfeatures));
+    static boost::shared_ptr<DynamicGlyphMatcherT> create(boost::shared_ptr<const PrincipalComponentsT> components)
+    {
         boost::shared_ptr<PcaGlyphMatcherT> matcher(new PcaGlyphMatcherT(components));
         boost::shared_ptr<DynamicGlyphMatcherT> dynamic_matcher(new DynamicGlyphMatcherT(matcher));
         return dynamic_matcher;
     }
+
+    // QuantizedPcaGlyphMatcher takes 8-bit single channel fonts only.
+    static bool quantizable()
+    {
+        return QuantizableT::value;
+    }
+
+    // Matcher computing with basis vectors and glyph coordinates quantized
+    // to TValue, int8_t (quant=8) or int16_t (quant=16). Fonts that are not
+    // quantizable() get the float matcher.
+    template<typename TValue>
+    static boost::shared_ptr<DynamicGlyphMatcherT> createQuantized(boost::shared_ptr<const PrincipalComponentsT> components)
+    {
+        return createQuantized<TValue>(components, QuantizableT());
+    }
+
+private:
+    typedef typename TFontImage::ConstViewT FontViewT;
+    typedef boost::integral_constant<bool, boost::gil::num_channels<FontViewT>::value == 1
+            && sizeof(typename boost::gil::channel_type<FontViewT>::type) == 1> QuantizableT;
+
+    template<typename TValue>
+    static boost::shared_ptr<DynamicGlyphMatcherT> createQuantized(boost::shared_ptr<const PrincipalComponentsT> components, 
+            boost::true_type)
+    {
+        typedef QuantizedPcaGlyphMatcher<PrincipalComponentsT, TValue> QuantizedPcaGlyphMatcherT;
+        boost::shared_ptr<QuantizedPcaGlyphMatcherT> matcher(new QuantizedPcaGlyphMatcherT(components));
+        boost::shared_ptr<DynamicGlyphMatcherT> dynamic_matcher(new DynamicGlyphMatcherT(matcher));
+        return dynamic_matcher;
+    }
+
+    template<typename TValue>
+    static boost::shared_ptr<DynamicGlyphMatcherT> createQuantized(boost::shared_ptr<const PrincipalComponentsT> components, 
+            boost::false_type)
+    {
+        return create(components);
+    }
+
+    //names the layout of FontPrincipalComponents::saveToCache(), bump on changes
+    static std::string cacheKind()
+    {
+        return "pca-components-1";
+    }
+
+    //names the format of the feature count entries, bump on changes
+    static std::string featureCountKind()
+    {
+        return "pca-nf-1";
+    }
+
+    static const unsigned AGREEMENT_SAMPLE_ROWS = 32;
+    static const unsigned AGREEMENT_SAMPLE_COLS = 64;
+
+    static bool useCache(const std::map<std::string, std::string>& options)
+    {
+        return !(options.count("cache") && !options.find("cache")->second.empty())
+                && !(options.count("autocache") && options.find("autocache")->second == "0");
+    }
+
+    // Value of a fraction option in (0, 1], 0 when it is missing or invalid;
+    // its text names the cache entries.
+    static double fractionOption(const std::map<std::string, std::string>& options, const char* name, std::string& text)
+    {
+        double value = 0;
+        if (options.count(name)) {
+            text = options.find(name)->second;
+            try {
+                value = boost::lexical_cast<double>(text);
+            } catch (boost::bad_lexical_cast&) { }
+        }
+        return value > 0 && value <= 1 ? value : 0;
+    }
+
+    static PcaMethod methodOption(const std::map<std::string, std::string>& options)
+    {
+        PcaMethod method = PcaMethod::Auto;
+        if (options.count("method")) {
+            try {
+                method = PcaMethod::parse(options.find("method")->second);
+            } catch (std::out_of_range&) { }
+        }
+        return method;
+    }
+
+    static bool hasComponents(const EigendecompositionT& decomposition, size_t component_cnt)
+    {
+        return decomposition.isComplete() || (component_cnt > 0 && decomposition.componentCount() >= component_cnt);
+    }
+
+    static bool loadCached(PrincipalComponentsT& components, const StateCache& cache, 
+            const std::string& kind, StateCache::KeyT key)
+    {
+        if (!cache.contains(kind, key))
+            return false;
+        try {
+            if (components.loadFromCache(cache.entryPath(kind, key)))
+                return true;
+        } catch (std::exception&) { }
+        cache.discardEntry(kind, key);
+        return false;
+    }
+
+    static bool loadFeatureCount(size_t& nfeatures, const StateCache& cache, 
+            const std::string& kind, StateCache::KeyT key)
+    {
+        if (!cache.contains(kind, key))
+            return false;
+        std::ifstream ifs(cache.entryPath(kind, key).c_str());
+        if (ifs >> nfeatures && nfeatures > 0)
+            return true;
+        cache.discardEntry(kind, key);
+        return false;
+    }
+
+    static void storeFeatureCount(size_t nfeatures, const StateCache& cache, 
+            const std::string& kind, StateCache::KeyT key)
+    {
+        std::string temp_path = cache.temporaryPath(kind, key);
+        if (temp_path.empty())
+            return;
+        std::ofstream ofs(temp_path.c_str(), std::ios_base::out | std::ios_base::trunc);
+        ofs << nfeatures << "\n";
+        ofs.close();
+        if (ofs) {
+            cache.commitEntry(temp_path, kind, key);
+        } else {
+            cache.removeTemporary(temp_path);
+        }
+    }
+
+    static void storeCached(const PrincipalComponentsT& components, const StateCache& cache, 
+            const std::string& kind, StateCache::KeyT key)
+    {
+        std::string temp_path = cache.temporaryPath(kind, key);
+        if (temp_path.empty())
+            return;
+        bool saved = false;
+        try {
+            saved = components.saveToCache(temp_path);
+        } catch (std::exception&) { }
+        if (saved) {
+            cache.commitEntry(temp_path, kind, key);
+        } else {
+            cache.removeTemporary(temp_path);
+        }
+    }
 };
 
 
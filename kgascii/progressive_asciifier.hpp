@@ -0,0 +1,204 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_PROGRESSIVEASCIIFIER_HPP
+#define KGASCII_PROGRESSIVEASCIIFIER_HPP
+
+#include <cassert>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <boost/gil/gil_all.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <kgascii/text_surface.hpp>
+
+namespace KG { namespace Ascii {
+
+// Coarse-to-fine asciifier for interactive use.
+// The whole surface is first filled using a cheap matcher (e.g. "ramp" or
+// "pca:nf=2"), then cells are refined with the fine matcher starting with
+// the ones of the highest variance, where the coarse guess is the least
+// reliable. Intermediate surfaces are published through a callback that
+// can stop the refinement by returning false; refinement also stops when
+// the time budget runs out.
+template<class TGlyphMatcher, class TCoarseGlyphMatcher=TGlyphMatcher>
+class ProgressiveAsciifier: boost::noncopyable
+{
+public:
+    typedef TGlyphMatcher GlyphMatcherT;
+    typedef typename TGlyphMatcher::ContextT ContextT;
+    typedef TCoarseGlyphMatcher CoarseGlyphMatcherT;
+    typedef typename TCoarseGlyphMatcher::ContextT CoarseContextT;
+    // arguments: current surface, refined cells, all cells
+    typedef boost::function<bool (const TextSurface&, size_t, size_t)> ProgressCallbackT;
+
+public:
+    ProgressiveAsciifier(boost::shared_ptr<const GlyphMatcherT> fine, boost::shared_ptr<const CoarseGlyphMatcherT> coarse)
+        :matcher_(fine)
+        ,coarseMatcher_(coarse)
+        ,context_(matcher_->createContext())
+        ,coarseContext_(coarseMatcher_->createContext())
+        ,publishInterval_(0)
+    {
+        assert(matcher_->cellWidth() == coarseMatcher_->cellWidth());
+        assert(matcher_->cellHeight() == coarseMatcher_->cellHeight());
+    }
+
+public:
+    boost::shared_ptr<const GlyphMatcherT> matcher() const
+    {
+        return matcher_;
+    }
+
+    boost::shared_ptr<const CoarseGlyphMatcherT> coarseMatcher() const
+    {
+        return coarseMatcher_;
+    }
+
+    unsigned threadCount() const
+    {
+        return 1;
+    }
+
+    // number of refined cells between callbacks, 0 means one text row
+    size_t publishInterval() const
+    {
+        return publishInterval_;
+    }
+
+    void setPublishInterval(size_t cells)
+    {
+        publishInterval_ = cells;
+    }
+
+public:
+    template<class TView>
+    void generate(const TView& imgv, TextSurface& text)
+    {
+        generate(imgv, text, ProgressCallbackT());
+    }
+
+    // Returns the number of cells refined with the fine matcher.
+    // The coarse pass is always completed, the budget applies to refinement.
+    template<class TView>
+    size_t generate(const TView& imgv, TextSurface& text, const ProgressCallbackT& cb,
+                    boost::posix_time::time_duration budget=boost::posix_time::pos_infin)
+    {
+        using namespace boost::posix_time;
+
+        ptime deadline = microsec_clock::universal_time() + budget;
+
+        prepareCells(imgv, text);
+
+        for (size_t i = 0; i < cells_.size(); ++i) {
+            const Cell& cell = cells_[i];
+            text(cell.r, cell.c) = coarseMatcher_->match(coarseContext_,
+                    subimage_view(imgv, cell.x, cell.y, cell.w, cell.h));
+        }
+        if (cb && !cb(text, 0, cells_.size()))
+            return 0;
+
+        for (size_t i = 0; i < cells_.size(); ++i) {
+            order_[i] = std::make_pair(cellVariance(imgv, cells_[i]), i);
+        }
+        std::sort(order_.begin(), order_.end(), std::greater<std::pair<double, size_t> >());
+
+        size_t interval = publishInterval_ > 0 ? publishInterval_ : std::max<size_t>(text.cols(), 1);
+        size_t refined = 0;
+        size_t published = 0;
+        while (refined < order_.size()) {
+            if (microsec_clock::universal_time() >= deadline)
+                break;
+            const Cell& cell = cells_[order_[refined].second];
+            text(cell.r, cell.c) = matcher_->match(context_,
+                    subimage_view(imgv, cell.x, cell.y, cell.w, cell.h));
+            ++refined;
+            if (cb && refined - published >= interval) {
+                published = refined;
+                if (!cb(text, refined, cells_.size()))
+                    return refined;
+            }
+        }
+        if (cb && refined != published) {
+            cb(text, refined, cells_.size());
+        }
+        return refined;
+    }
+
+private:
+    struct Cell
+    {
+        unsigned r, c;
+        int x, y, w, h;
+    };
+
+    template<class TView>
+    void prepareCells(const TView& imgv, const TextSurface& text)
+    {
+        //single character size
+        size_t char_w = matcher_->cellWidth();
+        size_t char_h = matcher_->cellHeight();
+        //processed image region size
+        size_t roi_w = std::min<size_t>(imgv.width(), text.cols() * char_w);
+        size_t roi_h = std::min<size_t>(imgv.height(), text.rows() * char_h);
+
+        cells_.clear();
+        for (size_t y = 0, r = 0; y < roi_h; y += char_h, ++r) {
+            for (size_t x = 0, c = 0; x < roi_w; x += char_w, ++c) {
+                Cell cell = { static_cast<unsigned>(r), static_cast<unsigned>(c),
+                              static_cast<int>(x), static_cast<int>(y),
+                              static_cast<int>(std::min(char_w, roi_w - x)),
+                              static_cast<int>(std::min(char_h, roi_h - y)) };
+                cells_.push_back(cell);
+            }
+        }
+        order_.resize(cells_.size());
+    }
+
+    template<class TView>
+    static double cellVariance(const TView& imgv, const Cell& cell)
+    {
+        double sum = 0, sum2 = 0;
+        for (int y = cell.y; y < cell.y + cell.h; ++y) {
+            typename TView::x_iterator it = imgv.row_begin(y) + cell.x;
+            for (int x = 0; x < cell.w; ++x) {
+                double value = get_color(*it++, boost::gil::gray_color_t());
+                sum += value;
+                sum2 += value * value;
+            }
+        }
+        double n = cell.w * cell.h;
+        return sum2 / n - (sum / n) * (sum / n);
+    }
+
+private:
+    boost::shared_ptr<const GlyphMatcherT> matcher_;
+    boost::shared_ptr<const CoarseGlyphMatcherT> coarseMatcher_;
+    ContextT context_;
+    CoarseContextT coarseContext_;
+    size_t publishInterval_;
+    std::vector<Cell> cells_;
+    std::vector<std::pair<double, size_t> > order_;
+};
+
+} } // namespace KG::Ascii
+
+#endif // KGASCII_PROGRESSIVEASCIIFIER_HPP
@@ -0,0 +1,233 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+#ifndef KGASCII_QUANTIZEDPCAGLYPHMATCHER_HPP
+#define KGASCII_QUANTIZEDPCAGLYPHMATCHER_HPP
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/static_assert.hpp>
+#include <kgascii/font_pca.hpp>
+#include <kgascii/internal/int_vector.hpp>
+
+namespace KG { namespace Ascii {
+
+// PCA matcher computing in integers. The basis vectors are scaled per
+// feature and rounded to TValue (int8_t or int16_t), the cell pixels
+// are projected with integer dot products, and the closest glyph is
+// found comparing int16 coordinates with int32 sums. Features are
+// projected in groups of 4 sharing the loads of the pixels.
+// The coordinates stay int16 for both value types: they take little
+// space, and int8 ones are too coarse to tell similar glyphs apart. Only the scaling
+// of the nf projections back to glyph coordinates is done in float.
+// Works on 8-bit single channel fonts.
+template<class TPrincipalComponents, typename TValue>
+class QuantizedPcaGlyphMatcher: boost::noncopyable
+{
+public:
+    typedef TPrincipalComponents PrincipalComponentsT;
+    typedef typename PrincipalComponentsT::FontImageT FontImageT;
+    typedef typename FontImageT::PixelT PixelT;
+    typedef typename FontImageT::ImageT ImageT;
+    typedef typename FontImageT::ViewT ViewT;
+    typedef typename FontImageT::ConstViewT ConstViewT;
+    typedef TValue ValueT;
+
+    BOOST_STATIC_ASSERT(boost::gil::num_channels<ViewT>::value == 1);
+    BOOST_STATIC_ASSERT(sizeof(typename boost::gil::channel_type<ViewT>::type) == 1);
+
+    class QuantizedPcaContext
+    {
+        friend class QuantizedPcaGlyphMatcher;
+    public:
+        typedef QuantizedPcaGlyphMatcher GlyphMatcherT;
+
+    private:
+        explicit QuantizedPcaContext(const QuantizedPcaGlyphMatcher* matcher)
+            :pixels_(matcher->pixelLength_, 0)
+            ,projections_(matcher->featureRows_, 0)
+            ,coordinates_(matcher->coordinateLength_, 0)
+        {
+        }
+
+    private:
+        std::vector<boost::int16_t> pixels_;
+        std::vector<boost::int32_t> projections_;
+        std::vector<boost::int16_t> coordinates_;
+    };
+    typedef QuantizedPcaContext ContextT;
+
+public:
+    explicit QuantizedPcaGlyphMatcher(boost::shared_ptr<const PrincipalComponentsT> feat)
+        :font_(feat->font())
+        ,featureCount_(feat->featureCount())
+        ,pixelLength_(Internal::intVectorLength(font_->glyphWidth() * font_->glyphHeight()))
+        ,featureRows_((featureCount_ + 3) / 4 * 4)
+        ,coordinateLength_(Internal::intVectorLength(featureCount_))
+    {
+        quantize(*feat);
+    }
+
+public:
+    boost::shared_ptr<const FontImageT> font() const
+    {
+        return font_;
+    }
+
+    size_t featureCount() const
+    {
+        return featureCount_;
+    }
+
+    unsigned cellWidth() const
+    {
+        return font()->glyphWidth();
+    }
+
+    unsigned cellHeight() const
+    {
+        return font()->glyphHeight();
+    }
+
+    QuantizedPcaContext createContext() const
+    {
+        return QuantizedPcaContext(this);
+    }
+
+    template<typename TSomeView>
+    Symbol match(QuantizedPcaContext& ctx, const TSomeView& imgv) const
+    {
+        boost::gil::gil_function_requires<boost::gil::ImageViewConcept<TSomeView> >();
+        boost::gil::gil_function_requires<boost::gil::ColorSpacesCompatibleConcept<
+                                    typename boost::gil::color_space_type<TSomeView>::type,
+                                    typename boost::gil::color_space_type<ConstViewT>::type> >();
+        boost::gil::gil_function_requires<boost::gil::ChannelsCompatibleConcept<
+                                    typename boost::gil::channel_type<TSomeView>::type,
+                                    typename boost::gil::channel_type<ConstViewT>::type> >();
+
+        assert(static_cast<size_t>(imgv.width()) <= cellWidth());
+        assert(static_cast<size_t>(imgv.height()) <= cellHeight());
+
+        //pixels outside of imgv stay zero, like in the float matcher
+        std::fill(ctx.pixels_.begin(), ctx.pixels_.end(), 0);
+        for (ptrdiff_t y = 0; y < imgv.height(); ++y) {
+            typename TSomeView::x_iterator it = imgv.row_begin(y);
+            boost::int16_t* row = &ctx.pixels_[y * cellWidth()];
+            for (ptrdiff_t x = 0; x < imgv.width(); ++x) {
+                row[x] = boost::gil::at_c<0>(it[x]);
+            }
+        }
+
+        for (size_t j = 0; j < featureRows_; j += 4) {
+            Internal::dotProduct4(&ctx.pixels_[0], &features_[j * pixelLength_], pixelLength_, pixelLength_, 
+                    &ctx.projections_[j]);
+        }
+        for (size_t j = 0; j < featureCount_; ++j) {
+            float coord = projectionScale_[j] * ctx.projections_[j] - projectionOffset_[j];
+            coord = std::max(-coordinateLimit_, std::min(coordinateLimit_, coord));
+            ctx.coordinates_[j] = static_cast<boost::int16_t>(std::floor(coord + 0.5f));
+        }
+
+        size_t min_index = 0;
+        boost::int32_t min_dist = std::numeric_limits<boost::int32_t>::max();
+        for (size_t ci = 0; ci < font_->glyphCount(); ++ci) {
+            boost::int32_t dist = Internal::squaredDistance(&ctx.coordinates_[0], 
+                    &glyphs_[ci * coordinateLength_], coordinateLength_);
+            if (dist < min_dist) {
+                min_dist = dist;
+                min_index = ci;
+            }
+        }
+        return font()->getSymbol(min_index);
+    }
+
+private:
+    void quantize(const PrincipalComponentsT& feat)
+    {
+        const Eigen::MatrixXf& features = feat.features();
+        const Eigen::MatrixXf& glyphs = feat.glyphs();
+        Eigen::VectorXf projected_mean = features.transpose() * feat.mean();
+        double value_max = std::numeric_limits<ValueT>::max();
+
+        //pixels are at most 255, so a basis vector with absolute sum s can be
+        //scaled by (2^31 - 1) / (255 * s) before its dot products overflow;
+        //half of that leaves room for the rounding
+        features_.assign(featureRows_ * pixelLength_, 0);
+        projectionScale_.resize(featureCount_);
+        projectionOffset_.resize(featureCount_);
+        std::vector<double> feature_scale(featureCount_, 0.0);
+        for (size_t j = 0; j < featureCount_; ++j) {
+            double abs_max = features.col(j).cwiseAbs().maxCoeff();
+            double abs_sum = features.col(j).cwiseAbs().sum();
+            if (abs_max > 0) {
+                feature_scale[j] = std::min(value_max / abs_max, 
+                        std::numeric_limits<boost::int32_t>::max() / (2.0 * 255.0 * abs_sum));
+            }
+            for (ptrdiff_t p = 0; p < features.rows(); ++p) {
+                features_[j * pixelLength_ + p] = roundToValue(features(p, j) * feature_scale[j]);
+            }
+        }
+
+        //coordinates are bounded so that the squared distance of two of them
+        //summed over all features fits into int32
+        double coord_limit = std::floor(std::sqrt(std::numeric_limits<boost::int32_t>::max() / double(coordinateLength_)) / 2.0);
+        double glyph_max = glyphs.size() > 0 ? glyphs.cwiseAbs().maxCoeff() : 0.0;
+        double coord_scale = glyph_max > 0 ? coord_limit / glyph_max : 1.0;
+        coordinateLimit_ = static_cast<float>(coord_limit);
+
+        for (size_t j = 0; j < featureCount_; ++j) {
+            double energy = feat.energies()[j] * coord_scale;
+            projectionScale_[j] = feature_scale[j] > 0 ? static_cast<float>(energy / (255.0 * feature_scale[j])) : 0.0f;
+            projectionOffset_[j] = static_cast<float>(energy * projected_mean[j]);
+        }
+
+        glyphs_.assign(font_->glyphCount() * coordinateLength_, 0);
+        for (ptrdiff_t ci = 0; ci < glyphs.cols(); ++ci) {
+            for (size_t j = 0; j < featureCount_; ++j) {
+                glyphs_[ci * coordinateLength_ + j] = static_cast<boost::int16_t>(
+                        std::max(-coord_limit, std::min(coord_limit, std::floor(glyphs(j, ci) * coord_scale + 0.5))));
+            }
+        }
+    }
+
+    static ValueT roundToValue(double value)
+    {
+        double value_max = std::numeric_limits<ValueT>::max();
+        return static_cast<ValueT>(std::max(-value_max, std::min(value_max, std::floor(value + 0.5))));
+    }
+
+private:
+    boost::shared_ptr<const FontImageT> font_;
+    size_t featureCount_;
+    size_t pixelLength_;
+    size_t featureRows_;
+    size_t coordinateLength_;
+    float coordinateLimit_;
+    std::vector<ValueT> features_;
+    std::vector<float> projectionScale_;
+    std::vector<float> projectionOffset_;
+    std::vector<boost::int16_t> glyphs_;
+};
+
+} } // namespace KG::Ascii
+
+
+#endif // KGASCII_QUANTIZEDPCAGLYPHMATCHER_HPP
@@ -18,9 +18,12 @@
 #ifndef KGASCII_SEQUENTIALASCIIFIER_HPP
 #define KGASCII_SEQUENTIALASCIIFIER_HPP
 
+#include <algorithm>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 #include <kgascii/text_surface.hpp>
+#include <kgascii/generate_future.hpp>
+#include <kgascii/matcher_handle.hpp>
 
 namespace KG { namespace Ascii {
 
@@ -30,18 +33,27 @@ class SequentialAsciifier: boost::noncopyable
 public:
     typedef TGlyphMatcher GlyphMatcherT;
     typedef typename TGlyphMatcher::ContextT ContextT;
+    typedef GenerateFuture::CallbackT CallbackT;
 
 public:
     explicit SequentialAsciifier(boost::shared_ptr<const GlyphMatcherT> c)
         :matcher_(c)
-        ,context_(matcher_->createContext())
+        ,contextMatcher_(c)
+        ,context_(c->createContext())
     {
     }
 
 public:
     boost::shared_ptr<const GlyphMatcherT> matcher() const
     {
-        return matcher_;
+        return matcher_.get();
+    }
+
+    // May be called from any thread; frames started afterwards use the new
+    // matcher, a frame being converted finishes with the old one.
+    void setMatcher(boost::shared_ptr<const GlyphMatcherT> c)
+    {
+        matcher_.set(c);
     }
 
     unsigned threadCount() const
@@ -50,46 +62,64 @@ public:
     }
 
 public:
+    template<class TView>
+    GenerateFuture generateAsync(const TView& imgv, TextSurface& text, const CallbackT& cb=CallbackT())
+    {
+        return generateAsync(imgv, text, text.region(), cb);
+    }
+
+    template<class TView>
+    GenerateFuture generateAsync(const TView& imgv, TextSurface& text, const TextRegion& reg, const CallbackT& cb=CallbackT())
+    {
+        //there are no workers, the frame is finished before returning
+        boost::shared_ptr<Internal::GenerateState> state = statePool_.acquire(cb);
+        generate(imgv, text, reg);
+        state->taskDone();
+        return GenerateFuture(state);
+    }
+
     template<class TView>
     void generate(const TView& imgv, TextSurface& text)
     {
-        //single character size
-        size_t char_w = matcher_->cellWidth();
-        size_t char_h = matcher_->cellHeight();
-        //text surface size
-        size_t text_w = text.cols() * char_w;
-        size_t text_h = text.rows() * char_h;
-        //processed image region size
-        size_t roi_w = std::min<size_t>(imgv.width(), text_w);
-        size_t roi_h = std::min<size_t>(imgv.height(), text_h);
-
-        size_t y = 0, r = 0;
-        for (; y + char_h <= roi_h; y += char_h, ++r) {
-            size_t x = 0, c = 0;
-            for (; x + char_w <= roi_w; x += char_w, ++c) {
-                text(r, c) = matcher_->match(context_, subimage_view(imgv, x, y, char_w, char_h));
-            }
-            if (x < roi_w) {
-                size_t dx = roi_w - x;
-                text(r, c) = matcher_->match(context_, subimage_view(imgv, x, y, dx, char_h));
-            }
+        generate(imgv, text, text.region());
+    }
+
+    // Only the cells inside the region are matched; the image view still
+    // covers the whole surface, starting at its top left cell.
+    template<class TView>
+    void generate(const TView& imgv, TextSurface& text, const TextRegion& reg)
+    {
+        boost::shared_ptr<const GlyphMatcherT> matcher = matcher_.get();
+        if (matcher != contextMatcher_) {
+            //a context only works with the matcher that created it
+            context_ = matcher->createContext();
+            contextMatcher_ = matcher;
         }
-        if (y < roi_h) {
-            size_t dy = roi_h - y;
-            size_t x = 0, c = 0;
-            for (; x + char_w <= roi_w; x += char_w, ++c) {
-                text(r, c) = matcher_->match(context_, subimage_view(imgv, x, y, char_w, dy));
-            }
-            if (x < roi_w) {
-                size_t dx = roi_w - x;
-                text(r, c) = matcher_->match(context_, subimage_view(imgv, x, y, dx, dy));
+
+        TextRegion clip_reg = text.clip(reg);
+        //single character size
+        size_t char_w = matcher->cellWidth();
+        size_t char_h = matcher->cellHeight();
+        //processed image region
+        size_t roi_x = clip_reg.col * char_w;
+        size_t roi_y = clip_reg.row * char_h;
+        size_t roi_r = std::min<size_t>(imgv.width(), (clip_reg.col + clip_reg.cols) * char_w);
+        size_t roi_b = std::min<size_t>(imgv.height(), (clip_reg.row + clip_reg.rows) * char_h);
+
+        for (size_t y = roi_y, r = clip_reg.row; y < roi_b; y += char_h, ++r) {
+            size_t dy = std::min(char_h, roi_b - y);
+            for (size_t x = roi_x, c = clip_reg.col; x < roi_r; x += char_w, ++c) {
+                size_t dx = std::min(char_w, roi_r - x);
+                text(r, c) = matcher->match(context_, subimage_view(imgv, x, y, dx, dy));
             }
         }
     }
 
 private:
-    boost::shared_ptr<const GlyphMatcherT> matcher_;
+    MatcherHandle<GlyphMatcherT> matcher_;
+    boost::shared_ptr<const GlyphMatcherT> contextMatcher_;
     ContextT context_;
+    Internal::GenerateStatePool statePool_;
 };
 
 } } // namespace KG::Ascii
@@ -0,0 +1,154 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+#ifndef KGASCII_STATE_CACHE_HPP
+#define KGASCII_STATE_CACHE_HPP
+
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <boost/cstdint.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/gil/gil_all.hpp>
+#include <kgutil/fnv_hash.hpp>
+
+namespace KG { namespace Ascii {
+
+// On-disk store of precomputed matcher state shared between runs.
+// Entries are addressed by a hash of the font contents and of everything
+// else the state depends on, so a changed font or option simply misses
+// and stale entries are never read.
+// The directory is $KGASCII_CACHE_DIR, $XDG_CACHE_HOME/kgascii or
+// ~/.cache/kgascii, whichever is set first; an empty KGASCII_CACHE_DIR
+// disables the cache.
+class StateCache
+{
+public:
+    typedef boost::uint64_t KeyT;
+
+public:
+    static std::string defaultDirectory()
+    {
+        if (const char* dir = std::getenv("KGASCII_CACHE_DIR"))
+            return dir;
+        if (const char* xdg_dir = std::getenv("XDG_CACHE_HOME")) {
+            if (*xdg_dir)
+                return (boost::filesystem::path(xdg_dir) / "kgascii").string();
+        }
+        if (const char* home_dir = std::getenv("HOME")) {
+            if (*home_dir)
+                return (boost::filesystem::path(home_dir) / ".cache" / "kgascii").string();
+        }
+        return std::string();
+    }
+
+    // Hash of the glyph size, symbols and pixels of a font image;
+    // names and the nominal pixel size do not affect any matcher.
+    template<class TFontImage>
+    static KeyT fontKey(const TFontImage& font)
+    {
+        typedef typename TFontImage::ConstViewT ConstViewT;
+        typedef typename ConstViewT::value_type PixelT;
+
+        boost::uint32_t header[3] = { font.glyphWidth(), font.glyphHeight(), static_cast<boost::uint32_t>(font.glyphCount()) };
+        KeyT hash = KG::Util::fnv1aHash(header, sizeof(header));
+        for (size_t ci = 0; ci < font.glyphCount(); ++ci) {
+            boost::uint32_t sym = font.getSymbol(ci).value();
+            hash = KG::Util::fnv1aHash(&sym, sizeof(sym), hash);
+            const ConstViewT& glyph = font.getGlyph(ci);
+            for (ptrdiff_t y = 0; y < glyph.height(); ++y) {
+                hash = KG::Util::fnv1aHash(&glyph.row_begin(y)[0], glyph.width() * sizeof(PixelT), hash);
+            }
+        }
+        return hash;
+    }
+
+public:
+    explicit StateCache(const std::string& dir=defaultDirectory())
+        :directory_(dir)
+    {
+    }
+
+public:
+    bool enabled() const
+    {
+        return !directory_.empty();
+    }
+
+    const std::string& directory() const
+    {
+        return directory_;
+    }
+
+    // kind names the matcher state and its format, key covers the font
+    // and the options; both end up in the file name.
+    std::string entryPath(const std::string& kind, KeyT key) const
+    {
+        char hex[17];
+        std::sprintf(hex, "%016llx", static_cast<unsigned long long>(key));
+        return (boost::filesystem::path(directory_) / (kind + "-" + hex + ".bin")).string();
+    }
+
+    bool contains(const std::string& kind, KeyT key) const
+    {
+        boost::system::error_code ec;
+        return enabled() && boost::filesystem::is_regular_file(entryPath(kind, key), ec);
+    }
+
+    // Entries are written to a temporary file first and renamed into place
+    // by commitEntry(), so that concurrent readers never see partial files.
+    // An empty path means the entry cannot be written.
+    std::string temporaryPath(const std::string& kind, KeyT key) const
+    {
+        if (!enabled())
+            return std::string();
+        boost::system::error_code ec;
+        boost::filesystem::create_directories(directory_, ec);
+        if (!boost::filesystem::is_directory(directory_, ec))
+            return std::string();
+        return entryPath(kind, key) + boost::filesystem::unique_path(".%%%%-%%%%-%%%%.tmp").string();
+    }
+
+    bool commitEntry(const std::string& temp_path, const std::string& kind, KeyT key) const
+    {
+        boost::system::error_code ec;
+        boost::filesystem::rename(temp_path, entryPath(kind, key), ec);
+        if (ec) {
+            boost::filesystem::remove(temp_path, ec);
+            return false;
+        }
+        return true;
+    }
+
+    void removeTemporary(const std::string& temp_path) const
+    {
+        boost::system::error_code ec;
+        boost::filesystem::remove(temp_path, ec);
+    }
+
+    void discardEntry(const std::string& kind, KeyT key) const
+    {
+        boost::system::error_code ec;
+        boost::filesystem::remove(entryPath(kind, key), ec);
+    }
+
+private:
+    std::string directory_;
+};
+
+} } // namespace KG::Ascii
+
+#endif // KGASCII_STATE_CACHE_HPP
@@ -19,11 +19,42 @@
 #define KGASCII_TEXTSURFACE_HPP
 
 #include <vector>
+#include <algorithm>
 #include <kgascii/kgascii_api.hpp>
 #include <kgascii/symbol.hpp>
 
 namespace KG { namespace Ascii {
 
+// Cell-aligned rectangle in text surface coordinates.
+struct TextRegion
+{
+    TextRegion()
+        :row(0)
+        ,col(0)
+        ,rows(0)
+        ,cols(0)
+    {
+    }
+
+    TextRegion(unsigned r, unsigned c, unsigned rr, unsigned cc)
+        :row(r)
+        ,col(c)
+        ,rows(rr)
+        ,cols(cc)
+    {
+    }
+
+    bool empty() const
+    {
+        return rows == 0 || cols == 0;
+    }
+
+    unsigned row;
+    unsigned col;
+    unsigned rows;
+    unsigned cols;
+};
+
 class KGASCII_API TextSurface
 {
 public:
@@ -51,13 +82,27 @@ public:
         return cols_;
     }
 
+    TextRegion region() const
+    {
+        return TextRegion(0, 0, rows_, cols_);
+    }
+
+    TextRegion clip(const TextRegion& reg) const
+    {
+        unsigned r = std::min(reg.row, rows_);
+        unsigned c = std::min(reg.col, cols_);
+        unsigned rr = std::min(reg.rows, rows_ - r);
+        unsigned cc = std::min(reg.cols, cols_ - c);
+        return TextRegion(r, c, rr, cc);
+    }
+
     void resize(unsigned rr, unsigned cc)
     {
+        //the storage keeps its capacity, shrinking and growing back is free
         if (rows_ != rr || cols_ != cc) {
-            std::vector<Symbol> new_data(rr * cc);
-            std::swap(rows_, rr);
-            std::swap(cols_, cc);
-            std::swap(data_, new_data);
+            data_.assign(rr * cc, Symbol());
+            rows_ = rr;
+            cols_ = cc;
         }
     }
 
@@ -0,0 +1,163 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGUTIL_ALLOCATION_COUNTER_HPP
+#define KGUTIL_ALLOCATION_COUNTER_HPP
+
+#include <cstdlib>
+#include <new>
+#include <iostream>
+#include <boost/noncopyable.hpp>
+#include <boost/detail/atomic_count.hpp>
+
+namespace KG { namespace Util {
+
+// Eigen reports an allocation in a forbidden region through eigen_assert,
+// which NDEBUG compiles out. Where this header is included before any
+// Eigen header, a failed Eigen assertion aborts in every build.
+inline void eigenAssertionFailed(const char* expr, const char* file, int line)
+{
+    std::cerr << file << ":" << line << ": Eigen assertion failed: " << expr << "\n";
+    std::abort();
+}
+
+} } // namespace KG::Util
+
+#if defined(EIGEN_RUNTIME_NO_MALLOC) && !defined(eigen_assert)
+#define eigen_assert(x) \
+    do { \
+        if (!(x)) \
+            KG::Util::eigenAssertionFailed(#x, __FILE__, __LINE__); \
+    } while (false)
+#endif
+
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+#include <Eigen/Core>
+#endif
+
+namespace KG { namespace Util {
+
+// Debug aid counting heap allocations made through the global operator new.
+// The counting operators are installed by placing
+// KGUTIL_DEFINE_ALLOCATION_COUNTER in exactly one translation unit of
+// a program; without it installed() is false and the count stays 0.
+class AllocationCounter
+{
+public:
+    static long count()
+    {
+        return counter();
+    }
+
+    static bool installed()
+    {
+        return installedFlag();
+    }
+
+    // Used by the replacement operators only.
+    static void increment()
+    {
+        ++counter();
+    }
+
+    static bool& installedFlag()
+    {
+        static bool flag = false;
+        return flag;
+    }
+
+private:
+    static boost::detail::atomic_count& counter()
+    {
+        static boost::detail::atomic_count cnt(0);
+        return cnt;
+    }
+};
+
+// Allocations made since construction, by any thread.
+class AllocationScope
+{
+public:
+    AllocationScope()
+        :start_(AllocationCounter::count())
+    {
+    }
+
+    long allocations() const
+    {
+        return AllocationCounter::count() - start_;
+    }
+
+private:
+    long start_;
+};
+
+// Eigen allocates with malloc, which the counter does not see. In builds
+// with EIGEN_RUNTIME_NO_MALLOC an enabled scope forbids Eigen to allocate
+// until it is destroyed; the flag is global, so worker threads are
+// covered as well. Without EIGEN_RUNTIME_NO_MALLOC it does nothing.
+class EigenMallocScope: boost::noncopyable
+{
+public:
+    explicit EigenMallocScope(bool forbid)
+        :forbid_(forbid)
+    {
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+        if (forbid_)
+            Eigen::internal::set_is_malloc_allowed(false);
+#endif
+    }
+
+    ~EigenMallocScope()
+    {
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+        if (forbid_)
+            Eigen::internal::set_is_malloc_allowed(true);
+#endif
+    }
+
+private:
+    bool forbid_;
+};
+
+} } // namespace KG::Util
+
+#define KGUTIL_DEFINE_ALLOCATION_COUNTER \
+    void* operator new(std::size_t size) \
+    { \
+        KG::Util::AllocationCounter::increment(); \
+        if (void* ptr = std::malloc(size ? size : 1)) \
+            return ptr; \
+        throw std::bad_alloc(); \
+    } \
+    void* operator new[](std::size_t size) \
+    { \
+        return operator new(size); \
+    } \
+    void operator delete(void* ptr) throw() \
+    { \
+        std::free(ptr); \
+    } \
+    void operator delete[](void* ptr) throw() \
+    { \
+        std::free(ptr); \
+    } \
+    namespace { \
+        const bool kgutil_allocation_counter_installed = (KG::Util::AllocationCounter::installedFlag() = true); \
+    }
+
+#endif // KGUTIL_ALLOCATION_COUNTER_HPP
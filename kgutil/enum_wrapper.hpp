@@ -141,7 +141,7 @@ private:
                  it = vn_map.begin(), it_end = vn_map.end(); 
                  it != it_end; ++it) 
             {
-                max_length = std::max(max_length, it->right.size());
+                max_length = std::max<unsigned>(max_length, it->right.size());
             }
         }
         return max_length;
@@ -0,0 +1,49 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGUTIL_FNV_HASH_HPP
+#define KGUTIL_FNV_HASH_HPP
+
+#include <string>
+#include <cstddef>
+#include <boost/cstdint.hpp>
+
+namespace KG { namespace Util {
+
+const boost::uint64_t FNV1A_OFFSET_BASIS = 14695981039346656037ull;
+const boost::uint64_t FNV1A_PRIME = 1099511628211ull;
+
+// 64 bit FNV-1a. Data given in several pieces hashes the same as when
+// given at once if the previous result is passed as the initial hash.
+inline boost::uint64_t fnv1aHash(const void* data, size_t size, boost::uint64_t hash=FNV1A_OFFSET_BASIS)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= FNV1A_PRIME;
+    }
+    return hash;
+}
+
+inline boost::uint64_t fnv1aHash(const std::string& data, boost::uint64_t hash=FNV1A_OFFSET_BASIS)
+{
+    return fnv1aHash(data.data(), data.size(), hash);
+}
+
+} } // namespace KG::Util
+
+#endif // KGUTIL_FNV_HASH_HPP
@@ -173,6 +173,76 @@ bool loadAndConvertImage(const TString& filename, TImage& image)
     return Internal::loadImage(filename, image, boost::mpl::true_());
 }
 
+namespace Internal {
+
+template<class TString, class TView, class TTag, bool Convert>
+bool tryLoadView(const TString& filename, const TView& view, const TTag& tag, 
+    const boost::mpl::bool_<Convert>& conv)
+{
+    boost::gil::read_view(filename, view, tag);
+    return true;
+}
+
+template<class TString, class TView, class TTag>
+bool tryLoadView(const TString& filename, const TView& view, const TTag& tag, 
+    const boost::mpl::true_&)
+{
+    boost::gil::read_and_convert_view(filename, view, tag);
+    return true;
+}
+
+template<class TString, class TView, bool Convert>
+bool loadView(const TString& filename, const TView& view, 
+    const boost::mpl::bool_<Convert>& conv)
+{
+    boost::filesystem::path file_path(filename);
+    std::string ext = boost::algorithm::to_lower_copy(file_path.extension().string());
+
+    if (ext == ".bmp") {
+        if (tryLoadView(filename, view, boost::gil::bmp_tag(), conv))
+            return true;
+    }
+    if (ext == ".jpg" || ext == ".jpeg") {
+        if (tryLoadView(filename, view, boost::gil::jpeg_tag(), conv))
+            return true;
+    }
+    if (ext == ".png") {
+        if (tryLoadView(filename, view, boost::gil::png_tag(), conv))
+            return true;
+    }
+    if (ext == ".pnm" || ext == ".pbm" || ext == ".pgm" || ext == ".ppm") {
+        if (tryLoadView(filename, view, boost::gil::pnm_tag(), conv))
+            return true;
+    }
+    if (ext == ".tga") {
+        if (tryLoadView(filename, view, boost::gil::targa_tag(), conv))
+            return true;
+    }
+    if (ext == ".tif" || ext == ".tiff") {
+        if (tryLoadView(filename, view, boost::gil::tiff_tag(), conv))
+            return true;
+    }
+    return false;
+}
+
+} // namespace Internal
+
+// The loadView() functions decode the image into existing pixels instead
+// of allocating an image. The view must not be smaller than the image,
+// only its top left part is written if it is larger.
+
+template<class TString, class TView>
+bool loadView(const TString& filename, const TView& view)
+{
+    return Internal::loadView(filename, view, boost::mpl::false_());
+}
+
+template<class TString, class TView>
+bool loadAndConvertView(const TString& filename, const TView& view)
+{
+    return Internal::loadView(filename, view, boost::mpl::true_());
+}
+
 struct ImageInfo
 {
     unsigned width;
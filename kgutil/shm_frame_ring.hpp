@@ -0,0 +1,288 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGUTIL_SHMFRAMERING_HPP
+#define KGUTIL_SHMFRAMERING_HPP
+
+#include <string>
+#include <new>
+#include <stdexcept>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/gil/gil_all.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/interprocess/sync/interprocess_condition.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+
+namespace KG { namespace Util {
+
+enum ShmPixelFormat
+{
+    SHM_GRAY8 = 1,
+    SHM_BGR8 = 2,
+    // one byte per text cell, width = columns, height = rows
+    SHM_TEXT8 = 3
+};
+
+struct ShmFrameHeader
+{
+    boost::uint32_t width;
+    boost::uint32_t height;
+    // bytes per row
+    boost::uint32_t stride;
+    boost::uint32_t format;
+    // assigned by the ring when the frame is published, starts at 0
+    boost::uint64_t seq;
+};
+
+// Bytes per pixel of a ShmPixelFormat, 0 for unknown formats.
+inline size_t shmPixelSize(boost::uint32_t format)
+{
+    switch (format) {
+    case SHM_GRAY8:
+    case SHM_TEXT8:
+        return 1;
+    case SHM_BGR8:
+        return 3;
+    default:
+        return 0;
+    }
+}
+
+// Single producer, single consumer ring of frame slots in POSIX shared
+// memory. Each slot holds a ShmFrameHeader followed by up to slotSize()
+// bytes of pixel data. The producer fills a slot in place between
+// beginWrite() and endWrite(), the consumer reads it in place between
+// beginRead() and endRead(); frames are never copied by the ring.
+// One side creates the ring, the other opens it by name. The other side
+// is not trusted: the ring geometry is checked when opening, and frame
+// headers have to be checked with frameFits() before touching pixels.
+class ShmFrameRing: boost::noncopyable
+{
+public:
+    ShmFrameRing(boost::interprocess::create_only_t, const std::string& name, size_t slot_cnt, size_t slot_size)
+        :name_(name)
+        ,owner_(true)
+    {
+        using namespace boost::interprocess;
+        if (slot_cnt == 0)
+            throw std::invalid_argument("frame ring without slots");
+        size_t slot_stride = alignSize(sizeof(ShmFrameHeader) + slot_size);
+        shm_ = shared_memory_object(create_only, name.c_str(), read_write);
+        shm_.truncate(alignSize(sizeof(RingHeader)) + slot_cnt * slot_stride);
+        region_ = mapped_region(shm_, read_write);
+        header_ = new (region_.get_address()) RingHeader;
+        header_->slot_count = slot_cnt;
+        header_->slot_size = slot_size;
+        header_->slot_stride = slot_stride;
+        header_->write_seq = 0;
+        header_->read_seq = 0;
+        header_->closed = false;
+        slotCount_ = slot_cnt;
+        slotSize_ = slot_size;
+        slotStride_ = slot_stride;
+        //the magic is set last, the ring is usable from now on; the fence
+        //keeps the other fields from becoming visible after it
+        boost::atomic_thread_fence(boost::memory_order_release);
+        header_->magic = MAGIC;
+    }
+
+    ShmFrameRing(boost::interprocess::open_only_t, const std::string& name)
+        :name_(name)
+        ,owner_(false)
+    {
+        using namespace boost::interprocess;
+        shm_ = shared_memory_object(open_only, name.c_str(), read_write);
+        region_ = mapped_region(shm_, read_write);
+        header_ = static_cast<RingHeader*>(region_.get_address());
+        if (region_.get_size() < alignSize(sizeof(RingHeader)) || header_->magic != MAGIC)
+            throw std::runtime_error("not a frame ring: " + name);
+        boost::atomic_thread_fence(boost::memory_order_acquire);
+
+        //the geometry is read once, later changes by the other side are ignored
+        slotCount_ = header_->slot_count;
+        slotSize_ = header_->slot_size;
+        slotStride_ = header_->slot_stride;
+        size_t slots_size = region_.get_size() - alignSize(sizeof(RingHeader));
+        if (slotCount_ == 0 || slotSize_ > slotStride_ || slotStride_ - slotSize_ < sizeof(ShmFrameHeader)
+                || slotStride_ > slots_size || slotCount_ > slots_size / slotStride_)
+            throw std::runtime_error("corrupted frame ring: " + name);
+    }
+
+    ~ShmFrameRing()
+    {
+        if (owner_) {
+            //the other side keeps its mapping, only the name goes away
+            boost::interprocess::shared_memory_object::remove(name_.c_str());
+        }
+    }
+
+    static bool remove(const std::string& name)
+    {
+        return boost::interprocess::shared_memory_object::remove(name.c_str());
+    }
+
+public:
+    const std::string& name() const
+    {
+        return name_;
+    }
+
+    size_t slotCount() const
+    {
+        return slotCount_;
+    }
+
+    size_t slotSize() const
+    {
+        return slotSize_;
+    }
+
+    // Whether the pixels described by the header, stride included, lie within
+    // a slot. Frames failing this have to be skipped like unknown formats.
+    bool frameFits(const ShmFrameHeader& hdr) const
+    {
+        boost::uint64_t pixel_size = shmPixelSize(hdr.format);
+        if (pixel_size == 0)
+            return false;
+        //32 bit factors, the products can not wrap in 64 bits
+        return static_cast<boost::uint64_t>(hdr.width) * pixel_size <= hdr.stride
+            && static_cast<boost::uint64_t>(hdr.stride) * hdr.height <= slotSize_;
+    }
+
+public:
+    // Producer side. Waits for a free slot, returns its data area or 0 when
+    // the ring was closed.
+    char* beginWrite()
+    {
+        LockT lock(header_->mutex);
+        while (!header_->closed && header_->write_seq - header_->read_seq >= slotCount_) {
+            header_->read_cond.wait(lock);
+        }
+        if (header_->closed)
+            return 0;
+        return slotData(header_->write_seq);
+    }
+
+    // Publishes the slot returned by beginWrite(), returns its sequence number.
+    boost::uint64_t endWrite(const ShmFrameHeader& hdr)
+    {
+        LockT lock(header_->mutex);
+        boost::uint64_t seq = header_->write_seq;
+        ShmFrameHeader* slot_hdr = slotHeader(seq);
+        *slot_hdr = hdr;
+        slot_hdr->seq = seq;
+        header_->write_seq++;
+        header_->write_cond.notify_all();
+        return seq;
+    }
+
+    // Consumer side. Waits for a published frame; returns false when the
+    // ring was closed and all frames were consumed.
+    bool beginRead(ShmFrameHeader& hdr, const char*& data)
+    {
+        LockT lock(header_->mutex);
+        while (header_->read_seq == header_->write_seq) {
+            if (header_->closed)
+                return false;
+            header_->write_cond.wait(lock);
+        }
+        hdr = *slotHeader(header_->read_seq);
+        data = slotData(header_->read_seq);
+        return true;
+    }
+
+    // Returns the slot obtained by beginRead() to the producer.
+    void endRead()
+    {
+        LockT lock(header_->mutex);
+        header_->read_seq++;
+        header_->read_cond.notify_all();
+    }
+
+    // Ends the stream; the consumer still gets the frames already published.
+    void close()
+    {
+        LockT lock(header_->mutex);
+        header_->closed = true;
+        header_->write_cond.notify_all();
+        header_->read_cond.notify_all();
+    }
+
+private:
+    typedef boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> LockT;
+
+    static const boost::uint32_t MAGIC = 0x4b47524eu;
+    static const size_t ALIGNMENT = 64;
+
+    struct RingHeader
+    {
+        boost::uint32_t magic;
+        boost::uint64_t slot_count;
+        boost::uint64_t slot_size;
+        boost::uint64_t slot_stride;
+        boost::uint64_t write_seq;
+        boost::uint64_t read_seq;
+        bool closed;
+        boost::interprocess::interprocess_mutex mutex;
+        boost::interprocess::interprocess_condition write_cond;
+        boost::interprocess::interprocess_condition read_cond;
+    };
+
+    static size_t alignSize(size_t size)
+    {
+        return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+
+    ShmFrameHeader* slotHeader(boost::uint64_t seq) const
+    {
+        char* base = static_cast<char*>(region_.get_address()) + alignSize(sizeof(RingHeader));
+        return reinterpret_cast<ShmFrameHeader*>(base + (seq % slotCount_) * slotStride_);
+    }
+
+    char* slotData(boost::uint64_t seq) const
+    {
+        return reinterpret_cast<char*>(slotHeader(seq)) + sizeof(ShmFrameHeader);
+    }
+
+private:
+    std::string name_;
+    bool owner_;
+    boost::interprocess::shared_memory_object shm_;
+    boost::interprocess::mapped_region region_;
+    RingHeader* header_;
+    size_t slotCount_;
+    size_t slotSize_;
+    size_t slotStride_;
+};
+
+// View of a slot's pixels, as castSurface does for cv::Mat.
+// The header has to pass ShmFrameRing::frameFits() first.
+template<typename TPixel>
+inline
+typename boost::gil::type_from_x_iterator<TPixel*>::view_t shmFrameView(const ShmFrameHeader& hdr, const char* data)
+{
+    TPixel* pixels = reinterpret_cast<TPixel*>(const_cast<char*>(data));
+    return boost::gil::interleaved_view(hdr.width, hdr.height, pixels, hdr.stride);
+}
+
+} } // namespace KG::Util
+
+#endif // KGUTIL_SHMFRAMERING_HPP
@@ -20,16 +20,23 @@
 
 #include <boost/noncopyable.hpp>
 #include <boost/thread.hpp>
-#include <deque>
+#include <vector>
+#include <algorithm>
 
 namespace KG { namespace Util {
 
+// Tasks are kept in a ring buffer that only grows, so a queue that has
+// reached its working size no longer allocates on push() and done().
+// Task has to be default constructible; finished slots are reset to a
+// default value to release whatever the task refers to.
 template<class Task>
 class TaskQueue: boost::noncopyable
 {
 public:
     TaskQueue()
         :closing_(false)
+        ,head_(0)
+        ,size_(0)
         ,index_(0)
     {
     }
@@ -37,7 +44,11 @@ public:
     void push(const Task& t)
     {
         boost::unique_lock<boost::mutex> lock(mutex_);
-        queue_.push_back(t);
+        if (size_ == ring_.size()) {
+            grow();
+        }
+        ring_[(head_ + size_) % ring_.size()] = t;
+        size_++;
         lock.unlock();
         activeCondition_.notify_one();
     }
@@ -45,19 +56,21 @@ public:
     bool wait_pop(Task& t)
     {
         boost::unique_lock<boost::mutex> lock(mutex_);
-        while (!closing_ && queue_.size() <= index_) {
+        while (!closing_ && size_ <= index_) {
             activeCondition_.wait(lock);
         }
         if (closing_)
             return false;
-        t = queue_[index_++];
+        t = ring_[(head_ + index_++) % ring_.size()];
         return true;
     }
 
     void done()
     {
         boost::unique_lock<boost::mutex> lock(mutex_);
-        queue_.pop_front();
+        ring_[head_] = Task();
+        head_ = (head_ + 1) % ring_.size();
+        size_--;
         index_--;
         lock.unlock();
         doneCondition_.notify_one();
@@ -66,7 +79,7 @@ public:
     void wait_empty()
     {
         boost::unique_lock<boost::mutex> lock(mutex_);
-        while (!queue_.empty()) {
+        while (size_ > 0) {
             doneCondition_.wait(lock);
         }
     }
@@ -79,9 +92,22 @@ public:
         activeCondition_.notify_all();
     }
 
+private:
+    void grow()
+    {
+        std::vector<Task> new_ring(std::max<size_t>(2 * ring_.size(), 16));
+        for (size_t i = 0; i < size_; ++i) {
+            new_ring[i] = ring_[(head_ + i) % ring_.size()];
+        }
+        ring_.swap(new_ring);
+        head_ = 0;
+    }
+
 private:
     bool closing_;
-    std::deque<Task> queue_;
+    std::vector<Task> ring_;
+    size_t head_;
+    size_t size_;
     size_t index_;
     boost::mutex mutex_;
     boost::condition_variable activeCondition_;
@@ -0,0 +1,167 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+//comes first, so that it can keep Eigen's assertions live
+#include <kgutil/allocation_counter.hpp>
+
+KGUTIL_DEFINE_ALLOCATION_COUNTER
+
+#include <iostream>
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <boost/gil/gil_all.hpp>
+#include <common/cmdline_tool.hpp>
+#include <kgascii/font_image.hpp>
+#include <kgascii/font_io.hpp>
+#include <kgascii/dynamic_asciifier.hpp>
+#include <kgascii/text_surface.hpp>
+#include <kgascii/glyph_matcher_context_factory.hpp>
+
+using namespace KG::Ascii;
+
+typedef Font<> FontT;
+typedef FontImage<FontT> FontImageT;
+typedef DynamicGlyphMatcher<FontImageT> DynamicGlyphMatcherT;
+typedef DynamicAsciifier<DynamicGlyphMatcherT> DynamicAsciifierT;
+
+// Converts a synthetic image with the sequential and the parallel
+// asciifier and fails if any frame after the warm-up allocates memory,
+// either through operator new or, in builds with EIGEN_RUNTIME_NO_MALLOC,
+// inside Eigen.
+class AllocationCheck: public CmdlineTool
+{
+public:
+    AllocationCheck();
+
+protected:
+    bool processArgs();
+
+    int doExecute();
+
+private:
+    unsigned checkAsciifier(const char* name, DynamicAsciifierT& asciifier);
+
+private:
+    std::string fontFile_;
+    std::string algorithm_;
+    unsigned cols_;
+    unsigned rows_;
+    unsigned threads_;
+    unsigned warmupFrames_;
+    unsigned frames_;
+    boost::gil::gray8_image_t image_;
+    TextSurface text_;
+};
+
+int main(int argc, char* argv[])
+{
+    return AllocationCheck().execute(argc, argv);
+}
+
+AllocationCheck::AllocationCheck()
+    :CmdlineTool("Options")
+{
+    using namespace boost::program_options;
+    desc_.add_options()
+        ("font-file,f", value(&fontFile_), "font file")
+        ("algorithm,a", value(&algorithm_)->default_value("pca"), "glyph matching algorithm")
+        ("cols,c", value(&cols_)->default_value(80), "text columns")
+        ("rows,r", value(&rows_)->default_value(25), "text rows")
+        ("threads,t", value(&threads_)->default_value(4), "threads of the parallel asciifier")
+        ("warmup", value(&warmupFrames_)->default_value(4), "frames converted before counting")
+        ("frames", value(&frames_)->default_value(16), "frames checked after the warm-up")
+    ;
+    posDesc_.add("font-file", 1);
+}
+
+bool AllocationCheck::processArgs()
+{
+    requireOption("font-file");
+    if (threads_ == 0)
+        throw std::logic_error("the parallel asciifier needs at least one thread");
+    return true;
+}
+
+int AllocationCheck::doExecute()
+{
+    using namespace boost::gil;
+
+    if (!KG::Util::AllocationCounter::installed()) {
+        std::cerr << "error: allocation counter not installed\n";
+        return 1;
+    }
+
+    boost::shared_ptr<FontT> font(new FontT);
+    if (!font->load(fontFile_)) {
+        std::cerr << "problem loading font\n";
+        return 1;
+    }
+    boost::shared_ptr<FontImageT> font_image(new FontImageT(font));
+    registerGlyphMatcherFactories<FontImageT>();
+    boost::shared_ptr<const DynamicGlyphMatcherT> matcher = GlyphMatcherFactory::create(font_image, algorithm_);
+
+    //a diagonal ramp, so that the matcher sees more than a single glyph
+    image_.recreate(cols_ * matcher->cellWidth(), rows_ * matcher->cellHeight());
+    gray8_view_t imgv = view(image_);
+    for (ptrdiff_t y = 0; y < imgv.height(); ++y) {
+        for (ptrdiff_t x = 0; x < imgv.width(); ++x) {
+            imgv(x, y) = gray8_pixel_t(static_cast<unsigned char>((x * 7 + y * 3) & 0xff));
+        }
+    }
+    text_.resize(rows_, cols_);
+
+    unsigned failures = 0;
+    {
+        DynamicAsciifierT asciifier(matcher);
+        failures += checkAsciifier("sequential", asciifier);
+    }
+    {
+        DynamicAsciifierT asciifier(matcher, threads_);
+        failures += checkAsciifier("parallel", asciifier);
+    }
+    if (failures > 0) {
+        std::cerr << "error: frames allocated memory after warm-up\n";
+        return 1;
+    }
+    return 0;
+}
+
+unsigned AllocationCheck::checkAsciifier(const char* name, DynamicAsciifierT& asciifier)
+{
+    boost::gil::gray8c_view_t imgv = boost::gil::const_view(image_);
+    for (unsigned i = 0; i < warmupFrames_; ++i) {
+        text_.clear();
+        asciifier.generate(imgv, text_);
+    }
+
+    unsigned allocating = 0;
+    long allocations = 0;
+    for (unsigned i = 0; i < frames_; ++i) {
+        KG::Util::AllocationScope alloc_scope;
+        KG::Util::EigenMallocScope eigen_scope(true);
+        text_.clear();
+        asciifier.generate(imgv, text_);
+        long frame_allocations = alloc_scope.allocations();
+        if (frame_allocations > 0) {
+            allocating++;
+            allocations += frame_allocations;
+        }
+    }
+    std::cout << name << " allocating frames " << allocating << " of " << frames_
+              << " allocations " << allocations << "\n";
+    return allocating;
+}
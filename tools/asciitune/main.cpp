@@ -0,0 +1,261 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread.hpp>
+#include <common/cmdline_tool.hpp>
+#include <common/tuning_profile.hpp>
+#include <kgascii/font_image.hpp>
+#include <kgascii/font_io.hpp>
+#include <kgascii/sequential_asciifier.hpp>
+#include <kgascii/parallel_asciifier.hpp>
+#include <kgascii/matcher_benchmark.hpp>
+#include <kgascii/glyph_matcher_context_factory.hpp>
+#include <kgutil/srgb.hpp>
+
+using namespace KG::Ascii;
+
+typedef Font<> FontT;
+
+class AsciiTune: public CmdlineTool
+{
+public:
+    AsciiTune();
+
+protected:
+    bool processArgs();
+
+    int doExecute();
+
+private:
+    template<class ImageT>
+    bool tune(boost::shared_ptr<const FontT> font, TuningProfile& profile);
+
+    std::vector<unsigned> threadCounts() const;
+
+    std::vector<unsigned> taskSizes() const;
+
+private:
+    std::string fontFile_;
+    std::string outputFile_;
+    std::string algorithms_;
+    std::string reference_;
+    double minAgreement_;
+    unsigned cols_;
+    unsigned rows_;
+    unsigned maxThreads_;
+    unsigned measureTime_;
+    bool gamma_;
+};
+
+int main(int argc, char* argv[])
+{
+    return AsciiTune().execute(argc, argv);
+}
+
+
+AsciiTune::AsciiTune()
+    :CmdlineTool("Options")
+{
+    using namespace boost::program_options;
+    desc_.add_options()
+        ("font-file,f", value(&fontFile_), "font file")
+        ("output-file,o", value(&outputFile_), "output profile file")
+        ("algorithms,a", value(&algorithms_)->default_value("sed,md,mi,"
+            "pca:nf=4,pca:nf=4:quant=8,pca:nf=4:quant=16,pca:nf=8,pca:nf=8:quant=8,pca:nf=8:quant=16,"
+            "pca:nf=12,pca:nf=12:quant=8,pca:nf=12:quant=16,pca:nf=16,pca:nf=16:quant=8,pca:nf=16:quant=16,ramp"), 
+            "comma separated candidate algorithms")
+        ("reference", value(&reference_)->default_value("sed"), "algorithm defining the expected result")
+        ("min-agreement", value(&minAgreement_)->default_value(0.9), "minimal fraction of cells equal to the reference")
+        ("cols,c", value(&cols_)->default_value(79), "number of text columns of a tuning frame")
+        ("rows,r", value(&rows_)->default_value(49), "number of text rows of a tuning frame")
+        ("max-threads", value(&maxThreads_)->default_value(0), "largest thread count tried (0 = twice the core count)")
+        ("measure-time", value(&measureTime_)->default_value(100), "time spent measuring each configuration in ms")
+        ("gamma", bool_switch(&gamma_), "tune for gamma corrected conversion (img2ascii --gamma)")
+    ;
+    posDesc_.add("font-file", 1);
+    posDesc_.add("output-file", 1);
+}
+
+bool AsciiTune::processArgs()
+{
+    requireOption("font-file");
+    requireOption("output-file");
+    if (minAgreement_ < 0 || minAgreement_ > 1)
+        throw std::logic_error("min-agreement has to be in range [0, 1]");
+    if (cols_ == 0 || rows_ == 0)
+        throw std::logic_error("empty tuning frame");
+    return true;
+}
+
+std::vector<unsigned> AsciiTune::threadCounts() const
+{
+    unsigned hw_threads = std::max(boost::thread::hardware_concurrency(), 1u);
+    unsigned max_threads = maxThreads_ ? maxThreads_ : 2 * hw_threads;
+    std::vector<unsigned> counts;
+    for (unsigned t = 1; t <= max_threads; t *= 2) {
+        counts.push_back(t);
+    }
+    //the old default of threads=0
+    if (hw_threads + 1 <= max_threads) {
+        counts.push_back(hw_threads);
+        counts.push_back(hw_threads + 1);
+    }
+    std::sort(counts.begin(), counts.end());
+    counts.erase(std::unique(counts.begin(), counts.end()), counts.end());
+    return counts;
+}
+
+std::vector<unsigned> AsciiTune::taskSizes() const
+{
+    std::vector<unsigned> sizes;
+    for (unsigned s = 1; s <= 8 && s <= rows_; s *= 2) {
+        sizes.push_back(s);
+    }
+    return sizes;
+}
+
+template<class ImageT>
+bool AsciiTune::tune(boost::shared_ptr<const FontT> font, TuningProfile& profile)
+{
+    typedef FontImage<FontT, ImageT> FontImageT;
+    typedef DynamicGlyphMatcher<FontImageT> DynamicGlyphMatcherT;
+    typedef boost::shared_ptr<const DynamicGlyphMatcherT> MatcherPtrT;
+
+    boost::posix_time::time_duration min_time = boost::posix_time::milliseconds(measureTime_);
+
+    registerGlyphMatcherFactories<FontImageT>();
+    boost::shared_ptr<FontImageT> font_image(new FontImageT(font));
+    MatcherBenchmark<FontImageT> bench(font_image, rows_, cols_);
+
+    std::cout << "creating reference matcher " << reference_ << "\n";
+    TextSurface reference;
+    bench.generateReference(MatcherPtrT(GlyphMatcherFactory::create(font_image, reference_)), reference);
+
+    std::vector<std::string> algorithms;
+    boost::algorithm::split(algorithms, algorithms_, boost::algorithm::is_any_of(","));
+
+    //single thread cost and quality of every candidate
+    std::vector<MatcherPtrT> candidates;
+    std::vector<std::string> candidate_names;
+    std::vector<double> candidate_agreement;
+    std::vector<double> candidate_cost;
+    TextSurface text;
+    for (size_t i = 0; i < algorithms.size(); ++i) {
+        if (algorithms[i].empty())
+            continue;
+        MatcherPtrT matcher;
+        try {
+            matcher = GlyphMatcherFactory::create(font_image, algorithms[i]);
+        } catch (const std::exception& e) {
+            std::cout << algorithms[i] << ": skipped (" << e.what() << ")\n";
+            continue;
+        }
+        typename MatcherBenchmark<FontImageT>::Result res = bench.evaluate(matcher, reference, text, min_time);
+        bool accepted = res.agreement >= minAgreement_;
+        std::cout << algorithms[i] << ": " << res.cellCost * 1e9 << " ns/cell, agreement " << res.agreement 
+            << (accepted ? "" : " (rejected)") << "\n";
+        if (accepted) {
+            candidates.push_back(matcher);
+            candidate_names.push_back(algorithms[i]);
+            candidate_agreement.push_back(res.agreement);
+            candidate_cost.push_back(res.cellCost);
+        }
+    }
+    if (candidates.empty()) {
+        std::cerr << "no algorithm reaches the requested agreement\n";
+        return false;
+    }
+
+    std::vector<unsigned> thread_counts = threadCounts();
+    std::vector<unsigned> task_sizes = taskSizes();
+    unsigned hw_threads = std::max(boost::thread::hardware_concurrency(), 1u);
+
+    size_t best = 0;
+    double best_cost = candidate_cost[0];
+    unsigned best_threads = 1;
+    unsigned best_task_size = 1;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (candidate_cost[i] < best_cost) {
+            best = i;
+            best_cost = candidate_cost[i];
+            best_threads = 1;
+            best_task_size = 1;
+        }
+        //no thread count can beat perfect scaling over all cores
+        if (candidate_cost[i] / hw_threads >= best_cost)
+            continue;
+        for (size_t t = 0; t < thread_counts.size(); ++t) {
+            if (thread_counts[t] == 1)
+                continue;
+            for (size_t s = 0; s < task_sizes.size(); ++s) {
+                ParallelAsciifier<DynamicGlyphMatcherT> asciifier(candidates[i], thread_counts[t], task_sizes[s]);
+                double cost = bench.measureCost(asciifier, text, min_time);
+                std::cout << candidate_names[i] << " threads " << thread_counts[t] << " rows/task " << task_sizes[s] 
+                    << ": " << cost * 1e9 << " ns/cell\n";
+                if (cost < best_cost) {
+                    best = i;
+                    best_cost = cost;
+                    best_threads = thread_counts[t];
+                    best_task_size = task_sizes[s];
+                }
+            }
+        }
+    }
+
+    profile.algorithm = candidate_names[best];
+    profile.threadCount = best_threads;
+    profile.rowsPerTask = best_task_size;
+    profile.cellWidth = font_image->glyphWidth();
+    profile.cellHeight = font_image->glyphHeight();
+    profile.hardwareThreads = hw_threads;
+    profile.cellCost = best_cost;
+    profile.agreement = candidate_agreement[best];
+    return true;
+}
+
+int AsciiTune::doExecute()
+{
+    std::cout << "loading font\n";
+    boost::shared_ptr<FontT> font(new FontT);
+    if (!font->load(fontFile_)) {
+        std::cerr << "problem loading font\n";
+        return -1;
+    }
+
+    TuningProfile profile;
+    bool found;
+    if (gamma_) {
+        found = tune<boost::gil::gray_lin16_image_t>(font, profile);
+    } else {
+        found = tune<FontT::ImageT>(font, profile);
+    }
+    if (!found)
+        return -1;
+
+    std::cout << "selected algorithm " << profile.algorithm << "\n";
+    std::cout << "selected threads " << profile.threadCount << "\n";
+    std::cout << "selected rows/task " << profile.rowsPerTask << "\n";
+    std::cout << "frame time " << profile.cellCost * cols_ * rows_ * 1e3 << " ms\n";
+    profile.save(outputFile_);
+    return 0;
+}
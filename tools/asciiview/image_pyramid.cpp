@@ -0,0 +1,67 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include "image_pyramid.hpp"
+#include <stdexcept>
+#include <kgutil/image_io.hpp>
+#include <kgutil/resample/resampler.hpp>
+#include <kgutil/resample/filter/bspline.hpp>
+
+namespace {
+
+//levels narrower than this are not halved any further, the resampler
+//needs a few source pixels for every filter tap
+const unsigned MIN_HALVED_SIZE = 32;
+
+} // namespace
+
+ImagePyramid::ImagePyramid(const std::string& file, unsigned min_width, unsigned min_height)
+{
+    using namespace boost::gil;
+
+    //decoded straight into grayscale, one scanline at a time, so that
+    //huge images never exist in memory in their full color form
+    boost::shared_ptr<ImageT> base(new ImageT);
+    if (!KG::Util::loadAndConvertImage(file, *base))
+        throw std::runtime_error("cannot load image " + file);
+    levels_.push_back(base);
+
+    typedef KG::Util::Filter::BSplineFilter<> FilterT;
+    for (;;) {
+        ViewT src = const_view(*levels_.back());
+        if (src.width() <= static_cast<long>(min_width) && src.height() <= static_cast<long>(min_height))
+            break;
+        if (src.width() < static_cast<long>(MIN_HALVED_SIZE) || src.height() < static_cast<long>(MIN_HALVED_SIZE))
+            break;
+        unsigned dst_w = (src.width() + 1) / 2;
+        unsigned dst_h = (src.height() + 1) / 2;
+        boost::shared_ptr<ImageT> dst(new ImageT(dst_w, dst_h));
+        KG::Util::Resampler<FilterT> resampler(src.width(), src.height(), dst_w, dst_h);
+        resampler.apply(src, view(*dst));
+        levels_.push_back(dst);
+    }
+}
+
+unsigned ImagePyramid::levelCount() const
+{
+    return levels_.size();
+}
+
+ImagePyramid::ViewT ImagePyramid::level(unsigned lvl) const
+{
+    return const_view(*levels_.at(lvl));
+}
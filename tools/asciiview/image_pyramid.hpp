@@ -0,0 +1,49 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_TOOLS_ASCIIVIEW_IMAGE_PYRAMID_HPP
+#define KGASCII_TOOLS_ASCIIVIEW_IMAGE_PYRAMID_HPP
+
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/gil/gil_all.hpp>
+
+
+// Grayscale image together with its successively halved versions.
+// Level 0 is the image at full resolution; halving stops once a level
+// fits into the given minimum size.
+class ImagePyramid: boost::noncopyable
+{
+public:
+    typedef boost::gil::gray8_image_t ImageT;
+    typedef ImageT::const_view_t ViewT;
+
+public:
+    ImagePyramid(const std::string& file, unsigned min_width, unsigned min_height);
+
+public:
+    unsigned levelCount() const;
+
+    ViewT level(unsigned lvl) const;
+
+private:
+    std::vector<boost::shared_ptr<ImageT> > levels_;
+};
+
+#endif // KGASCII_TOOLS_ASCIIVIEW_IMAGE_PYRAMID_HPP
@@ -0,0 +1,264 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <common/cmdline_tool.hpp>
+#include <kgascii/font_io.hpp>
+#include <kgascii/glyph_matcher_context_factory.hpp>
+#include <kgutil/fnv_hash.hpp>
+#include "image_pyramid.hpp"
+#include "tile_cache.hpp"
+#include "tile_viewer.hpp"
+
+using namespace KG::Ascii;
+
+typedef TileViewer::FontT FontT;
+typedef TileViewer::FontImageT FontImageT;
+
+class AsciiView: public CmdlineTool
+{
+public:
+    AsciiView();
+
+protected:
+    bool processArgs();
+
+    int doExecute();
+
+private:
+    std::string cacheSubdirectory() const;
+
+    bool command(const std::string& line, TileViewer& viewer, const TileCache& cache);
+
+    void show(TileViewer& viewer);
+
+    void clampPosition(TileViewer& viewer);
+
+private:
+    std::string inputFile_;
+    std::string fontFile_;
+    std::string algorithm_;
+    unsigned cols_;
+    unsigned rows_;
+    unsigned tileCols_;
+    unsigned tileRows_;
+    unsigned cacheSize_;
+    std::string cacheDir_;
+    unsigned threadCount_;
+    bool sync_;
+    unsigned level_;
+    unsigned row_;
+    unsigned col_;
+    TextSurface screen_;
+};
+
+int main(int argc, char* argv[])
+{
+    return AsciiView().execute(argc, argv);
+}
+
+
+AsciiView::AsciiView()
+    :CmdlineTool("Options")
+    ,level_(0)
+    ,row_(0)
+    ,col_(0)
+{
+    using namespace boost::program_options;
+    desc_.add_options()
+        ("input-file,i", value(&inputFile_), "input image file")
+        ("font-file,f", value(&fontFile_), "font file")
+        ("algorithm,a", value(&algorithm_)->default_value("pca"), "glyph matching algorithm")
+        ("cols,c", value(&cols_)->default_value(79), "number of text columns of the view")
+        ("rows,r", value(&rows_)->default_value(24), "number of text rows of the view")
+        ("tile-cols", value(&tileCols_)->default_value(32), "number of text columns of a tile")
+        ("tile-rows", value(&tileRows_)->default_value(16), "number of text rows of a tile")
+        ("cache-size", value(&cacheSize_)->default_value(1024), "number of tiles kept in memory")
+        ("cache-dir", value(&cacheDir_), "directory keeping converted tiles between runs")
+        ("threads", value(&threadCount_)->default_value(0), "worker thread count")
+        ("sync", bool_switch(&sync_), "wait for missing tiles before showing a view")
+    ;
+    posDesc_.add("input-file", 1);
+    posDesc_.add("font-file", 1);
+}
+
+bool AsciiView::processArgs()
+{
+    requireOption("input-file");
+    requireOption("font-file");
+    requireOption("algorithm");
+    if (cols_ == 0 || rows_ == 0)
+        throw std::logic_error("empty view");
+    if (tileCols_ == 0 || tileRows_ == 0)
+        throw std::logic_error("empty tiles");
+    return true;
+}
+
+int AsciiView::doExecute()
+{
+    std::cerr << "loading font...\n";
+    boost::shared_ptr<FontT> font(new FontT);
+    if (!font->load(fontFile_))
+        return -1;
+
+    std::cerr << "creating glyph matcher...\n";
+    registerGlyphMatcherFactories<FontImageT>();
+    boost::shared_ptr<FontImageT> font_image(new FontImageT(font));
+    boost::shared_ptr<const TileViewer::DynamicGlyphMatcherT> matcher = GlyphMatcherFactory::create(font_image, algorithm_);
+
+    std::cerr << "loading image...\n";
+    //the coarsest level fits into a single tile
+    ImagePyramid pyramid(inputFile_, tileCols_ * font->glyphWidth(), tileRows_ * font->glyphHeight());
+
+    std::string disk_dir;
+    if (!cacheDir_.empty()) {
+        disk_dir = (boost::filesystem::path(cacheDir_) / cacheSubdirectory()).string();
+    }
+    TileCache cache(cacheSize_, disk_dir);
+    TileViewer viewer(pyramid, matcher, cache, tileRows_, tileCols_, threadCount_);
+    screen_.resize(rows_, cols_);
+
+    std::cout << "pyramid levels " << viewer.levelCount() << "\n";
+    for (unsigned i = 0; i < viewer.levelCount(); ++i) {
+        std::cout << "level " << i << " columns " << viewer.levelCols(i) << " rows " << viewer.levelRows(i) << "\n";
+    }
+
+    show(viewer);
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        try {
+            if (!command(line, viewer, cache))
+                break;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+        }
+    }
+    return 0;
+}
+
+std::string AsciiView::cacheSubdirectory() const
+{
+    namespace fs = boost::filesystem;
+
+    //tiles are only reused for the same file contents (as far as size and
+    //modification time tell), font, algorithm and tile size
+    std::ostringstream key;
+    key << fs::absolute(inputFile_).string() << "\n"
+        << fs::file_size(inputFile_) << "\n"
+        << fs::last_write_time(inputFile_) << "\n"
+        << fs::absolute(fontFile_).string() << "\n"
+        << fs::last_write_time(fontFile_) << "\n"
+        << algorithm_ << "\n"
+        << tileCols_ << "x" << tileRows_;
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << KG::Util::fnv1aHash(key.str());
+    return name.str();
+}
+
+// Commands, one per line:
+//   left|right|up|down [N]  pan by N cells (half of the view by default)
+//   in|out                  zoom keeping the center of the view
+//   goto ROW COL            move the top left corner of the view
+//   show                    redraw the view
+//   wait                    wait for the missing tiles and redraw
+//   stats                   print cache statistics
+//   quit
+bool AsciiView::command(const std::string& line, TileViewer& viewer, const TileCache& cache)
+{
+    std::istringstream sin(line);
+    std::string cmd;
+    if (!(sin >> cmd))
+        return true;
+
+    if (cmd == "quit" || cmd == "q")
+        return false;
+
+    if (cmd == "left" || cmd == "right" || cmd == "up" || cmd == "down") {
+        bool horizontal = cmd == "left" || cmd == "right";
+        unsigned n = horizontal ? cols_ / 2 : rows_ / 2;
+        if (!(sin >> n) && !sin.eof())
+            throw std::runtime_error("invalid distance");
+        unsigned& pos = horizontal ? col_ : row_;
+        if (cmd == "left" || cmd == "up") {
+            pos -= std::min(pos, n);
+        } else {
+            pos += n;
+        }
+    } else if (cmd == "in") {
+        if (level_ == 0)
+            throw std::runtime_error("already at full resolution");
+        level_--;
+        row_ = 2 * row_ + rows_ / 2;
+        col_ = 2 * col_ + cols_ / 2;
+    } else if (cmd == "out") {
+        if (level_ + 1 >= viewer.levelCount())
+            throw std::runtime_error("already at the coarsest level");
+        level_++;
+        row_ = (row_ + rows_ / 2) / 2;
+        col_ = (col_ + cols_ / 2) / 2;
+        row_ -= std::min(row_, rows_ / 2);
+        col_ -= std::min(col_, cols_ / 2);
+    } else if (cmd == "goto") {
+        if (!(sin >> row_ >> col_))
+            throw std::runtime_error("expected goto ROW COL");
+    } else if (cmd == "wait") {
+        viewer.waitIdle();
+    } else if (cmd == "stats") {
+        std::cout << "converted tiles " << viewer.convertedTiles() << "\n";
+        std::cout << "pending tiles " << viewer.pendingTiles() << "\n";
+        std::cout << "cached tiles " << cache.size() << "/" << cache.capacity() << "\n";
+        std::cout << "memory hits " << cache.memoryHits() << "\n";
+        std::cout << "disk hits " << cache.diskHits() << "\n";
+        std::cout << "misses " << cache.misses() << "\n";
+        return true;
+    } else if (cmd != "show") {
+        throw std::runtime_error("unknown command " + cmd);
+    }
+
+    clampPosition(viewer);
+    show(viewer);
+    return true;
+}
+
+void AsciiView::show(TileViewer& viewer)
+{
+    unsigned missing = viewer.render(level_, row_, col_, screen_);
+    if (missing > 0 && sync_) {
+        viewer.waitIdle();
+        missing = viewer.render(level_, row_, col_, screen_);
+    }
+    for (unsigned r = 0; r < screen_.rows(); ++r) {
+        for (unsigned c = 0; c < screen_.cols(); ++c)
+            std::cout.put(screen_(r, c).charValue());
+        std::cout.put('\n');
+    }
+    std::cout << "level " << level_ << " row " << row_ << " col " << col_ 
+        << " missing tiles " << missing << std::endl;
+}
+
+void AsciiView::clampPosition(TileViewer& viewer)
+{
+    unsigned level_rows = viewer.levelRows(level_);
+    unsigned level_cols = viewer.levelCols(level_);
+    row_ = std::min(row_, level_rows > rows_ ? level_rows - rows_ : 0);
+    col_ = std::min(col_, level_cols > cols_ ? level_cols - cols_ : 0);
+}
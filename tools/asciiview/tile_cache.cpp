@@ -0,0 +1,215 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include "tile_cache.hpp"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cstring>
+#include <boost/cstdint.hpp>
+#include <boost/filesystem.hpp>
+
+using KG::Ascii::TextSurface;
+using KG::Ascii::Symbol;
+
+namespace {
+
+// Disk tiles are a header followed by rows * cols characters, row by row,
+// in host byte order. Any byte is a valid character, '\n' included.
+const char TILE_FILE_MAGIC[4] = { 'K', 'G', 'T', 'L' };
+const boost::uint32_t TILE_FILE_VERSION = 1;
+
+struct TileFileHeader
+{
+    char magic[4];
+    boost::uint32_t version;
+    boost::uint32_t rows;
+    boost::uint32_t cols;
+};
+
+} // namespace
+
+TileCache::TileCache(size_t capacity, const std::string& disk_dir)
+    :capacity_(std::max<size_t>(capacity, 1))
+    ,diskDir_(disk_dir)
+    ,memoryHits_(0)
+    ,diskHits_(0)
+    ,misses_(0)
+{
+    if (!diskDir_.empty()) {
+        boost::filesystem::create_directories(diskDir_);
+    }
+}
+
+TileCache::TilePtrT TileCache::find(const TileKey& key)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        TileMapT::iterator it = tiles_.find(key);
+        if (it != tiles_.end()) {
+            usage_.splice(usage_.begin(), usage_, it->second.second);
+            memoryHits_++;
+            return it->second.first;
+        }
+    }
+
+    //the file is read without holding the lock
+    TilePtrT tile;
+    if (!diskDir_.empty()) {
+        tile = readTile(key);
+    }
+
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    if (tile) {
+        diskHits_++;
+        store(key, tile);
+    } else {
+        misses_++;
+    }
+    return tile;
+}
+
+void TileCache::insert(const TileKey& key, TilePtrT tile)
+{
+    if (!diskDir_.empty()) {
+        writeTile(key, *tile);
+    }
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    store(key, tile);
+}
+
+size_t TileCache::capacity() const
+{
+    return capacity_;
+}
+
+size_t TileCache::size() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    return tiles_.size();
+}
+
+size_t TileCache::memoryHits() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    return memoryHits_;
+}
+
+size_t TileCache::diskHits() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    return diskHits_;
+}
+
+size_t TileCache::misses() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    return misses_;
+}
+
+void TileCache::store(const TileKey& key, TilePtrT tile)
+{
+    TileMapT::iterator it = tiles_.find(key);
+    if (it != tiles_.end()) {
+        it->second.first = tile;
+        usage_.splice(usage_.begin(), usage_, it->second.second);
+        return;
+    }
+    while (tiles_.size() >= capacity_) {
+        tiles_.erase(usage_.back());
+        usage_.pop_back();
+    }
+    usage_.push_front(key);
+    tiles_.insert(std::make_pair(key, std::make_pair(tile, usage_.begin())));
+}
+
+std::string TileCache::tilePath(const TileKey& key) const
+{
+    std::ostringstream name;
+    name << key.level << "_" << key.row << "_" << key.col << ".tile";
+    return (boost::filesystem::path(diskDir_) / name.str()).string();
+}
+
+TileCache::TilePtrT TileCache::readTile(const TileKey& key) const
+{
+    std::ifstream fin(tilePath(key).c_str(), std::ios::in | std::ios::binary);
+    if (!fin)
+        return TilePtrT();
+
+    TileFileHeader hdr;
+    if (!fin.read(reinterpret_cast<char*>(&hdr), sizeof(hdr)))
+        return TilePtrT();
+    if (std::memcmp(hdr.magic, TILE_FILE_MAGIC, sizeof(TILE_FILE_MAGIC)) != 0 || hdr.version != TILE_FILE_VERSION)
+        return TilePtrT();
+
+    //the size is checked against the file before anything is allocated
+    fin.seekg(0, std::ios::end);
+    boost::uint64_t data_size = static_cast<boost::uint64_t>(fin.tellg()) - sizeof(hdr);
+    if (hdr.rows == 0 || hdr.cols == 0 || static_cast<boost::uint64_t>(hdr.rows) * hdr.cols != data_size)
+        return TilePtrT();
+    fin.seekg(sizeof(hdr), std::ios::beg);
+
+    std::vector<char> data(data_size);
+    if (!fin.read(&data[0], data.size()))
+        return TilePtrT();
+
+    boost::shared_ptr<TextSurface> tile(new TextSurface(hdr.rows, hdr.cols));
+    for (size_t r = 0; r < hdr.rows; ++r) {
+        for (size_t c = 0; c < hdr.cols; ++c) {
+            (*tile)(r, c) = Symbol(static_cast<unsigned char>(data[r * hdr.cols + c]));
+        }
+    }
+    return tile;
+}
+
+void TileCache::writeTile(const TileKey& key, const TextSurface& tile) const
+{
+    namespace fs = boost::filesystem;
+
+    TileFileHeader hdr;
+    std::memcpy(hdr.magic, TILE_FILE_MAGIC, sizeof(TILE_FILE_MAGIC));
+    hdr.version = TILE_FILE_VERSION;
+    hdr.rows = tile.rows();
+    hdr.cols = tile.cols();
+
+    std::vector<char> data(static_cast<size_t>(tile.rows()) * tile.cols());
+    for (size_t r = 0; r < tile.rows(); ++r) {
+        for (size_t c = 0; c < tile.cols(); ++c)
+            data[r * tile.cols() + c] = tile(r, c).charValue();
+    }
+
+    //written under a temporary name first, so that other viewers sharing
+    //the directory never see a partial tile
+    std::string path = tilePath(key);
+    std::ostringstream temp_path;
+    temp_path << path << "." << boost::this_thread::get_id() << ".tmp";
+    {
+        std::ofstream fout(temp_path.str().c_str(), std::ios::out | std::ios::binary);
+        fout.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+        if (!data.empty()) {
+            fout.write(&data[0], data.size());
+        }
+        if (!fout)
+            return;
+    }
+    boost::system::error_code ec;
+    fs::rename(temp_path.str(), path, ec);
+    if (ec) {
+        fs::remove(temp_path.str(), ec);
+    }
+}
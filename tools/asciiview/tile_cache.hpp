@@ -0,0 +1,108 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_TOOLS_ASCIIVIEW_TILE_CACHE_HPP
+#define KGASCII_TOOLS_ASCIIVIEW_TILE_CACHE_HPP
+
+#include <string>
+#include <list>
+#include <map>
+#include <cstddef>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <kgascii/text_surface.hpp>
+
+
+struct TileKey
+{
+    TileKey(unsigned lvl, unsigned r, unsigned c)
+        :level(lvl)
+        ,row(r)
+        ,col(c)
+    {
+    }
+
+    bool operator<(const TileKey& other) const
+    {
+        if (level != other.level)
+            return level < other.level;
+        if (row != other.row)
+            return row < other.row;
+        return col < other.col;
+    }
+
+    unsigned level;
+    unsigned row;
+    unsigned col;
+};
+
+// Converted tiles, kept in memory up to the given count with the least
+// recently used ones dropped first. With a disk directory set, every
+// inserted tile is also written there and tiles missing in memory are
+// looked up on disk before they count as a miss.
+// Thread safe.
+class TileCache: boost::noncopyable
+{
+public:
+    typedef boost::shared_ptr<const KG::Ascii::TextSurface> TilePtrT;
+
+public:
+    explicit TileCache(size_t capacity, const std::string& disk_dir=std::string());
+
+public:
+    // Null if the tile is neither in memory nor on disk.
+    TilePtrT find(const TileKey& key);
+
+    void insert(const TileKey& key, TilePtrT tile);
+
+public:
+    size_t capacity() const;
+
+    size_t size() const;
+
+    size_t memoryHits() const;
+
+    size_t diskHits() const;
+
+    size_t misses() const;
+
+private:
+    void store(const TileKey& key, TilePtrT tile);
+
+    std::string tilePath(const TileKey& key) const;
+
+    TilePtrT readTile(const TileKey& key) const;
+
+    void writeTile(const TileKey& key, const KG::Ascii::TextSurface& tile) const;
+
+private:
+    typedef std::list<TileKey> UsageListT;
+    typedef std::map<TileKey, std::pair<TilePtrT, UsageListT::iterator> > TileMapT;
+
+    size_t capacity_;
+    std::string diskDir_;
+    mutable boost::mutex mutex_;
+    //most recently used first
+    UsageListT usage_;
+    TileMapT tiles_;
+    size_t memoryHits_;
+    size_t diskHits_;
+    size_t misses_;
+};
+
+#endif // KGASCII_TOOLS_ASCIIVIEW_TILE_CACHE_HPP
@@ -0,0 +1,221 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include "tile_viewer.hpp"
+#include <set>
+#include <vector>
+#include <algorithm>
+#include <boost/bind.hpp>
+
+using namespace KG::Ascii;
+
+TileViewer::TileViewer(const ImagePyramid& pyramid, boost::shared_ptr<const DynamicGlyphMatcherT> matcher,
+        TileCache& cache, unsigned tile_rows, unsigned tile_cols, unsigned thr_cnt)
+    :pyramid_(pyramid)
+    ,cache_(cache)
+    ,tileRows_(std::max(tile_rows, 1u))
+    ,tileCols_(std::max(tile_cols, 1u))
+    ,cellWidth_(matcher->cellWidth())
+    ,cellHeight_(matcher->cellHeight())
+    ,nextId_(0)
+    ,converted_(0)
+    ,asciifier_(new AsciifierT(matcher, thr_cnt))
+{
+}
+
+TileViewer::~TileViewer()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        for (PendingMapT::iterator it = pending_.begin(); it != pending_.end(); ++it) {
+            if (it->second.future.valid()) {
+                it->second.future.cancel();
+            }
+        }
+    }
+    waitIdle();
+}
+
+unsigned TileViewer::levelCount() const
+{
+    return pyramid_.levelCount();
+}
+
+unsigned TileViewer::levelRows(unsigned lvl) const
+{
+    return (pyramid_.level(lvl).height() + cellHeight_ - 1) / cellHeight_;
+}
+
+unsigned TileViewer::levelCols(unsigned lvl) const
+{
+    return (pyramid_.level(lvl).width() + cellWidth_ - 1) / cellWidth_;
+}
+
+unsigned TileViewer::render(unsigned lvl, unsigned row, unsigned col, TextSurface& screen)
+{
+    unsigned level_rows = levelRows(lvl);
+    unsigned level_cols = levelCols(lvl);
+    for (unsigned r = 0; r < screen.rows(); ++r) {
+        std::fill(screen.row(r), screen.row(r) + screen.cols(), Symbol(' '));
+    }
+
+    TileMemoT memo;
+    std::set<TileKey> visible;
+    unsigned missing = 0;
+    unsigned end_row = std::min(level_rows, row + screen.rows());
+    unsigned end_col = std::min(level_cols, col + screen.cols());
+    for (unsigned tr = row / tileRows_; tr * tileRows_ < end_row; ++tr) {
+        for (unsigned tc = col / tileCols_; tc * tileCols_ < end_col; ++tc) {
+            TileKey key(lvl, tr, tc);
+            visible.insert(key);
+            TileCache::TilePtrT tile = findTile(key, memo);
+            if (!tile) {
+                requestTile(key);
+                missing++;
+            }
+            //visible part of the tile in level coordinates
+            unsigned r0 = std::max(row, tr * tileRows_);
+            unsigned c0 = std::max(col, tc * tileCols_);
+            unsigned r1 = std::min(end_row, (tr + 1) * tileRows_);
+            unsigned c1 = std::min(end_col, (tc + 1) * tileCols_);
+            for (unsigned r = r0; r < r1; ++r) {
+                Symbol* outp = screen.row(r - row);
+                if (tile) {
+                    const Symbol* inp = tile->row(r - tr * tileRows_);
+                    std::copy(inp + (c0 - tc * tileCols_), inp + (c1 - tc * tileCols_), outp + (c0 - col));
+                } else {
+                    for (unsigned c = c0; c < c1; ++c) {
+                        outp[c - col] = fallbackSymbol(lvl, r, c, memo);
+                    }
+                }
+            }
+        }
+    }
+
+    //tiles scrolled out of view are not worth finishing
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    for (PendingMapT::iterator it = pending_.begin(); it != pending_.end(); ++it) {
+        if (it->second.future.valid() && !visible.count(it->first)) {
+            it->second.future.cancel();
+        }
+    }
+    return missing;
+}
+
+void TileViewer::waitIdle()
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    while (!pending_.empty()) {
+        idleCondition_.wait(lock);
+    }
+}
+
+size_t TileViewer::pendingTiles() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    return pending_.size();
+}
+
+size_t TileViewer::convertedTiles() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    return converted_;
+}
+
+TileCache::TilePtrT TileViewer::findTile(const TileKey& key, TileMemoT& memo)
+{
+    TileMemoT::iterator it = memo.find(key);
+    if (it == memo.end()) {
+        it = memo.insert(std::make_pair(key, cache_.find(key))).first;
+    }
+    return it->second;
+}
+
+void TileViewer::requestTile(const TileKey& key)
+{
+    unsigned id;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        PendingMapT::iterator it = pending_.find(key);
+        if (it != pending_.end()) {
+            //a cancelled conversion cannot be resumed, it is requested again
+            //once its callback has run
+            return;
+        }
+        id = nextId_++;
+        PendingTile pt = { id, GenerateFuture() };
+        pending_.insert(std::make_pair(key, pt));
+    }
+
+    ImagePyramid::ViewT level = pyramid_.level(key.level);
+    unsigned x = key.col * tileCols_ * cellWidth_;
+    unsigned y = key.row * tileRows_ * cellHeight_;
+    unsigned w = std::min<unsigned>(tileCols_ * cellWidth_, level.width() - x);
+    unsigned h = std::min<unsigned>(tileRows_ * cellHeight_, level.height() - y);
+    boost::shared_ptr<TextSurface> tile(new TextSurface(
+            (h + cellHeight_ - 1) / cellHeight_, (w + cellWidth_ - 1) / cellWidth_));
+
+    //the callback may run before generateAsync() returns, so the lock
+    //cannot be held while submitting
+    GenerateFuture future = asciifier_->generateAsync(subimage_view(level, x, y, w, h), *tile,
+            boost::bind(&TileViewer::tileDone, this, key, id, tile, _1));
+
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    PendingMapT::iterator it = pending_.find(key);
+    if (it != pending_.end() && it->second.id == id) {
+        it->second.future = future;
+    }
+}
+
+void TileViewer::tileDone(const TileKey& key, unsigned id, boost::shared_ptr<TextSurface> tile, bool completed)
+{
+    if (completed) {
+        cache_.insert(key, tile);
+    }
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    PendingMapT::iterator it = pending_.find(key);
+    if (it != pending_.end() && it->second.id == id) {
+        pending_.erase(it);
+    }
+    if (completed) {
+        converted_++;
+    }
+    if (pending_.empty()) {
+        idleCondition_.notify_all();
+    }
+}
+
+Symbol TileViewer::fallbackSymbol(unsigned lvl, unsigned grow, unsigned gcol, TileMemoT& memo)
+{
+    //every cell of the coarser level covers four cells of this one
+    if (lvl + 1 < levelCount()) {
+        unsigned r = grow / 2;
+        unsigned c = gcol / 2;
+        TileCache::TilePtrT tile = findTile(TileKey(lvl + 1, r / tileRows_, c / tileCols_), memo);
+        if (tile && r % tileRows_ < tile->rows() && c % tileCols_ < tile->cols())
+            return (*tile)(r % tileRows_, c % tileCols_);
+    }
+    //a finer level has four cells for every one, the top left one is used
+    if (lvl > 0) {
+        unsigned r = grow * 2;
+        unsigned c = gcol * 2;
+        TileCache::TilePtrT tile = findTile(TileKey(lvl - 1, r / tileRows_, c / tileCols_), memo);
+        if (tile && r % tileRows_ < tile->rows() && c % tileCols_ < tile->cols())
+            return (*tile)(r % tileRows_, c % tileCols_);
+    }
+    return Symbol(' ');
+}
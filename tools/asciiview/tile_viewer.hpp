@@ -0,0 +1,108 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_TOOLS_ASCIIVIEW_TILE_VIEWER_HPP
+#define KGASCII_TOOLS_ASCIIVIEW_TILE_VIEWER_HPP
+
+#include <map>
+#include <cstddef>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <kgascii/font.hpp>
+#include <kgascii/font_image.hpp>
+#include <kgascii/dynamic_glyph_matcher.hpp>
+#include <kgascii/parallel_asciifier.hpp>
+#include <kgascii/text_surface.hpp>
+#include "image_pyramid.hpp"
+#include "tile_cache.hpp"
+
+
+// Renders views of an image pyramid from fixed size text tiles.
+// Tiles missing in the cache are converted in the background; until they
+// are ready their cells are filled from tiles of the adjacent levels that
+// happen to be cached, coarser ones first.
+class TileViewer: boost::noncopyable
+{
+public:
+    typedef KG::Ascii::Font<> FontT;
+    typedef KG::Ascii::FontImage<FontT> FontImageT;
+    typedef KG::Ascii::DynamicGlyphMatcher<FontImageT> DynamicGlyphMatcherT;
+    typedef KG::Ascii::ParallelAsciifier<DynamicGlyphMatcherT> AsciifierT;
+
+public:
+    TileViewer(const ImagePyramid& pyramid, boost::shared_ptr<const DynamicGlyphMatcherT> matcher,
+            TileCache& cache, unsigned tile_rows, unsigned tile_cols, unsigned thr_cnt);
+
+    ~TileViewer();
+
+public:
+    unsigned levelCount() const;
+
+    // Size of the whole level in text cells.
+    unsigned levelRows(unsigned lvl) const;
+
+    unsigned levelCols(unsigned lvl) const;
+
+    // Fills the screen with the text of the level starting at the given
+    // cell and returns the number of visible tiles that are not ready yet.
+    // Conversions of tiles that went out of view are cancelled.
+    unsigned render(unsigned lvl, unsigned row, unsigned col, KG::Ascii::TextSurface& screen);
+
+    // Waits until all requested tiles are converted or cancelled.
+    void waitIdle();
+
+public:
+    size_t pendingTiles() const;
+
+    size_t convertedTiles() const;
+
+private:
+    typedef std::map<TileKey, TileCache::TilePtrT> TileMemoT;
+
+    TileCache::TilePtrT findTile(const TileKey& key, TileMemoT& memo);
+
+    void requestTile(const TileKey& key);
+
+    void tileDone(const TileKey& key, unsigned id, boost::shared_ptr<KG::Ascii::TextSurface> tile, bool completed);
+
+    KG::Ascii::Symbol fallbackSymbol(unsigned lvl, unsigned grow, unsigned gcol, TileMemoT& memo);
+
+private:
+    struct PendingTile
+    {
+        unsigned id;
+        KG::Ascii::GenerateFuture future;
+    };
+    typedef std::map<TileKey, PendingTile> PendingMapT;
+
+    const ImagePyramid& pyramid_;
+    TileCache& cache_;
+    unsigned tileRows_;
+    unsigned tileCols_;
+    unsigned cellWidth_;
+    unsigned cellHeight_;
+    mutable boost::mutex mutex_;
+    boost::condition_variable idleCondition_;
+    PendingMapT pending_;
+    unsigned nextId_;
+    size_t converted_;
+    //destroyed first, its workers call back into the members above
+    boost::shared_ptr<AsciifierT> asciifier_;
+};
+
+#endif // KGASCII_TOOLS_ASCIIVIEW_TILE_VIEWER_HPP
@@ -0,0 +1,32 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include "ascii_client.hpp"
+
+AsciiClient::AsciiClient(const std::string& socket_path)
+    :socket_(io_)
+{
+    socket_.connect(boost::asio::local::stream_protocol::endpoint(socket_path));
+}
+
+void AsciiClient::convert(const AsciiProtocol::Request& req, AsciiProtocol::Response& resp)
+{
+    AsciiProtocol::encodeRequest(req, buffer_);
+    AsciiProtocol::writeFrame(socket_, buffer_);
+    AsciiProtocol::readFrame(socket_, buffer_);
+    AsciiProtocol::decodeResponse(buffer_, resp);
+}
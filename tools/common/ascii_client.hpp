@@ -0,0 +1,41 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_TOOLS_COMMON_ASCII_CLIENT_HPP
+#define KGASCII_TOOLS_COMMON_ASCII_CLIENT_HPP
+
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/asio.hpp>
+#include "ascii_protocol.hpp"
+
+// Blocking kgasciid client, one connection reused for many requests.
+class AsciiClient: boost::noncopyable
+{
+public:
+    explicit AsciiClient(const std::string& socket_path);
+
+    void convert(const AsciiProtocol::Request& req, AsciiProtocol::Response& resp);
+
+private:
+    boost::asio::io_service io_;
+    boost::asio::local::stream_protocol::socket socket_;
+    std::vector<char> buffer_;
+};
+
+#endif // KGASCII_TOOLS_COMMON_ASCII_CLIENT_HPP
@@ -0,0 +1,211 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include "ascii_protocol.hpp"
+#include <algorithm>
+#include <cassert>
+#include <boost/format.hpp>
+
+namespace AsciiProtocol {
+
+namespace {
+
+const char REQUEST_MAGIC[] = { 'K', 'G', 'Q', static_cast<char>(VERSION) };
+const char RESPONSE_MAGIC[] = { 'K', 'G', 'R', static_cast<char>(VERSION) };
+
+void encodeUint(unsigned value, char* bytes)
+{
+    bytes[0] = static_cast<char>((value >> 24) & 0xff);
+    bytes[1] = static_cast<char>((value >> 16) & 0xff);
+    bytes[2] = static_cast<char>((value >> 8) & 0xff);
+    bytes[3] = static_cast<char>(value & 0xff);
+}
+
+unsigned decodeUint(const char* bytes)
+{
+    const unsigned char* ubytes = reinterpret_cast<const unsigned char*>(bytes);
+    return (static_cast<unsigned>(ubytes[0]) << 24) | (static_cast<unsigned>(ubytes[1]) << 16)
+         | (static_cast<unsigned>(ubytes[2]) << 8) | static_cast<unsigned>(ubytes[3]);
+}
+
+} // namespace
+
+MessageWriter::MessageWriter(std::vector<char>& buf)
+    :buf_(buf)
+{
+    buf_.clear();
+}
+
+void MessageWriter::putBytes(const char* data, size_t size)
+{
+    buf_.insert(buf_.end(), data, data + size);
+}
+
+void MessageWriter::putUint(unsigned value)
+{
+    char bytes[4];
+    encodeUint(value, bytes);
+    putBytes(bytes, 4);
+}
+
+void MessageWriter::putString(const std::string& value)
+{
+    putUint(value.size());
+    putBytes(value.data(), value.size());
+}
+
+MessageReader::MessageReader(const std::vector<char>& buf)
+    :buf_(buf)
+    ,pos_(0)
+{
+}
+
+const char* MessageReader::getBytes(size_t size)
+{
+    if (buf_.size() - pos_ < size)
+        throw ProtocolError("truncated message");
+    const char* data = buf_.empty() ? 0 : &buf_[0] + pos_;
+    pos_ += size;
+    return data;
+}
+
+unsigned MessageReader::getUint()
+{
+    return decodeUint(getBytes(4));
+}
+
+std::string MessageReader::getString()
+{
+    size_t size = getUint();
+    const char* data = getBytes(size);
+    return std::string(data, data + size);
+}
+
+void MessageReader::getMagic(const char* magic)
+{
+    if (!std::equal(magic, magic + 4, getBytes(4)))
+        throw ProtocolError("bad message magic or version");
+}
+
+void MessageReader::finish() const
+{
+    if (pos_ != buf_.size())
+        throw ProtocolError("trailing bytes in message");
+}
+
+Request::Request()
+    :cols(0)
+    ,rows(0)
+    ,format(ENCODED_IMAGE)
+    ,width(0)
+    ,height(0)
+{
+}
+
+Response::Response()
+    :ok(false)
+    ,cols(0)
+    ,rows(0)
+{
+}
+
+void encodeRequest(const Request& req, std::vector<char>& payload)
+{
+    MessageWriter wr(payload);
+    wr.putBytes(REQUEST_MAGIC, 4);
+    wr.putString(req.font_file);
+    wr.putString(req.algorithm);
+    wr.putUint(req.cols);
+    wr.putUint(req.rows);
+    wr.putUint(req.format);
+    wr.putUint(req.width);
+    wr.putUint(req.height);
+    wr.putUint(req.data.size());
+    if (!req.data.empty()) {
+        wr.putBytes(&req.data[0], req.data.size());
+    }
+}
+
+void decodeRequest(const std::vector<char>& payload, Request& req)
+{
+    MessageReader rd(payload);
+    rd.getMagic(REQUEST_MAGIC);
+    req.font_file = rd.getString();
+    req.algorithm = rd.getString();
+    req.cols = rd.getUint();
+    req.rows = rd.getUint();
+    req.format = rd.getUint();
+    req.width = rd.getUint();
+    req.height = rd.getUint();
+    size_t data_size = rd.getUint();
+
+    //the image is checked before anything is allocated for it; each side
+    //is bounded first, so that the product can not wrap
+    if (req.format != ENCODED_IMAGE && req.format != RAW_GRAY8)
+        throw ProtocolError("unknown image format");
+    if (req.format == RAW_GRAY8) {
+        if (req.width > MAX_IMAGE_SIDE || req.height > MAX_IMAGE_SIDE)
+            throw ProtocolError("raw image too large");
+        if (static_cast<size_t>(req.width) * req.height != data_size)
+            throw ProtocolError("raw image size mismatch");
+    }
+
+    const char* data = rd.getBytes(data_size);
+    req.data.assign(data, data + data_size);
+    rd.finish();
+}
+
+void encodeResponse(const Response& resp, std::vector<char>& payload)
+{
+    MessageWriter wr(payload);
+    wr.putBytes(RESPONSE_MAGIC, 4);
+    wr.putUint(resp.ok ? 1 : 0);
+    wr.putString(resp.error);
+    wr.putUint(resp.cols);
+    wr.putUint(resp.rows);
+    wr.putString(resp.text);
+}
+
+void decodeResponse(const std::vector<char>& payload, Response& resp)
+{
+    MessageReader rd(payload);
+    rd.getMagic(RESPONSE_MAGIC);
+    resp.ok = rd.getUint() != 0;
+    resp.error = rd.getString();
+    resp.cols = rd.getUint();
+    resp.rows = rd.getUint();
+    resp.text = rd.getString();
+    rd.finish();
+}
+
+void encodeHeader(size_t payload_size, char* header)
+{
+    assert(payload_size <= MAX_PAYLOAD_SIZE);
+    encodeUint(static_cast<unsigned>(payload_size), header);
+}
+
+size_t decodeHeader(const char* header)
+{
+    size_t size = decodeUint(header);
+    if (size > MAX_PAYLOAD_SIZE) {
+        boost::format fmt_err("message too large (%1% bytes)");
+        throw ProtocolError(str(fmt_err % size));
+    }
+    return size;
+}
+
+} // namespace AsciiProtocol
@@ -0,0 +1,156 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_TOOLS_COMMON_ASCII_PROTOCOL_HPP
+#define KGASCII_TOOLS_COMMON_ASCII_PROTOCOL_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+#include <boost/asio.hpp>
+
+// Framed request/response protocol spoken by kgasciid.
+// Every message is a 4 byte big endian payload length followed by the
+// payload. Integers inside the payload are 4 byte big endian, strings and
+// byte blocks are prefixed with their length.
+namespace AsciiProtocol {
+
+const unsigned VERSION = 1;
+const size_t HEADER_SIZE = 4;
+const size_t MAX_PAYLOAD_SIZE = 64 << 20;
+// larger RAW_GRAY8 images are rejected
+const unsigned MAX_IMAGE_SIDE = 16384;
+
+enum ImageFormat
+{
+    // any image file format understood by the server
+    ENCODED_IMAGE = 0,
+    // width * height bytes, no row padding
+    RAW_GRAY8 = 1
+};
+
+struct Request
+{
+    Request();
+
+    // empty values select server defaults
+    std::string font_file;
+    std::string algorithm;
+    // suggested text size, the image aspect ratio is kept
+    unsigned cols;
+    unsigned rows;
+    unsigned format;
+    // RAW_GRAY8 only
+    unsigned width;
+    unsigned height;
+    std::vector<char> data;
+};
+
+struct Response
+{
+    Response();
+
+    bool ok;
+    std::string error;
+    unsigned cols;
+    unsigned rows;
+    // rows lines, each terminated with '\n'
+    std::string text;
+};
+
+class ProtocolError: public std::runtime_error
+{
+public:
+    explicit ProtocolError(const std::string& msg)
+        :std::runtime_error(msg)
+    {
+    }
+};
+
+// Helpers for building and parsing payloads, also used by other
+// protocols sharing the same framing.
+class MessageWriter
+{
+public:
+    explicit MessageWriter(std::vector<char>& buf);
+
+    void putBytes(const char* data, size_t size);
+
+    void putUint(unsigned value);
+
+    void putString(const std::string& value);
+
+private:
+    std::vector<char>& buf_;
+};
+
+class MessageReader
+{
+public:
+    explicit MessageReader(const std::vector<char>& buf);
+
+    const char* getBytes(size_t size);
+
+    unsigned getUint();
+
+    std::string getString();
+
+    // Throws ProtocolError unless the next 4 bytes equal magic.
+    void getMagic(const char* magic);
+
+    // Throws ProtocolError unless the whole payload was consumed.
+    void finish() const;
+
+private:
+    const std::vector<char>& buf_;
+    size_t pos_;
+};
+
+void encodeRequest(const Request& req, std::vector<char>& payload);
+
+void decodeRequest(const std::vector<char>& payload, Request& req);
+
+void encodeResponse(const Response& resp, std::vector<char>& payload);
+
+void decodeResponse(const std::vector<char>& payload, Response& resp);
+
+void encodeHeader(size_t payload_size, char* header);
+
+size_t decodeHeader(const char* header);
+
+template<class TSyncStream>
+void writeFrame(TSyncStream& stream, const std::vector<char>& payload)
+{
+    char header[HEADER_SIZE];
+    encodeHeader(payload.size(), header);
+    boost::asio::write(stream, boost::asio::buffer(header, HEADER_SIZE));
+    boost::asio::write(stream, boost::asio::buffer(payload));
+}
+
+template<class TSyncStream>
+void readFrame(TSyncStream& stream, std::vector<char>& payload)
+{
+    char header[HEADER_SIZE];
+    boost::asio::read(stream, boost::asio::buffer(header, HEADER_SIZE));
+    payload.resize(decodeHeader(header));
+    boost::asio::read(stream, boost::asio::buffer(payload));
+}
+
+} // namespace AsciiProtocol
+
+#endif // KGASCII_TOOLS_COMMON_ASCII_PROTOCOL_HPP
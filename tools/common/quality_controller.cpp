@@ -0,0 +1,141 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include "quality_controller.hpp"
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace {
+
+//weight of the newest sample in the per-level cost average
+const double COST_SMOOTHING = 0.2;
+//cost ratio assumed between a level that was never measured and the next cheaper one
+const double UNKNOWN_COST_RATIO = 2.0;
+//frames of plentiful slack (in upgrade delays) after which old cost estimates are retried
+const unsigned PROBE_DELAY_FACTOR = 8;
+
+} // namespace
+
+QualityController::QualityController(unsigned level_cnt, unsigned upgrade_delay, double headroom)
+    :level_(0)
+    ,upgradeDelay_(upgrade_delay)
+    ,headroom_(headroom)
+    ,slackFrames_(0)
+    ,downgrades_(0)
+    ,upgrades_(0)
+    ,levelFrames_(level_cnt, 0)
+    ,levelCost_(level_cnt, -1.0)
+{
+    if (level_cnt == 0)
+        throw std::logic_error("no quality levels");
+}
+
+void QualityController::update(double frame_cost, double time_budget)
+{
+    double& cost = levelCost_[level_];
+    if (cost < 0) {
+        cost = frame_cost;
+    } else {
+        cost += COST_SMOOTHING * (frame_cost - cost);
+    }
+    levelFrames_[level_]++;
+
+    if (frame_cost > time_budget) {
+        if (level_ + 1 < levelCount()) {
+            changeLevel(level_ + 1);
+            downgrades_++;
+        }
+        slackFrames_ = 0;
+        return;
+    }
+
+    if (level_ == 0)
+        return;
+
+    if (estimateCost(level_ - 1) <= headroom_ * time_budget) {
+        slackFrames_++;
+        if (slackFrames_ >= upgradeDelay_) {
+            changeLevel(level_ - 1);
+            upgrades_++;
+        }
+    } else if (frame_cost <= headroom_ * time_budget / UNKNOWN_COST_RATIO) {
+        //the better level was too slow once, but conditions may have changed since
+        slackFrames_++;
+        if (slackFrames_ >= PROBE_DELAY_FACTOR * upgradeDelay_) {
+            levelCost_[level_ - 1] = -1.0;
+            slackFrames_ = 0;
+        }
+    } else {
+        slackFrames_ = 0;
+    }
+}
+
+void QualityController::reset()
+{
+    level_ = 0;
+    slackFrames_ = 0;
+    downgrades_ = 0;
+    upgrades_ = 0;
+    std::fill(levelFrames_.begin(), levelFrames_.end(), 0);
+    std::fill(levelCost_.begin(), levelCost_.end(), -1.0);
+}
+
+unsigned QualityController::levelCount() const
+{
+    return levelFrames_.size();
+}
+
+unsigned QualityController::level() const
+{
+    return level_;
+}
+
+unsigned QualityController::downgrades() const
+{
+    return downgrades_;
+}
+
+unsigned QualityController::upgrades() const
+{
+    return upgrades_;
+}
+
+unsigned QualityController::levelFrames(unsigned lvl) const
+{
+    return levelFrames_.at(lvl);
+}
+
+double QualityController::levelCost(unsigned lvl) const
+{
+    return levelCost_.at(lvl);
+}
+
+double QualityController::estimateCost(unsigned lvl) const
+{
+    if (levelCost_[lvl] >= 0)
+        return levelCost_[lvl];
+    assert(lvl + 1 < levelCount());
+    return estimateCost(lvl + 1) * UNKNOWN_COST_RATIO;
+}
+
+void QualityController::changeLevel(unsigned lvl)
+{
+    assert(lvl < levelCount());
+    level_ = lvl;
+    slackFrames_ = 0;
+}
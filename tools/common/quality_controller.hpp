@@ -0,0 +1,70 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_TOOLS_COMMON_QUALITY_CONTROLLER_HPP
+#define KGASCII_TOOLS_COMMON_QUALITY_CONTROLLER_HPP
+
+#include <vector>
+#include <boost/noncopyable.hpp>
+
+
+// Picks one of an ordered set of quality levels (0 = best, each next one
+// cheaper) based on the measured cost of every frame and the time left
+// until its deadline.
+// A missed deadline steps one level down immediately. Stepping back up
+// requires the cost of the better level to fit into the budget with some
+// headroom for a number of consecutive frames.
+class QualityController: boost::noncopyable
+{
+public:
+    explicit QualityController(unsigned level_cnt, unsigned upgrade_delay=24, double headroom=0.75);
+
+public:
+    void update(double frame_cost, double time_budget);
+
+    void reset();
+
+public:
+    unsigned levelCount() const;
+
+    unsigned level() const;
+
+    unsigned downgrades() const;
+
+    unsigned upgrades() const;
+
+    unsigned levelFrames(unsigned lvl) const;
+
+    double levelCost(unsigned lvl) const;
+
+private:
+    double estimateCost(unsigned lvl) const;
+
+    void changeLevel(unsigned lvl);
+
+private:
+    unsigned level_;
+    unsigned upgradeDelay_;
+    double headroom_;
+    unsigned slackFrames_;
+    unsigned downgrades_;
+    unsigned upgrades_;
+    std::vector<unsigned> levelFrames_;
+    std::vector<double> levelCost_;
+};
+
+#endif // KGASCII_TOOLS_COMMON_QUALITY_CONTROLLER_HPP
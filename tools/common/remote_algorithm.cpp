@@ -0,0 +1,72 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include "remote_algorithm.hpp"
+#include <map>
+#include <vector>
+#include <stdexcept>
+#include <boost/algorithm/string.hpp>
+
+namespace {
+
+const char* const ALLOWED_ALGORITHMS[] = { "sed", "md", "mi", "pca", "ramp" };
+const char* const ALLOWED_OPTIONS[] = { "bins", "nf", "energy", "quant", "method", "precision" };
+const size_t MAX_ALGORITHM_SIZE = 256;
+
+template<size_t N>
+bool isListed(const char* const (&list)[N], const std::string& name)
+{
+    for (size_t i = 0; i < N; ++i) {
+        if (name == list[i])
+            return true;
+    }
+    return false;
+}
+
+} // namespace
+
+std::string checkRemoteAlgorithm(const std::string& algorithm)
+{
+    using namespace boost::algorithm;
+
+    if (algorithm.size() > MAX_ALGORITHM_SIZE)
+        throw std::runtime_error("algorithm string too long");
+
+    //split like GlyphMatcherFactory::create, which defaults to pca
+    std::vector<std::string> tokens;
+    split(tokens, algorithm, is_any_of(":"), token_compress_on);
+    std::string name = tokens.empty() || tokens.front().empty() ? "pca" : tokens.front();
+    if (!isListed(ALLOWED_ALGORITHMS, name))
+        throw std::runtime_error("algorithm " + name + " is not allowed");
+
+    std::map<std::string, std::string> options;
+    for (size_t i = 1; i < tokens.size(); ++i) {
+        std::vector<std::string> opt_tokens;
+        split(opt_tokens, tokens[i], is_any_of("="), token_compress_on);
+        if (opt_tokens[0].empty())
+            continue;
+        if (!isListed(ALLOWED_OPTIONS, opt_tokens[0]))
+            throw std::runtime_error("algorithm option " + opt_tokens[0] + " is not allowed");
+        options[opt_tokens[0]] = opt_tokens.size() > 1 ? opt_tokens[1] : "";
+    }
+
+    std::string result = name;
+    for (std::map<std::string, std::string>::const_iterator it = options.begin(); it != options.end(); ++it) {
+        result += ":" + it->first + "=" + it->second;
+    }
+    return result;
+}
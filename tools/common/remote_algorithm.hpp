@@ -0,0 +1,34 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_TOOLS_COMMON_REMOTE_ALGORITHM_HPP
+#define KGASCII_TOOLS_COMMON_REMOTE_ALGORITHM_HPP
+
+#include <string>
+
+
+// Algorithm strings received by the servers come from untrusted peers.
+// Only the plain matchers and the options that tune them are accepted;
+// options naming files (cache, makecache, autocache) are not, and neither
+// are the auto matcher and the agree option of pca, whose benchmarks are
+// too expensive to start on request.
+// Returns the string rebuilt from the parsed name and options, with the
+// options sorted, so that equal specs make equal cache keys.
+// Throws std::runtime_error for rejected strings.
+std::string checkRemoteAlgorithm(const std::string& algorithm);
+
+#endif // KGASCII_TOOLS_COMMON_REMOTE_ALGORITHM_HPP
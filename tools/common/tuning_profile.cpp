@@ -0,0 +1,97 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include "tuning_profile.hpp"
+#include <fstream>
+#include <stdexcept>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+TuningProfile::TuningProfile()
+    :threadCount(0)
+    ,rowsPerTask(1)
+    ,cellWidth(0)
+    ,cellHeight(0)
+    ,hardwareThreads(0)
+    ,cellCost(0)
+    ,agreement(0)
+{
+}
+
+void TuningProfile::load(const std::string& file)
+{
+    std::ifstream fin(file.c_str());
+    if (!fin)
+        throw std::runtime_error("cannot open profile file " + file);
+
+    TuningProfile prof;
+    std::string line;
+    unsigned line_no = 0;
+    while (std::getline(fin, line)) {
+        line_no++;
+        boost::algorithm::trim(line);
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::string::size_type eq = line.find('=');
+        if (eq == std::string::npos)
+            throw std::runtime_error(file + ":" + boost::lexical_cast<std::string>(line_no) + ": expected key=value");
+        std::string key = boost::algorithm::trim_copy(line.substr(0, eq));
+        std::string val = boost::algorithm::trim_copy(line.substr(eq + 1));
+        try {
+            if (key == "algorithm") {
+                prof.algorithm = val;
+            } else if (key == "threads") {
+                prof.threadCount = boost::lexical_cast<unsigned>(val);
+            } else if (key == "rows_per_task") {
+                prof.rowsPerTask = boost::lexical_cast<unsigned>(val);
+            } else if (key == "cell_width") {
+                prof.cellWidth = boost::lexical_cast<unsigned>(val);
+            } else if (key == "cell_height") {
+                prof.cellHeight = boost::lexical_cast<unsigned>(val);
+            } else if (key == "hardware_threads") {
+                prof.hardwareThreads = boost::lexical_cast<unsigned>(val);
+            } else if (key == "cell_cost") {
+                prof.cellCost = boost::lexical_cast<double>(val);
+            } else if (key == "agreement") {
+                prof.agreement = boost::lexical_cast<double>(val);
+            }
+        } catch (boost::bad_lexical_cast&) {
+            throw std::runtime_error(file + ":" + boost::lexical_cast<std::string>(line_no) + ": invalid value of " + key);
+        }
+    }
+    if (prof.algorithm.empty())
+        throw std::runtime_error("profile file " + file + " does not name an algorithm");
+    *this = prof;
+}
+
+void TuningProfile::save(const std::string& file) const
+{
+    std::ofstream fout(file.c_str());
+    if (!fout)
+        throw std::runtime_error("cannot create profile file " + file);
+    fout << "# kgascii tuning profile\n";
+    fout << "algorithm=" << algorithm << "\n";
+    fout << "threads=" << threadCount << "\n";
+    fout << "rows_per_task=" << rowsPerTask << "\n";
+    fout << "cell_width=" << cellWidth << "\n";
+    fout << "cell_height=" << cellHeight << "\n";
+    fout << "hardware_threads=" << hardwareThreads << "\n";
+    fout << "cell_cost=" << cellCost << "\n";
+    fout << "agreement=" << agreement << "\n";
+    if (!fout)
+        throw std::runtime_error("cannot write profile file " + file);
+}
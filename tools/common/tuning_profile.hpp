@@ -0,0 +1,47 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_TOOLS_COMMON_TUNING_PROFILE_HPP
+#define KGASCII_TOOLS_COMMON_TUNING_PROFILE_HPP
+
+#include <string>
+
+
+// Configuration picked by asciitune for a given font and machine.
+// Stored as a text file with one key=value pair per line; unknown keys
+// are ignored and lines starting with '#' are comments.
+struct TuningProfile
+{
+    TuningProfile();
+
+    void load(const std::string& file);
+
+    void save(const std::string& file) const;
+
+    std::string algorithm;
+    unsigned threadCount;
+    unsigned rowsPerTask;
+    //cell size of the font the profile was tuned for
+    unsigned cellWidth;
+    unsigned cellHeight;
+    unsigned hardwareThreads;
+    //seconds per text cell of the chosen configuration
+    double cellCost;
+    double agreement;
+};
+
+#endif // KGASCII_TOOLS_COMMON_TUNING_PROFILE_HPP
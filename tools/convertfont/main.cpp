@@ -0,0 +1,95 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include <iostream>
+#include <boost/filesystem.hpp>
+#include <common/cmdline_tool.hpp>
+#include <kgascii/font_io.hpp>
+#include <kgascii/mapped_font.hpp>
+
+using namespace KG::Ascii;
+
+typedef Font<> FontT;
+
+class ConvertFont: public CmdlineTool
+{
+public:
+    ConvertFont();
+
+protected:
+    bool processArgs();
+    int doExecute();
+};
+
+int main(int argc, char* argv[])
+{
+    return ConvertFont().execute(argc, argv);
+}
+
+ConvertFont::ConvertFont()
+    :CmdlineTool("Options")
+{
+    using namespace boost::program_options;
+    desc_.add_options()
+        ("input-file,i", value<std::string>(), "input font file (dsc or kgf)")
+        ("output-file,o", value<std::string>(), "output font file, binary if named *.kgf")
+    ;
+    posDesc_.add("input-file", 1);
+    posDesc_.add("output-file", 1);
+}
+
+bool ConvertFont::processArgs()
+{
+    requireOption("input-file");
+    return true;
+}
+
+int ConvertFont::doExecute()
+{
+    std::string input_file = vm_["input-file"].as<std::string>();
+    std::string output_file;
+    if (vm_["output-file"].empty()) {
+        boost::filesystem::path input_path(input_file);
+        output_file = input_path.replace_extension(".kgf").filename().string();
+    } else {
+        output_file = vm_["output-file"].as<std::string>();
+    }
+    if (boost::filesystem::exists(output_file) && boost::filesystem::equivalent(input_file, output_file)) {
+        std::cerr << "input and output are the same file\n";
+        return -1;
+    }
+
+    FontT font;
+    if (!font.load(input_file))
+        return -1;
+    if (!font.save(output_file))
+        return -1;
+
+    std::cout << "glyph count " << font.glyphCount() << "\n";
+    std::cout << "glyph width " << font.glyphWidth() << "\n";
+    std::cout << "glyph height " << font.glyphHeight() << "\n";
+
+    //a binary file has to open in place
+    if (Internal::hasFontFileExtension(output_file)) {
+        MappedFont<> mapped(output_file);
+        if (mapped.glyphCount() != font.glyphCount()) {
+            std::cerr << "problem verifying " << output_file << "\n";
+            return -1;
+        }
+    }
+    return 0;
+}
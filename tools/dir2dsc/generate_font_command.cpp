@@ -42,7 +42,7 @@ void GenerateFontCommand::execute(const Parameters& params)
     ImageDirectoryFontLoader loader(params.image_path);
 
     Font<> font;
-    if (!load(font, loader)) {
+    if (!loadParallel(font, loader, params.thread_count)) {
         BOOST_THROW_EXCEPTION(std::runtime_error("font loading error"));
     }
 
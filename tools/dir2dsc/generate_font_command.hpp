@@ -29,6 +29,7 @@ public:
     {
         std::string image_path;
         std::string output_filename;
+        unsigned thread_count;
     };
 
 public:
@@ -42,7 +42,9 @@ GenerateFont::GenerateFont()
     using namespace boost::program_options;
     desc_.add_options()
         ("image-path,i", value<std::string>(), "input image directory")
-        ("output-file,o", value<std::string>(), "output font file")
+        ("output-file,o", value<std::string>(), "output font file, binary if named *.kgf")
+        ("binary,b", "name the default output file *.kgf instead of *.dsc")
+        ("threads,t", value<unsigned>()->default_value(0), "number of image decoding threads (0 = auto)")
     ;
     posDesc_.add("image-path", 1);
     posDesc_.add("output-file", 1);
@@ -58,9 +60,10 @@ int GenerateFont::doExecute()
 {
     GenerateFontCommand::Parameters params;
     params.image_path = vm_["image-path"].as<std::string>();
+    params.thread_count = vm_["threads"].as<unsigned>();
     if (vm_["output-file"].empty()) {
         boost::filesystem::path input_path(params.image_path);
-        params.output_filename = input_path.replace_extension(".dsc").filename().string();
+        params.output_filename = input_path.replace_extension(vm_.count("binary") ? ".kgf" : ".dsc").filename().string();
     } else {
         params.output_filename = vm_["output-file"].as<std::string>();
     }
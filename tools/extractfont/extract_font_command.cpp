@@ -42,11 +42,11 @@ void ExtractFontCommand::execute(const Parameters& params)
 
     Font<> font;
     if (params.min_char && params.max_char) {
-        if (!load(font, loader, params.min_char.get(), params.max_char.get())) {
+        if (!loadParallel(font, loader, params.thread_count, params.min_char.get(), params.max_char.get())) {
             BOOST_THROW_EXCEPTION(std::runtime_error("font loading error"));
         }
     } else if (!params.min_char && !params.max_char) {
-        if (!load(font, loader)) {
+        if (!loadParallel(font, loader, params.thread_count)) {
             BOOST_THROW_EXCEPTION(std::runtime_error("font loading error"));
         }
     } else {
@@ -38,6 +38,7 @@ public:
         boost::optional<KG::Ascii::FT2FontLoader::AutoHinter> autohint;
         boost::optional<KG::Ascii::FT2FontLoader::RenderMode> render_mode;
         std::string output_file;
+        unsigned thread_count;
     };
 
 public:
@@ -15,6 +15,8 @@
 // You should have received a copy of the GNU Lesser General Public License 
 // along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
 
+#include <stdexcept>
+#include <vector>
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 #include <common/cmdline_tool.hpp>
@@ -47,18 +49,24 @@ ExtractFont::ExtractFont()
         ("mode,m", value<FT2FontLoader::RenderMode>()->default_value(FT2FontLoader::RenderMode::Grayscale), "rendering mode (gray|mono)")
         ("min-char,f", value<unsigned>()->default_value(32), "first charcode")
         ("max-char,l", value<unsigned>()->default_value(126), "last charcode")
-        ("output-file,o", value<std::string>(), "output file")
+        ("output-file,o", value<std::string>(), "output file, binary if named *.kgf; with several pixel sizes %1% is replaced by the size")
+        ("binary,b", "name the default output file *.kgf instead of *.dsc")
+        ("threads,t", value<unsigned>()->default_value(0), "number of rasterizer threads (0 = auto)")
         ("input-file,i", value<std::string>(), "input font file")
-        ("pixel-size,s", value<unsigned>(), "font nominal pixel size")
+        ("pixel-size,s", value<std::vector<unsigned> >()->multitoken(), "font nominal pixel sizes")
     ;
     posDesc_.add("input-file", 1);
-    posDesc_.add("pixel-size", 1);
+    posDesc_.add("pixel-size", -1);
 }
 
 bool ExtractFont::processArgs()
 {
     requireOption("input-file");
     requireOption("pixel-size");
+    if (vm_["pixel-size"].as<std::vector<unsigned> >().size() > 1 && vm_.count("output-file")
+            && vm_["output-file"].as<std::string>().find("%1%") == std::string::npos) {
+        throw std::logic_error("output file name must contain %1% when extracting several pixel sizes");
+    }
     return true;
 }
 
@@ -66,23 +74,30 @@ int ExtractFont::doExecute()
 {
     ExtractFontCommand::Parameters params;
     params.font_file = vm_["input-file"].as<std::string>();
-    params.font_size = vm_["pixel-size"].as<unsigned>();
     params.autohint = vm_["autohint"].as<FT2FontLoader::AutoHinter>();
     params.hinting = vm_["hint"].as<FT2FontLoader::Hinting>();
     params.render_mode = vm_["mode"].as<FT2FontLoader::RenderMode>();
     params.min_char = Symbol(vm_["min-char"].as<unsigned>());
     params.max_char = Symbol(vm_["max-char"].as<unsigned>());
-    if (vm_["output-file"].empty()) {
-        boost::filesystem::path input_path(params.font_file);
-        const std::string& basename = input_path.stem().string();
-        params.output_file = str(boost::format("%1%_%2%.dsc") % basename % params.font_size);
-    } else {
-        params.output_file = vm_["output-file"].as<std::string>();
-    }
+    params.thread_count = vm_["threads"].as<unsigned>();
 
-    ExtractFontCommand cmd;
-    cmd.execute(params);
+    const std::vector<unsigned>& sizes = vm_["pixel-size"].as<std::vector<unsigned> >();
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        params.font_size = sizes[i];
+        if (vm_["output-file"].empty()) {
+            boost::filesystem::path input_path(params.font_file);
+            const std::string& basename = input_path.stem().string();
+            const char* extension = vm_.count("binary") ? "kgf" : "dsc";
+            params.output_file = str(boost::format("%1%_%2%.%3%") % basename % params.font_size % extension);
+        } else if (sizes.size() > 1) {
+            params.output_file = str(boost::format(vm_["output-file"].as<std::string>()) % params.font_size);
+        } else {
+            params.output_file = vm_["output-file"].as<std::string>();
+        }
+
+        ExtractFontCommand cmd;
+        cmd.execute(params);
+    }
 
     return 0;
 }
-
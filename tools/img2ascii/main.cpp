@@ -19,25 +19,41 @@
 #include <fstream>
 #include <limits>
 #include <cmath>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <cctype>
 #include <boost/optional.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <common/cmdline_tool.hpp>
 #include <common/validate_optional.hpp>
+#include <common/tuning_profile.hpp>
 #include <kgascii/font_image.hpp>
 #include <kgascii/font_io.hpp>
+#include <kgascii/mapped_font.hpp>
 #include <kgascii/dynamic_asciifier.hpp>
+#include <kgascii/multi_resolution_asciifier.hpp>
+#include <kgascii/progressive_asciifier.hpp>
 #include <kgascii/text_surface.hpp>
 #include <kgascii/glyph_matcher_context_factory.hpp>
 #include <kgutil/image_io.hpp>
 #include <kgutil/srgb.hpp>
 #include <kgutil/resample.hpp>
 #include <kgutil/resample/filter/bspline.hpp>
+#include <kgutil/task_queue.hpp>
 
 using namespace KG::Ascii;
 using namespace KG::Util;
 
 typedef Font<> FontT;
 
+class Converter;
+
 class ImageToAscii: public CmdlineTool
 {
 public:
@@ -47,16 +63,46 @@ protected:
     bool processArgs();
 
     int doExecute();
+
+private:
+    struct Job
+    {
+        std::string input_file;
+        std::string output_file;
+    };
+
+    void collectInputFiles();
+
+    bool convertFile(const Job& job, Converter& conv, bool verbose) const;
+
+    bool convertFileSizes(const Job& job, Converter& conv, bool verbose) const;
+
+    void workerFunc(boost::shared_ptr<Converter> conv);
     
 private:
-    std::string inputFile_;
+    std::vector<std::string> inputPatterns_;
+    std::vector<std::string> inputFiles_;
     std::string outputFile_;
+    std::string outputDir_;
     std::string fontFile_;
     unsigned maxCols_;
     unsigned maxRows_;
     std::string algorithm_;
+    std::string coarseAlgorithm_;
+    unsigned budget_;
     unsigned threadCount_;
+    unsigned jobCount_;
     bool gamma_;
+    std::string profileFile_;
+    TuningProfile profile_;
+    std::string sizes_;
+    std::vector<std::pair<unsigned, unsigned> > gridSizes_;
+    unsigned rowsPerTask_;
+    unsigned charWidth_;
+    unsigned charHeight_;
+    KG::Util::TaskQueue<Job> queue_;
+    boost::mutex logMutex_;
+    unsigned failedCount_;
 };
 
 int main(int argc, char* argv[])
@@ -67,19 +113,29 @@ int main(int argc, char* argv[])
 
 ImageToAscii::ImageToAscii()
     :CmdlineTool("Options")
+    ,rowsPerTask_(1)
+    ,charWidth_(0)
+    ,charHeight_(0)
+    ,failedCount_(0)
 {
     using namespace boost::program_options;
     desc_.add_options()
-        ("input-file,i", value(&inputFile_), "input image file")
+        ("input-file,i", value(&inputPatterns_)->composing(), "input image files, directories or wildcard patterns")
         ("font-file,f", value(&fontFile_), "font file")
         ("cols,c", value(&maxCols_)->default_value(79), "suggested number of text columns")
         ("rows,r", value(&maxRows_)->default_value(49), "suggested number of text rows")
-        ("output-file,o", value(&outputFile_), "output text file")
+        ("output-file,o", value(&outputFile_), "output text file (single input only)")
+        ("output-dir,d", value(&outputDir_), "output directory for text files (NAME.EXT.txt in batch mode, input subdirectories mirrored)")
         ("algorithm,a", value(&algorithm_)->default_value("pca"), "glyph matching algorithm")
-        ("threads", value(&threadCount_)->default_value(0), "worker thread count")
+        ("budget", value(&budget_), "convert coarse-to-fine, refining cells for at most this many milliseconds")
+        ("coarse-algorithm", value(&coarseAlgorithm_)->default_value("ramp"), "glyph matching algorithm of the coarse pass (with budget)")
+        ("threads", value(&threadCount_)->default_value(0), "worker thread count (single input)")
+        ("jobs,j", value(&jobCount_)->default_value(0), "number of files converted in parallel (0 = auto)")
         ("gamma", value<bool>()->zero_tokens(), "use gamma correction")
+        ("profile,p", value(&profileFile_), "tuning profile written by asciitune")
+        ("sizes,s", value(&sizes_), "comma separated COLSxROWS suggested sizes, each written to its own file")
     ;
-    posDesc_.add("input-file", 1);
+    posDesc_.add("input-file", -1);
 }
 
 bool ImageToAscii::processArgs()
@@ -87,73 +143,440 @@ bool ImageToAscii::processArgs()
     requireOption("input-file");
     requireOption("font-file");
     requireOption("algorithm");
-    
-    if (!vm_.count("output-file")) {
-        boost::filesystem::path input_path(inputFile_);
-        outputFile_ = input_path.stem().string() + ".txt";
+    conflictingOptions("output-file", "output-dir");
+    conflictingOptions("sizes", "cols");
+    conflictingOptions("sizes", "rows");
+    conflictingOptions("sizes", "budget");
+
+    collectInputFiles();
+    if (inputFiles_.empty()) {
+        std::cerr << "no input files\n";
+        return false;
+    }
+    if (inputFiles_.size() > 1 && vm_.count("output-file")) {
+        std::cerr << "output-file can be used with a single input file only, use output-dir\n";
+        return false;
     }
 
     gamma_ = vm_.count("gamma") > 0;
 
+    if (!sizes_.empty()) {
+        std::vector<std::string> tokens;
+        boost::algorithm::split(tokens, sizes_, boost::algorithm::is_any_of(","));
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            std::vector<std::string> dims;
+            boost::algorithm::split(dims, tokens[i], boost::algorithm::is_any_of("x"));
+            try {
+                if (dims.size() != 2)
+                    throw boost::bad_lexical_cast();
+                unsigned cols = boost::lexical_cast<unsigned>(dims[0]);
+                unsigned rows = boost::lexical_cast<unsigned>(dims[1]);
+                if (cols == 0 || rows == 0)
+                    throw boost::bad_lexical_cast();
+                gridSizes_.push_back(std::make_pair(cols, rows));
+            } catch (boost::bad_lexical_cast&) {
+                throw std::logic_error("invalid size '" + tokens[i] + "', expected COLSxROWS");
+            }
+        }
+    }
+
+    //explicitly given options take precedence over the profile
+    if (!profileFile_.empty()) {
+        profile_.load(profileFile_);
+        if (vm_["algorithm"].defaulted()) {
+            algorithm_ = profile_.algorithm;
+        }
+        if (vm_["threads"].defaulted()) {
+            threadCount_ = profile_.threadCount;
+        }
+        rowsPerTask_ = profile_.rowsPerTask;
+    }
+
     return true;
 }
 
+namespace {
+
+bool wildcardMatch(const char* pattern, const char* name)
+{
+    for (; *pattern; ++pattern, ++name) {
+        if (*pattern == '*') {
+            for (const char* rest = name; ; ++rest) {
+                if (wildcardMatch(pattern + 1, rest))
+                    return true;
+                if (!*rest)
+                    return false;
+            }
+        }
+        if (!*name || (*pattern != '?' && *pattern != *name))
+            return false;
+    }
+    return !*name;
+}
+
+bool isImageFile(const boost::filesystem::path& file_path)
+{
+    static const char* const extensions[] = { ".png", ".jpg", ".jpeg", ".tif", ".tiff" };
+    std::string ext = file_path.extension().string();
+    for (size_t i = 0; i < ext.size(); ++i) {
+        ext[i] = static_cast<char>(tolower(ext[i]));
+    }
+    for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); ++i) {
+        if (ext == extensions[i])
+            return true;
+    }
+    return false;
+}
+
+// Absolute path with links, "." and ".." resolved if the file exists.
+boost::filesystem::path resolvedPath(const std::string& file)
+{
+    boost::system::error_code err;
+    boost::filesystem::path resolved = boost::filesystem::canonical(file, err);
+    return err ? boost::filesystem::absolute(file) : resolved;
+}
+
+// Deepest directory holding all the absolute paths.
+boost::filesystem::path commonParent(const std::vector<boost::filesystem::path>& paths)
+{
+    namespace fs = boost::filesystem;
+
+    fs::path first_dir = paths.front().parent_path();
+    std::vector<fs::path> common(first_dir.begin(), first_dir.end());
+    for (size_t i = 1; i < paths.size(); ++i) {
+        fs::path dir = paths[i].parent_path();
+        size_t n = 0;
+        for (fs::path::iterator it = dir.begin(); it != dir.end() && n < common.size() && *it == common[n]; ++it) {
+            ++n;
+        }
+        common.resize(n);
+    }
+    fs::path result;
+    for (size_t i = 0; i < common.size(); ++i) {
+        result /= common[i];
+    }
+    return result;
+}
+
+// The part of path below base, which is one of its parents.
+boost::filesystem::path relativePath(const boost::filesystem::path& path, const boost::filesystem::path& base)
+{
+    namespace fs = boost::filesystem;
+
+    size_t skip = std::distance(base.begin(), base.end());
+    fs::path result;
+    size_t n = 0;
+    for (fs::path::iterator it = path.begin(); it != path.end(); ++it, ++n) {
+        if (n >= skip) {
+            result /= *it;
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+void ImageToAscii::collectInputFiles()
+{
+    namespace fs = boost::filesystem;
+
+    for (size_t i = 0; i < inputPatterns_.size(); ++i) {
+        fs::path input_path(inputPatterns_[i]);
+        std::string name = input_path.filename().string();
+        std::vector<std::string> matches;
+        if (fs::is_directory(input_path)) {
+            for (fs::directory_iterator it(input_path), end; it != end; ++it) {
+                if (fs::is_regular_file(it->status()) && isImageFile(it->path())) {
+                    matches.push_back(it->path().string());
+                }
+            }
+        } else if (name.find_first_of("*?") != std::string::npos) {
+            fs::path dir_path = input_path.parent_path();
+            if (dir_path.empty()) {
+                dir_path = ".";
+            }
+            if (fs::is_directory(dir_path)) {
+                for (fs::directory_iterator it(dir_path), end; it != end; ++it) {
+                    if (fs::is_regular_file(it->status())
+                            && wildcardMatch(name.c_str(), it->path().filename().string().c_str())) {
+                        matches.push_back(it->path().string());
+                    }
+                }
+            }
+        } else {
+            matches.push_back(input_path.string());
+        }
+        //directory iteration order is unspecified
+        std::sort(matches.begin(), matches.end());
+        inputFiles_.insert(inputFiles_.end(), matches.begin(), matches.end());
+    }
+
+    //overlapping patterns must not convert a file twice
+    std::set<std::string> seen;
+    std::vector<std::string> unique_files;
+    for (size_t i = 0; i < inputFiles_.size(); ++i) {
+        if (seen.insert(resolvedPath(inputFiles_[i]).string()).second) {
+            unique_files.push_back(inputFiles_[i]);
+        }
+    }
+    inputFiles_.swap(unique_files);
+}
+
+class Converter: boost::noncopyable
+{
+public:
+    virtual ~Converter() { }
+
+    virtual void generate(const boost::gil::gray8c_view_t& view, TextSurface& text) = 0;
+
+    // All surfaces from one full resolution image, each scaled to its
+    // entry of sizes, see MultiResolutionAsciifier.
+    virtual void generate(const boost::gil::rgb_lin16c_view_t& view, std::vector<TextSurface>& texts, 
+            const std::vector<boost::gil::point2<ptrdiff_t> >& sizes) = 0;
+
+    // Coarse pass followed by refinement within the budget, see ProgressiveAsciifier.
+    // Returns the number of refined cells.
+    virtual size_t generate(const boost::gil::gray8c_view_t& view, TextSurface& text, 
+            boost::posix_time::time_duration budget) = 0;
+
+    // New converter sharing the glyph matcher, with its own sequential asciifier.
+    virtual boost::shared_ptr<Converter> clone() const = 0;
+
+    virtual unsigned cellWidth() const = 0;
+
+    virtual unsigned cellHeight() const = 0;
+};
+
 template<class ImageT>
-class ConverterImpl
+class ConverterImpl: public Converter
 {
     typedef FontImage<FontT, ImageT> FontImageT;
     typedef DynamicGlyphMatcher<FontImageT> DynamicGlyphMatcherT;
     typedef DynamicAsciifier<DynamicGlyphMatcherT> DynamicAsciifierT;
+    typedef MultiResolutionAsciifier<DynamicGlyphMatcherT> MultiResolutionAsciifierT;
+    typedef ProgressiveAsciifier<DynamicGlyphMatcherT> ProgressiveAsciifierT;
 
 public:
-    explicit ConverterImpl(boost::shared_ptr<const FontT> font, const std::string& algo, size_t threads)
+    // The coarse matcher is only created when coarse_algo is not empty.
+    explicit ConverterImpl(const std::string& font_file, const std::string& algo, const std::string& coarse_algo,
+            size_t threads, unsigned rows_per_task)
+        :threads_(threads)
+        ,rowsPerTask_(rows_per_task)
     {
         registerGlyphMatcherFactories<FontImageT>();
-        fontImage_.reset(new FontImageT(font));
+        fontImage_ = loadFontImage<FontImageT>(font_file);
         matcher_ = GlyphMatcherFactory::create(fontImage_, algo);
+        if (!coarse_algo.empty()) {
+            coarseMatcher_ = GlyphMatcherFactory::create(fontImage_, coarse_algo);
+        }
         asciifier_.reset(new DynamicAsciifierT(matcher_));
         if (threads == 1) {
             asciifier_->setSequential();
         } else {
-            asciifier_->setParallel(threads);
+            asciifier_->setParallel(threads, rows_per_task);
         }
     }
 
-    template<class TView>
-    void generate(const TView& view, TextSurface& text)
+    virtual void generate(const boost::gil::gray8c_view_t& view, TextSurface& text)
+    {
+        convertInput(view);
+        asciifier_->generate(boost::gil::const_view(tempImage_), text);
+    }
+
+    virtual size_t generate(const boost::gil::gray8c_view_t& view, TextSurface& text, 
+            boost::posix_time::time_duration budget)
+    {
+        assert(coarseMatcher_);
+        if (!progressiveAsciifier_) {
+            progressiveAsciifier_.reset(new ProgressiveAsciifierT(matcher_, coarseMatcher_));
+        }
+        convertInput(view);
+        return progressiveAsciifier_->generate(boost::gil::const_view(tempImage_), text, 
+                typename ProgressiveAsciifierT::ProgressCallbackT(), budget);
+    }
+
+    virtual void generate(const boost::gil::rgb_lin16c_view_t& view, std::vector<TextSurface>& texts, 
+            const std::vector<boost::gil::point2<ptrdiff_t> >& sizes)
+    {
+        if (!multiAsciifier_) {
+            multiAsciifier_.reset(new MultiResolutionAsciifierT(matcher_, threads_, rowsPerTask_));
+        }
+        multiAsciifier_->generate(view, texts, sizes);
+    }
+
+    virtual boost::shared_ptr<Converter> clone() const
+    {
+        boost::shared_ptr<Converter> ptr(new ConverterImpl(fontImage_, matcher_, coarseMatcher_));
+        return ptr;
+    }
+
+    virtual unsigned cellWidth() const
+    {
+        return fontImage_->glyphWidth();
+    }
+
+    virtual unsigned cellHeight() const
+    {
+        return fontImage_->glyphHeight();
+    }
+
+private:
+    ConverterImpl(boost::shared_ptr<FontImageT> font_image, boost::shared_ptr<DynamicGlyphMatcherT> matcher,
+            boost::shared_ptr<DynamicGlyphMatcherT> coarse_matcher)
+        :fontImage_(font_image)
+        ,matcher_(matcher)
+        ,coarseMatcher_(coarse_matcher)
+        ,asciifier_(new DynamicAsciifierT(matcher_))
+        ,threads_(1)
+        ,rowsPerTask_(1)
+    {
+    }
+
+    void convertInput(const boost::gil::gray8c_view_t& view)
     {
-        ImageT temp_image(view.width(), view.height());
-        boost::gil::copy_and_convert_pixels(view, boost::gil::view(temp_image));
-        asciifier_->generate(boost::gil::const_view(temp_image), text);
+        //the conversion buffer is reused while the image size stays the same
+        if (tempImage_.dimensions() != view.dimensions()) {
+            tempImage_.recreate(view.dimensions());
+        }
+        boost::gil::copy_and_convert_pixels(view, boost::gil::view(tempImage_));
     }
 
 private:
     boost::shared_ptr<FontImageT> fontImage_;
     boost::shared_ptr<DynamicGlyphMatcherT> matcher_;
+    boost::shared_ptr<DynamicGlyphMatcherT> coarseMatcher_;
     boost::shared_ptr<DynamicAsciifierT> asciifier_;
+    boost::shared_ptr<MultiResolutionAsciifierT> multiAsciifier_;
+    boost::shared_ptr<ProgressiveAsciifierT> progressiveAsciifier_;
+    size_t threads_;
+    unsigned rowsPerTask_;
+    ImageT tempImage_;
 };
 
 int ImageToAscii::doExecute()
 {
-    std::cerr << "loading font...\n";
-    boost::shared_ptr<FontT> font(new FontT);
-    if (!font->load(fontFile_))
-        return -1;
-    unsigned char_width = font->glyphWidth();
-    unsigned char_height = font->glyphHeight();
+    namespace fs = boost::filesystem;
 
-    std::cerr << "loading image...\n";
-    ImageInfo iinfo;
-    if (!readImageInfo(inputFile_, iinfo)) {
+    //a single input is written to NAME.txt; in batch mode the extension is
+    //kept, so that x.png and x.jpg do not end up in the same file, and the
+    //directories of the inputs below their common parent are mirrored, so
+    //that a/x.png and b/x.png do not either
+    std::vector<fs::path> input_paths;
+    for (size_t i = 0; i < inputFiles_.size(); ++i) {
+        input_paths.push_back(resolvedPath(inputFiles_[i]));
+    }
+    fs::path base_dir = commonParent(input_paths);
+
+    std::vector<Job> jobs(inputFiles_.size());
+    for (size_t i = 0; i < inputFiles_.size(); ++i) {
+        jobs[i].input_file = inputFiles_[i];
+        if (!outputFile_.empty()) {
+            jobs[i].output_file = outputFile_;
+            continue;
+        }
+        fs::path output_path;
+        if (inputFiles_.size() == 1) {
+            output_path = fs::path(inputFiles_[i]).stem().string() + ".txt";
+        } else {
+            output_path = relativePath(input_paths[i].parent_path(), base_dir) / (input_paths[i].filename().string() + ".txt");
+        }
+        if (!outputDir_.empty()) {
+            output_path = fs::path(outputDir_) / output_path;
+        }
+        if (output_path.has_parent_path()) {
+            fs::create_directories(output_path.parent_path());
+        }
+        jobs[i].output_file = output_path.string();
+    }
+
+    //the font and the matcher are loaded once and shared by all files;
+    //binary fonts are mapped, see loadFontImage
+    std::cerr << "loading font and creating glyph matcher...\n";
+    unsigned thread_count = jobs.size() > 1 ? 1 : threadCount_;
+    std::string coarse_algorithm = vm_.count("budget") ? coarseAlgorithm_ : std::string();
+    boost::shared_ptr<Converter> converter;
+    if (gamma_) {
+        converter.reset(new ConverterImpl<boost::gil::gray_lin16_image_t>(fontFile_, algorithm_, coarse_algorithm, 
+                thread_count, rowsPerTask_));
+    } else {
+        converter.reset(new ConverterImpl<boost::gil::gray8_image_t>(fontFile_, algorithm_, coarse_algorithm, 
+                thread_count, rowsPerTask_));
+    }
+    charWidth_ = converter->cellWidth();
+    charHeight_ = converter->cellHeight();
+    if (profile_.cellWidth && (profile_.cellWidth != charWidth_ || profile_.cellHeight != charHeight_)) {
+        std::cerr << "warning: profile was tuned for a different cell size\n";
+    }
+
+    if (jobs.size() == 1) {
+        return convertFile(jobs.front(), *converter, true) ? 0 : -1;
+    }
+
+    unsigned job_count = jobCount_;
+    if (job_count == 0) {
+        job_count = std::max(boost::thread::hardware_concurrency(), 1u);
+    }
+    job_count = std::min<size_t>(job_count, jobs.size());
+
+    std::cout << "input files " << jobs.size() << "\n";
+    std::cout << "parallel jobs " << job_count << "\n";
+
+    //each worker decodes, resamples and matches whole files on its own
+    boost::thread_group group;
+    group.create_thread(boost::bind(&ImageToAscii::workerFunc, this, converter));
+    for (unsigned i = 1; i < job_count; ++i) {
+        group.create_thread(boost::bind(&ImageToAscii::workerFunc, this, converter->clone()));
+    }
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        queue_.push(jobs[i]);
+    }
+    queue_.wait_empty();
+    queue_.close();
+    group.join_all();
+
+    std::cout << "converted files " << jobs.size() - failedCount_ << "\n";
+    if (failedCount_ > 0) {
+        std::cout << "failed files " << failedCount_ << "\n";
         return -1;
     }
+    return 0;
+}
 
-    unsigned frame_width = iinfo.width;
-    unsigned frame_height = iinfo.height;
+void ImageToAscii::workerFunc(boost::shared_ptr<Converter> conv)
+{
+    Job job;
+    while (queue_.wait_pop(job)) {
+        bool ok = false;
+        try {
+            ok = convertFile(job, *conv, false);
+        } catch (const std::exception& e) {
+            boost::unique_lock<boost::mutex> lock(logMutex_);
+            std::cerr << job.input_file << ": " << e.what() << "\n";
+        }
+        if (!ok) {
+            boost::unique_lock<boost::mutex> lock(logMutex_);
+            std::cerr << "problem converting " << job.input_file << "\n";
+            failedCount_++;
+        }
+        queue_.done();
+    }
+}
 
-    unsigned hint_width = maxCols_ * char_width;
-    unsigned hint_height = maxRows_ * char_height;
-    unsigned out_width, out_height;
+namespace {
+
+typedef boost::mpl::vector<
+    boost::gil::gray8_image_t,
+    boost::gil::gray16_image_t,
+    boost::gil::rgb8_image_t,
+    boost::gil::rgb16_image_t,
+    boost::gil::rgba8_image_t,
+    boost::gil::rgba16_image_t
+>::type input_image_types;
+
+// Largest size of the frame fitting into the hint that keeps its aspect ratio.
+void fitOutputSize(unsigned frame_width, unsigned frame_height, unsigned hint_width, unsigned hint_height, 
+        unsigned& out_width, unsigned& out_height)
+{
     if (hint_width * frame_height / frame_width < hint_height) {
         out_width = hint_width;
         out_height = out_width * frame_height / frame_width;
@@ -161,28 +584,57 @@ int ImageToAscii::doExecute()
         out_height = hint_height;
         out_width = out_height * frame_width / frame_height;
     }
+}
+
+bool writeText(const std::string& file, const TextSurface& text)
+{
+    std::ofstream fout(file.c_str());
+    for (size_t r = 0; r < text.rows(); ++r) {
+        for (size_t c = 0; c < text.cols(); ++c)
+            fout.put(text(r, c).charValue());
+        fout.put('\n');
+    }
+    fout.close();
+
+    return static_cast<bool>(fout);
+}
+
+} // namespace
+
+bool ImageToAscii::convertFile(const Job& job, Converter& conv, bool verbose) const
+{
+    if (!gridSizes_.empty())
+        return convertFileSizes(job, conv, verbose);
+
+    if (verbose) {
+        std::cerr << "loading image...\n";
+    }
+    ImageInfo iinfo;
+    if (!readImageInfo(job.input_file, iinfo)) {
+        return false;
+    }
+
+    unsigned frame_width = iinfo.width;
+    unsigned frame_height = iinfo.height;
+
+    unsigned out_width, out_height;
+    fitOutputSize(frame_width, frame_height, maxCols_ * charWidth_, maxRows_ * charHeight_, out_width, out_height);
+
+    unsigned col_count = (out_width + charWidth_ - 1) / charWidth_;
+    unsigned row_count = (out_height + charHeight_ - 1) / charHeight_;
+
+    if (verbose) {
+        std::cout << "image width " << frame_width << "\n";
+        std::cout << "image height " << frame_height << "\n";
+        std::cout << "output width " << out_width << "\n";
+        std::cout << "output height " << out_height << "\n";
+        std::cout << "output columns " << col_count << "\n";
+        std::cout << "output rows " << row_count << "\n";
+    }
 
-    unsigned col_count = (out_width + char_width - 1) / char_width;
-    unsigned row_count = (out_height + char_height - 1) / char_height;
-
-    std::cout << "image width " << frame_width << "\n";
-    std::cout << "image height " << frame_height << "\n";
-    std::cout << "output width " << out_width << "\n";
-    std::cout << "output height " << out_height << "\n";
-    std::cout << "output columns " << col_count << "\n";
-    std::cout << "output rows " << row_count << "\n";
-
-    typedef boost::mpl::vector<
-        boost::gil::gray8_image_t,
-        boost::gil::gray16_image_t,
-        boost::gil::rgb8_image_t,
-        boost::gil::rgb16_image_t,
-        boost::gil::rgba8_image_t,
-        boost::gil::rgba16_image_t
-    >::type input_image_types;
     boost::gil::any_image<input_image_types> loaded_image;
-    if (!loadImage(inputFile_, loaded_image))
-        return -1;
+    if (!loadImage(job.input_file, loaded_image))
+        return false;
 
     boost::gil::rgb_lin16_image_t input_image(frame_width, frame_height);
     boost::gil::copy_and_convert_pixels(const_view(loaded_image), view(input_image));
@@ -194,22 +646,60 @@ int ImageToAscii::doExecute()
     boost::gil::copy_and_convert_pixels(const_view(scaled_image), view(grayscale_image));
 
     TextSurface text(row_count, col_count);
-    if (gamma_) {
-        ConverterImpl<boost::gil::gray_lin16_image_t> converter(font, algorithm_, threadCount_);
-        converter.generate(const_view(grayscale_image), text);
+    if (vm_.count("budget")) {
+        //the coarse matcher fills all cells, the fine one refines the busiest first
+        size_t refined = conv.generate(const_view(grayscale_image), text, boost::posix_time::milliseconds(budget_));
+        if (verbose) {
+            std::cout << "refined cells " << refined << " of " << text.rows() * text.cols() << "\n";
+        }
     } else {
-        ConverterImpl<boost::gil::gray8_image_t> converter(font, algorithm_, threadCount_);
-        converter.generate(const_view(grayscale_image), text);
+        conv.generate(const_view(grayscale_image), text);
     }
 
-    std::ofstream fout(outputFile_.c_str());
-    for (size_t r = 0; r < text.rows(); ++r) {
-        for (size_t c = 0; c < text.cols(); ++c)
-            fout.put(text(r, c).charValue());
-        fout.put('\n');
+    return writeText(job.output_file, text);
+}
+
+// The image is decoded and converted once; every requested size is
+// written next to the output file as NAME.COLSxROWS.EXT.
+bool ImageToAscii::convertFileSizes(const Job& job, Converter& conv, bool verbose) const
+{
+    namespace fs = boost::filesystem;
+
+    if (verbose) {
+        std::cerr << "loading image...\n";
     }
-    fout.close();
+    boost::gil::any_image<input_image_types> loaded_image;
+    if (!loadImage(job.input_file, loaded_image))
+        return false;
 
-    return 0;
-}
+    unsigned frame_width = loaded_image.width();
+    unsigned frame_height = loaded_image.height();
+    boost::gil::rgb_lin16_image_t input_image(frame_width, frame_height);
+    boost::gil::copy_and_convert_pixels(const_view(loaded_image), view(input_image));
 
+    //sized like a single conversion with the same --cols and --rows
+    std::vector<TextSurface> texts(gridSizes_.size());
+    std::vector<boost::gil::point2<ptrdiff_t> > sizes(gridSizes_.size());
+    for (size_t i = 0; i < gridSizes_.size(); ++i) {
+        unsigned out_width, out_height;
+        fitOutputSize(frame_width, frame_height, gridSizes_[i].first * charWidth_, gridSizes_[i].second * charHeight_, 
+                out_width, out_height);
+        sizes[i] = boost::gil::point2<ptrdiff_t>(out_width, out_height);
+        texts[i].resize((out_height + charHeight_ - 1) / charHeight_, (out_width + charWidth_ - 1) / charWidth_);
+        if (verbose) {
+            std::cout << "output size " << texts[i].cols() << "x" << texts[i].rows() << "\n";
+        }
+    }
+
+    conv.generate(const_view(input_image), texts, sizes);
+
+    fs::path output_path(job.output_file);
+    bool ok = true;
+    for (size_t i = 0; i < gridSizes_.size(); ++i) {
+        std::string suffix = "." + boost::lexical_cast<std::string>(gridSizes_[i].first) 
+            + "x" + boost::lexical_cast<std::string>(gridSizes_[i].second);
+        fs::path size_path = output_path.parent_path() / (output_path.stem().string() + suffix + output_path.extension().string());
+        ok = writeText(size_path.string(), texts[i]) && ok;
+    }
+    return ok;
+}
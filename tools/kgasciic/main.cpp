@@ -0,0 +1,95 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <common/cmdline_tool.hpp>
+#include <common/ascii_client.hpp>
+
+
+class AsciiClientTool: public CmdlineTool
+{
+public:
+    AsciiClientTool();
+
+protected:
+    bool processArgs();
+
+    int doExecute();
+
+private:
+    std::string socketPath_;
+    std::string inputFile_;
+    std::string outputFile_;
+    AsciiProtocol::Request request_;
+};
+
+int main(int argc, char* argv[])
+{
+    return AsciiClientTool().execute(argc, argv);
+}
+
+AsciiClientTool::AsciiClientTool()
+    :CmdlineTool("Options")
+{
+    using namespace boost::program_options;
+    desc_.add_options()
+        ("socket,s", value(&socketPath_)->default_value("/tmp/kgasciid.sock"), "kgasciid socket path")
+        ("input-file,i", value(&inputFile_), "input image file")
+        ("output-file,o", value(&outputFile_), "output text file (default stdout)")
+        ("font-file,f", value(&request_.font_file), "font file (default chosen by the daemon)")
+        ("algorithm,a", value(&request_.algorithm), "glyph matching algorithm (default chosen by the daemon)")
+        ("cols,c", value(&request_.cols)->default_value(79), "suggested number of text columns")
+        ("rows,r", value(&request_.rows)->default_value(49), "suggested number of text rows")
+    ;
+    posDesc_.add("input-file", 1);
+}
+
+bool AsciiClientTool::processArgs()
+{
+    requireOption("input-file");
+    return true;
+}
+
+int AsciiClientTool::doExecute()
+{
+    std::ifstream fin(inputFile_.c_str(), std::ios_base::in | std::ios_base::binary);
+    if (!fin) {
+        std::cerr << "problem opening " << inputFile_ << "\n";
+        return -1;
+    }
+    //the daemon decodes the image, it is sent as is
+    request_.format = AsciiProtocol::ENCODED_IMAGE;
+    request_.data.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+
+    AsciiProtocol::Response response;
+    AsciiClient client(socketPath_);
+    client.convert(request_, response);
+    if (!response.ok) {
+        std::cerr << "conversion failed: " << response.error << "\n";
+        return -1;
+    }
+
+    if (outputFile_.empty()) {
+        std::cout << response.text;
+    } else {
+        std::ofstream fout(outputFile_.c_str());
+        fout << response.text;
+    }
+    return 0;
+}
@@ -0,0 +1,318 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include "ascii_server.hpp"
+#include <cerrno>
+#include <csignal>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <boost/array.hpp>
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/format.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <common/cast_surface.hpp>
+#include <kgascii/sequential_asciifier.hpp>
+#include <kgascii/text_surface.hpp>
+
+using namespace KG::Ascii;
+
+namespace {
+
+//larger requests are rejected, they are most likely garbage
+const unsigned MAX_TEXT_SIZE = 1000;
+const unsigned DEFAULT_COLS = 79;
+const unsigned DEFAULT_ROWS = 49;
+//accepting again right after running out of descriptors or memory only spins
+const long ACCEPT_RETRY_DELAY_MS = 100;
+
+bool isResourceError(const boost::system::error_code& err)
+{
+    return err == boost::asio::error::no_descriptors
+            || err == boost::system::errc::too_many_files_open_in_system
+            || err == boost::asio::error::no_buffer_space
+            || err == boost::asio::error::no_memory;
+}
+
+// A socket file left behind by a previous instance prevents binding.
+// It is removed only when nothing accepts connections on it any more;
+// another file, or the socket of a running server, is left alone.
+void removeStaleSocket(boost::asio::io_service& io, const std::string& socket_path)
+{
+    struct stat st;
+    if (lstat(socket_path.c_str(), &st) != 0) {
+        if (errno == ENOENT)
+            return;
+        throw std::runtime_error("can not access " + socket_path);
+    }
+    if (!S_ISSOCK(st.st_mode))
+        throw std::runtime_error(socket_path + " exists and is not a socket");
+
+    boost::asio::local::stream_protocol::socket probe(io);
+    boost::system::error_code err;
+    probe.connect(boost::asio::local::stream_protocol::endpoint(socket_path), err);
+    if (!err)
+        throw std::runtime_error("another server is listening on " + socket_path);
+    if (err != boost::asio::error::connection_refused)
+        throw std::runtime_error("can not probe " + socket_path + ": " + err.message());
+
+    if (unlink(socket_path.c_str()) != 0)
+        throw std::runtime_error("can not remove stale socket " + socket_path);
+}
+
+} // namespace
+
+class AsciiServer::Session: public boost::enable_shared_from_this<Session>, boost::noncopyable
+{
+public:
+    Session(AsciiServer* server, boost::asio::io_service& io)
+        :server_(server)
+        ,socket_(io)
+    {
+    }
+
+    boost::asio::local::stream_protocol::socket& socket()
+    {
+        return socket_;
+    }
+
+    void start()
+    {
+        boost::asio::async_read(socket_, boost::asio::buffer(header_, AsciiProtocol::HEADER_SIZE),
+            boost::bind(&Session::handleHeader, shared_from_this(), boost::asio::placeholders::error));
+    }
+
+private:
+    void handleHeader(const boost::system::error_code& err)
+    {
+        if (err)
+            return;
+        try {
+            payload_.resize(AsciiProtocol::decodeHeader(header_));
+        } catch (const std::exception& e) {
+            server_->log(e.what());
+            return;
+        }
+        boost::asio::async_read(socket_, boost::asio::buffer(payload_),
+            boost::bind(&Session::handlePayload, shared_from_this(), boost::asio::placeholders::error));
+    }
+
+    void handlePayload(const boost::system::error_code& err)
+    {
+        if (err)
+            return;
+
+        AsciiProtocol::Request req;
+        AsciiProtocol::Response resp;
+        try {
+            AsciiProtocol::decodeRequest(payload_, req);
+        } catch (const std::exception& e) {
+            //the stream can not be trusted anymore, drop the connection
+            server_->log(e.what());
+            return;
+        }
+        server_->process(req, resp);
+
+        AsciiProtocol::encodeResponse(resp, payload_);
+        AsciiProtocol::encodeHeader(payload_.size(), header_);
+        boost::array<boost::asio::const_buffer, 2> buffers = { {
+            boost::asio::buffer(header_, AsciiProtocol::HEADER_SIZE),
+            boost::asio::buffer(payload_)
+        } };
+        boost::asio::async_write(socket_, buffers,
+            boost::bind(&Session::handleWrite, shared_from_this(), boost::asio::placeholders::error));
+    }
+
+    void handleWrite(const boost::system::error_code& err)
+    {
+        if (err)
+            return;
+        start();
+    }
+
+private:
+    AsciiServer* server_;
+    boost::asio::local::stream_protocol::socket socket_;
+    char header_[AsciiProtocol::HEADER_SIZE];
+    std::vector<char> payload_;
+};
+
+AsciiServer::AsciiServer(MatcherCache& cache, std::ostream& log)
+    :cache_(cache)
+    ,log_(log)
+    ,acceptor_(io_)
+    ,acceptTimer_(io_)
+    ,signals_(io_, SIGINT, SIGTERM)
+{
+}
+
+void AsciiServer::run(const Parameters& params)
+{
+    params_ = params;
+
+    removeStaleSocket(io_, params_.socket_path);
+    boost::asio::local::stream_protocol::endpoint endpoint(params_.socket_path);
+    acceptor_.open(endpoint.protocol());
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+    //the file is removed on exit only if it is still the one bound here
+    struct stat bound_st;
+    if (lstat(params_.socket_path.c_str(), &bound_st) != 0)
+        throw std::runtime_error("can not access " + params_.socket_path);
+
+    signals_.async_wait(boost::bind(&AsciiServer::stop, this));
+    startAccept();
+
+    unsigned thread_count = params_.thread_count;
+    if (thread_count == 0) {
+        thread_count = std::max(boost::thread::hardware_concurrency(), 1u);
+    }
+    log(str(boost::format("listening on %1% with %2% threads") % params_.socket_path % thread_count));
+
+    boost::thread_group group;
+    for (unsigned i = 1; i < thread_count; ++i) {
+        group.create_thread(boost::bind(&boost::asio::io_service::run, &io_));
+    }
+    io_.run();
+    group.join_all();
+
+    acceptor_.close();
+    struct stat st;
+    if (lstat(params_.socket_path.c_str(), &st) == 0 
+            && st.st_dev == bound_st.st_dev && st.st_ino == bound_st.st_ino) {
+        unlink(params_.socket_path.c_str());
+    }
+    log("stopped");
+}
+
+void AsciiServer::stop()
+{
+    io_.stop();
+}
+
+void AsciiServer::process(const AsciiProtocol::Request& req, AsciiProtocol::Response& resp)
+{
+    try {
+        convert(req, resp);
+        resp.ok = true;
+    } catch (const std::exception& e) {
+        resp = AsciiProtocol::Response();
+        resp.error = e.what();
+    }
+}
+
+void AsciiServer::log(const std::string& msg)
+{
+    boost::unique_lock<boost::mutex> lock(logMutex_);
+    log_ << msg << std::endl;
+}
+
+void AsciiServer::startAccept()
+{
+    boost::shared_ptr<Session> session(new Session(this, io_));
+    acceptor_.async_accept(session->socket(),
+        boost::bind(&AsciiServer::handleAccept, this, session, boost::asio::placeholders::error));
+}
+
+void AsciiServer::handleAccept(boost::shared_ptr<Session> session, const boost::system::error_code& err)
+{
+    if (!err) {
+        session->start();
+    } else {
+        log(err.message());
+        if (isResourceError(err)) {
+            acceptTimer_.expires_from_now(boost::posix_time::milliseconds(ACCEPT_RETRY_DELAY_MS));
+            acceptTimer_.async_wait(boost::bind(&AsciiServer::handleAcceptDelay, this, boost::asio::placeholders::error));
+            return;
+        }
+    }
+    startAccept();
+}
+
+void AsciiServer::handleAcceptDelay(const boost::system::error_code& err)
+{
+    if (!err) {
+        startAccept();
+    }
+}
+
+void AsciiServer::convert(const AsciiProtocol::Request& req, AsciiProtocol::Response& resp)
+{
+    typedef MatcherCache::DynamicGlyphMatcherT DynamicGlyphMatcherT;
+
+    std::string font_file = req.font_file.empty() ? params_.default_font : req.font_file;
+    std::string algorithm = req.algorithm.empty() ? params_.default_algorithm : req.algorithm;
+    if (font_file.empty())
+        throw std::runtime_error("no font file");
+
+    unsigned max_cols = req.cols > 0 ? req.cols : DEFAULT_COLS;
+    unsigned max_rows = req.rows > 0 ? req.rows : DEFAULT_ROWS;
+    if (max_cols > MAX_TEXT_SIZE || max_rows > MAX_TEXT_SIZE)
+        throw std::runtime_error("text size too large");
+
+    boost::shared_ptr<const DynamicGlyphMatcherT> matcher = cache_.get(font_file, algorithm);
+
+    cv::Mat gray_image;
+    if (req.format == AsciiProtocol::ENCODED_IMAGE) {
+        if (req.data.empty())
+            throw std::runtime_error("empty image");
+        cv::Mat encoded(1, req.data.size(), CV_8UC1, const_cast<char*>(&req.data[0]));
+        gray_image = cv::imdecode(encoded, CV_LOAD_IMAGE_GRAYSCALE);
+        if (gray_image.empty())
+            throw std::runtime_error("problem decoding image");
+    } else {
+        if (req.width == 0 || req.height == 0)
+            throw std::runtime_error("empty image");
+        gray_image = cv::Mat(req.height, req.width, CV_8UC1, const_cast<char*>(&req.data[0]));
+    }
+
+    unsigned char_width = matcher->cellWidth();
+    unsigned char_height = matcher->cellHeight();
+    unsigned frame_width = gray_image.cols;
+    unsigned frame_height = gray_image.rows;
+
+    unsigned hint_width = max_cols * char_width;
+    unsigned hint_height = max_rows * char_height;
+    unsigned out_width, out_height;
+    if (hint_width * frame_height / frame_width < hint_height) {
+        out_width = hint_width;
+        out_height = std::max(out_width * frame_height / frame_width, 1u);
+    } else {
+        out_height = hint_height;
+        out_width = std::max(out_height * frame_width / frame_height, 1u);
+    }
+
+    cv::Mat scaled_image;
+    cv::resize(gray_image, scaled_image, cv::Size(out_width, out_height), 0, 0, cv::INTER_AREA);
+    boost::gil::gray8c_view_t scaled_view = castSurface<const boost::gil::gray8_pixel_t>(scaled_image);
+
+    TextSurface text((out_height + char_height - 1) / char_height, (out_width + char_width - 1) / char_width);
+    SequentialAsciifier<DynamicGlyphMatcherT> asciifier(matcher);
+    asciifier.generate(scaled_view, text);
+
+    resp.cols = text.cols();
+    resp.rows = text.rows();
+    resp.text.clear();
+    resp.text.reserve((text.cols() + 1) * text.rows());
+    for (size_t r = 0; r < text.rows(); ++r) {
+        for (size_t c = 0; c < text.cols(); ++c)
+            resp.text += text(r, c).charValue();
+        resp.text += '\n';
+    }
+}
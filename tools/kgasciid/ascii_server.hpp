@@ -0,0 +1,81 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_TOOLS_KGASCIID_ASCII_SERVER_HPP
+#define KGASCII_TOOLS_KGASCIID_ASCII_SERVER_HPP
+
+#include <string>
+#include <ostream>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/asio.hpp>
+#include <common/ascii_protocol.hpp>
+#include "matcher_cache.hpp"
+
+
+// Accepts kgasciid connections on a Unix domain socket.
+// All sessions are served asynchronously by one pool of threads running
+// the io_service; a request is converted on the thread that received it.
+// A connection may send any number of requests, one at a time.
+class AsciiServer: boost::noncopyable
+{
+public:
+    struct Parameters
+    {
+        std::string socket_path;
+        std::string default_font;
+        std::string default_algorithm;
+        unsigned thread_count;
+    };
+
+public:
+    AsciiServer(MatcherCache& cache, std::ostream& log);
+
+    // Serves requests until stop() is called or SIGINT/SIGTERM is received.
+    void run(const Parameters& params);
+
+    void stop();
+
+    // Thread safe, never throws; failures are reported in the response.
+    void process(const AsciiProtocol::Request& req, AsciiProtocol::Response& resp);
+
+    void log(const std::string& msg);
+
+private:
+    class Session;
+
+    void startAccept();
+
+    void handleAccept(boost::shared_ptr<Session> session, const boost::system::error_code& err);
+
+    void handleAcceptDelay(const boost::system::error_code& err);
+
+    void convert(const AsciiProtocol::Request& req, AsciiProtocol::Response& resp);
+
+private:
+    MatcherCache& cache_;
+    std::ostream& log_;
+    boost::mutex logMutex_;
+    Parameters params_;
+    boost::asio::io_service io_;
+    boost::asio::local::stream_protocol::acceptor acceptor_;
+    boost::asio::deadline_timer acceptTimer_;
+    boost::asio::signal_set signals_;
+};
+
+#endif // KGASCII_TOOLS_KGASCIID_ASCII_SERVER_HPP
@@ -0,0 +1,100 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include <iostream>
+#include <vector>
+#include <common/cmdline_tool.hpp>
+#include "matcher_cache.hpp"
+#include "ascii_server.hpp"
+
+
+class AsciiDaemon: public CmdlineTool
+{
+public:
+    AsciiDaemon();
+
+protected:
+    bool processArgs();
+
+    int doExecute();
+
+private:
+    AsciiServer::Parameters params_;
+    std::vector<std::string> preloadAlgorithms_;
+    std::vector<std::string> allowedFonts_;
+    std::vector<std::string> fontDirectories_;
+    unsigned cacheSize_;
+};
+
+int main(int argc, char* argv[])
+{
+    return AsciiDaemon().execute(argc, argv);
+}
+
+AsciiDaemon::AsciiDaemon()
+    :CmdlineTool("Options")
+{
+    using namespace boost::program_options;
+    desc_.add_options()
+        ("socket,s", value(&params_.socket_path)->default_value("/tmp/kgasciid.sock"), "unix domain socket path")
+        ("font-file,f", value(&params_.default_font), "default font file")
+        ("algorithm,a", value(&params_.default_algorithm)->default_value("pca"), "default glyph matching algorithm")
+        ("threads", value(&params_.thread_count)->default_value(0), "worker thread count (0 = auto)")
+        ("preload,p", value(&preloadAlgorithms_)->composing(), "algorithm to build for the default font at startup")
+        ("allow-font", value(&allowedFonts_)->composing(), "font file clients may request (besides the default font)")
+        ("font-dir", value(&fontDirectories_)->composing(), "directory whose fonts clients may request")
+        ("cache-size", value(&cacheSize_)->default_value(16), "number of glyph matchers and fonts kept loaded")
+    ;
+}
+
+bool AsciiDaemon::processArgs()
+{
+    if (!preloadAlgorithms_.empty()) {
+        requireOption("font-file");
+    }
+    return true;
+}
+
+int AsciiDaemon::doExecute()
+{
+    //clients may only name fonts the daemon was told about
+    MatcherCache cache(cacheSize_);
+    if (!params_.default_font.empty()) {
+        cache.allowFont(params_.default_font);
+    }
+    for (size_t i = 0; i < allowedFonts_.size(); ++i) {
+        cache.allowFont(allowedFonts_[i]);
+    }
+    for (size_t i = 0; i < fontDirectories_.size(); ++i) {
+        cache.allowFontDirectory(fontDirectories_[i]);
+    }
+
+    if (!params_.default_font.empty()) {
+        //a broken default font is better reported now than by the first request
+        std::cerr << "loading " << params_.default_font << " " << params_.default_algorithm << "\n";
+        cache.get(params_.default_font, params_.default_algorithm);
+    }
+    for (size_t i = 0; i < preloadAlgorithms_.size(); ++i) {
+        std::cerr << "loading " << params_.default_font << " " << preloadAlgorithms_[i] << "\n";
+        cache.get(params_.default_font, preloadAlgorithms_[i]);
+    }
+
+    AsciiServer server(cache, std::cerr);
+    server.run(params_);
+
+    return 0;
+}
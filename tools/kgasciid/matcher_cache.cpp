@@ -0,0 +1,156 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include "matcher_cache.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <kgascii/font_io.hpp>
+#include <kgascii/mapped_font.hpp>
+#include <kgascii/glyph_matcher_context_factory.hpp>
+#include <common/remote_algorithm.hpp>
+
+using namespace KG::Ascii;
+
+
+MatcherCache::MatcherCache(size_t capacity)
+    :capacity_(std::max<size_t>(capacity, 1))
+    ,useCounter_(0)
+{
+    registerGlyphMatcherFactories<FontImageT>();
+}
+
+void MatcherCache::allowFont(const std::string& font_file)
+{
+    allowedFonts_.insert(boost::filesystem::canonical(font_file).string());
+}
+
+void MatcherCache::allowFontDirectory(const std::string& dir)
+{
+    allowedDirectories_.insert(boost::filesystem::canonical(dir).string());
+}
+
+boost::shared_ptr<const MatcherCache::DynamicGlyphMatcherT> MatcherCache::get(const std::string& font_file, const std::string& algorithm)
+{
+    std::string font_path = checkFont(font_file);
+    std::string spec = checkRemoteAlgorithm(algorithm);
+    MatcherKeyT key(font_path, spec);
+    boost::shared_ptr<MatcherEntryT> entry = acquireEntry(matchers_, key);
+
+    boost::unique_lock<boost::mutex> lock(entry->mutex);
+    if (!entry->value) {
+        try {
+            boost::shared_ptr<const FontImageT> font_image = getFontImage(font_path);
+            entry->value = GlyphMatcherFactory::create(font_image, spec);
+        } catch (...) {
+            //bad algorithm strings must not pile up in the cache
+            dropEntry(matchers_, key, entry);
+            throw;
+        }
+    }
+    return entry->value;
+}
+
+size_t MatcherCache::fontCount() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    return fonts_.size();
+}
+
+size_t MatcherCache::matcherCount() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    return matchers_.size();
+}
+
+std::string MatcherCache::checkFont(const std::string& font_file) const
+{
+    namespace fs = boost::filesystem;
+
+    boost::system::error_code err;
+    fs::path font_path = fs::canonical(font_file, err);
+    if (!err) {
+        if (allowedFonts_.count(font_path.string()))
+            return font_path.string();
+        for (fs::path dir = font_path.parent_path(); !dir.empty(); dir = dir.parent_path()) {
+            if (allowedDirectories_.count(dir.string()))
+                return font_path.string();
+            if (dir == dir.root_path())
+                break;
+        }
+    }
+    boost::format fmt_err("font %1% is not allowed");
+    throw std::runtime_error(str(fmt_err % font_file));
+}
+
+boost::shared_ptr<const MatcherCache::FontImageT> MatcherCache::getFontImage(const std::string& font_file)
+{
+    boost::shared_ptr<FontEntryT> entry = acquireEntry(fonts_, font_file);
+
+    boost::unique_lock<boost::mutex> lock(entry->mutex);
+    if (!entry->value) {
+        try {
+            //binary fonts are mapped and shared with other processes
+            entry->value = loadFontImage<FontImageT>(font_file);
+        } catch (...) {
+            dropEntry(fonts_, font_file, entry);
+            throw;
+        }
+    }
+    return entry->value;
+}
+
+// Finds or inserts the entry of the key and marks it as used. Inserting
+// evicts the least recently used entry once there are too many; whoever
+// is still building or using an evicted entry keeps it alive.
+template<class TKey, class TEntry>
+boost::shared_ptr<TEntry> MatcherCache::acquireEntry(std::map<TKey, boost::shared_ptr<TEntry> >& entries, const TKey& key)
+{
+    typedef typename std::map<TKey, boost::shared_ptr<TEntry> >::iterator IteratorT;
+
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    boost::shared_ptr<TEntry>& slot = entries[key];
+    if (!slot) {
+        slot.reset(new TEntry);
+    }
+    slot->lastUse = ++useCounter_;
+    boost::shared_ptr<TEntry> entry = slot;
+
+    while (entries.size() > capacity_) {
+        IteratorT oldest = entries.begin();
+        for (IteratorT it = entries.begin(); it != entries.end(); ++it) {
+            if (it->second->lastUse < oldest->second->lastUse) {
+                oldest = it;
+            }
+        }
+        entries.erase(oldest);
+    }
+    return entry;
+}
+
+template<class TKey, class TEntry>
+void MatcherCache::dropEntry(std::map<TKey, boost::shared_ptr<TEntry> >& entries, const TKey& key, 
+        const boost::shared_ptr<TEntry>& entry)
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    typename std::map<TKey, boost::shared_ptr<TEntry> >::iterator it = entries.find(key);
+    //the entry may have been evicted and replaced meanwhile
+    if (it != entries.end() && it->second == entry) {
+        entries.erase(it);
+    }
+}
@@ -0,0 +1,103 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_TOOLS_KGASCIID_MATCHER_CACHE_HPP
+#define KGASCII_TOOLS_KGASCIID_MATCHER_CACHE_HPP
+
+#include <string>
+#include <map>
+#include <set>
+#include <utility>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <kgascii/font.hpp>
+#include <kgascii/font_image.hpp>
+#include <kgascii/dynamic_glyph_matcher.hpp>
+
+
+// Keeps loaded fonts, font images and fully built glyph matchers
+// (including PCA decompositions) between requests.
+// Algorithm strings come from clients and are checked with
+// checkRemoteAlgorithm(); matchers are keyed by font file and the checked
+// string. Each entry is built once, by the first request that needs it;
+// requests for other entries are not blocked meanwhile. Entries that fail
+// to build are dropped, and at most capacity matchers and fonts are kept,
+// the least recently used ones are evicted first.
+// Only fonts allowed with allowFont() or allowFontDirectory() are loaded.
+class MatcherCache: boost::noncopyable
+{
+public:
+    typedef KG::Ascii::Font<> FontT;
+    typedef KG::Ascii::FontImage<FontT> FontImageT;
+    typedef KG::Ascii::DynamicGlyphMatcher<FontImageT> DynamicGlyphMatcherT;
+
+public:
+    explicit MatcherCache(size_t capacity=16);
+
+    void allowFont(const std::string& font_file);
+
+    // Allows the fonts in the directory and its subdirectories.
+    void allowFontDirectory(const std::string& dir);
+
+    boost::shared_ptr<const DynamicGlyphMatcherT> get(const std::string& font_file, const std::string& algorithm);
+
+    size_t fontCount() const;
+
+    size_t matcherCount() const;
+
+private:
+    // Canonical path of an allowed font, throws for other files.
+    std::string checkFont(const std::string& font_file) const;
+
+    boost::shared_ptr<const FontImageT> getFontImage(const std::string& font_file);
+
+private:
+    template<class T>
+    struct Entry: boost::noncopyable
+    {
+        Entry()
+            :lastUse(0)
+        {
+        }
+
+        boost::mutex mutex;
+        boost::shared_ptr<const T> value;
+        //guarded by the cache mutex
+        unsigned long lastUse;
+    };
+    typedef Entry<FontImageT> FontEntryT;
+    typedef Entry<DynamicGlyphMatcherT> MatcherEntryT;
+    typedef std::pair<std::string, std::string> MatcherKeyT;
+
+    template<class TKey, class TEntry>
+    boost::shared_ptr<TEntry> acquireEntry(std::map<TKey, boost::shared_ptr<TEntry> >& entries, const TKey& key);
+
+    template<class TKey, class TEntry>
+    void dropEntry(std::map<TKey, boost::shared_ptr<TEntry> >& entries, const TKey& key, 
+            const boost::shared_ptr<TEntry>& entry);
+
+    size_t capacity_;
+    std::set<std::string> allowedFonts_;
+    std::set<std::string> allowedDirectories_;
+    mutable boost::mutex mutex_;
+    unsigned long useCounter_;
+    std::map<std::string, boost::shared_ptr<FontEntryT> > fonts_;
+    std::map<MatcherKeyT, boost::shared_ptr<MatcherEntryT> > matchers_;
+};
+
+#endif // KGASCII_TOOLS_KGASCIID_MATCHER_CACHE_HPP
@@ -0,0 +1,187 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <vector>
+#include <cstdlib>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <common/cmdline_tool.hpp>
+#include <common/ascii_client.hpp>
+
+
+class AsciiLoadTest: public CmdlineTool
+{
+public:
+    AsciiLoadTest();
+
+protected:
+    bool processArgs();
+
+    int doExecute();
+
+private:
+    struct ConnectionStats
+    {
+        ConnectionStats()
+            :failed(0)
+        {
+        }
+
+        std::vector<double> latencies;
+        unsigned failed;
+        std::string error;
+    };
+
+    void connectionFunc(ConnectionStats& stats) const;
+
+private:
+    std::string socketPath_;
+    std::string inputFile_;
+    unsigned imageWidth_;
+    unsigned imageHeight_;
+    unsigned connectionCount_;
+    unsigned requestCount_;
+    AsciiProtocol::Request request_;
+};
+
+int main(int argc, char* argv[])
+{
+    return AsciiLoadTest().execute(argc, argv);
+}
+
+AsciiLoadTest::AsciiLoadTest()
+    :CmdlineTool("Options")
+{
+    using namespace boost::program_options;
+    desc_.add_options()
+        ("socket,s", value(&socketPath_)->default_value("/tmp/kgasciid.sock"), "kgasciid socket path")
+        ("input-file,i", value(&inputFile_), "input image file (default synthetic gray image)")
+        ("width", value(&imageWidth_)->default_value(640), "synthetic image width")
+        ("height", value(&imageHeight_)->default_value(480), "synthetic image height")
+        ("font-file,f", value(&request_.font_file), "font file (default chosen by the daemon)")
+        ("algorithm,a", value(&request_.algorithm), "glyph matching algorithm (default chosen by the daemon)")
+        ("cols,c", value(&request_.cols)->default_value(79), "suggested number of text columns")
+        ("rows,r", value(&request_.rows)->default_value(49), "suggested number of text rows")
+        ("connections,n", value(&connectionCount_)->default_value(4), "number of concurrent connections")
+        ("requests", value(&requestCount_)->default_value(100), "number of requests per connection")
+    ;
+    posDesc_.add("input-file", 1);
+}
+
+bool AsciiLoadTest::processArgs()
+{
+    if (connectionCount_ == 0 || requestCount_ == 0)
+        throw std::logic_error("connection and request counts must be positive");
+    if (inputFile_.empty() && (imageWidth_ == 0 || imageHeight_ == 0))
+        throw std::logic_error("synthetic image size must be positive");
+    return true;
+}
+
+int AsciiLoadTest::doExecute()
+{
+    using namespace boost::posix_time;
+
+    if (!inputFile_.empty()) {
+        std::ifstream fin(inputFile_.c_str(), std::ios_base::in | std::ios_base::binary);
+        if (!fin) {
+            std::cerr << "problem opening " << inputFile_ << "\n";
+            return -1;
+        }
+        request_.format = AsciiProtocol::ENCODED_IMAGE;
+        request_.data.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+    } else {
+        //noisy gradient, so that matching is not trivially cheap
+        request_.format = AsciiProtocol::RAW_GRAY8;
+        request_.width = imageWidth_;
+        request_.height = imageHeight_;
+        request_.data.resize(imageWidth_ * imageHeight_);
+        srand(0);
+        for (unsigned y = 0; y < imageHeight_; ++y) {
+            for (unsigned x = 0; x < imageWidth_; ++x) {
+                request_.data[y * imageWidth_ + x] = static_cast<char>((x + y + rand() % 64) & 0xff);
+            }
+        }
+    }
+
+    std::vector<ConnectionStats> stats(connectionCount_);
+
+    ptime start_time = microsec_clock::universal_time();
+    boost::thread_group group;
+    for (unsigned i = 0; i < connectionCount_; ++i) {
+        group.create_thread(boost::bind(&AsciiLoadTest::connectionFunc, this, boost::ref(stats[i])));
+    }
+    group.join_all();
+    double elapsed = (microsec_clock::universal_time() - start_time).total_microseconds() / 1e6;
+
+    std::vector<double> latencies;
+    unsigned failed = 0;
+    for (unsigned i = 0; i < connectionCount_; ++i) {
+        latencies.insert(latencies.end(), stats[i].latencies.begin(), stats[i].latencies.end());
+        failed += stats[i].failed;
+        if (!stats[i].error.empty()) {
+            std::cerr << "connection " << i << ": " << stats[i].error << "\n";
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    std::cout << "connections " << connectionCount_ << "\n";
+    std::cout << "completed requests " << latencies.size() << "\n";
+    std::cout << "failed requests " << failed << "\n";
+    std::cout << "elapsed time " << elapsed << "\n";
+    if (!latencies.empty()) {
+        double sum = 0;
+        for (size_t i = 0; i < latencies.size(); ++i) {
+            sum += latencies[i];
+        }
+        std::cout << "requests / second " << latencies.size() / elapsed << "\n";
+        std::cout << "latency avg " << sum / latencies.size() << "\n";
+        std::cout << "latency p50 " << latencies[latencies.size() / 2] << "\n";
+        std::cout << "latency p95 " << latencies[latencies.size() * 95 / 100] << "\n";
+        std::cout << "latency p99 " << latencies[latencies.size() * 99 / 100] << "\n";
+        std::cout << "latency max " << latencies.back() << "\n";
+    }
+    return failed > 0 ? -1 : 0;
+}
+
+void AsciiLoadTest::connectionFunc(ConnectionStats& stats) const
+{
+    using namespace boost::posix_time;
+
+    try {
+        AsciiClient client(socketPath_);
+        AsciiProtocol::Response response;
+        for (unsigned i = 0; i < requestCount_; ++i) {
+            ptime start_time = microsec_clock::universal_time();
+            client.convert(request_, response);
+            ptime end_time = microsec_clock::universal_time();
+            if (response.ok) {
+                stats.latencies.push_back((end_time - start_time).total_microseconds() / 1e6);
+            } else {
+                stats.failed++;
+                stats.error = response.error;
+            }
+        }
+    } catch (const std::exception& e) {
+        stats.failed += requestCount_ - stats.latencies.size() - stats.failed;
+        stats.error = e.what();
+    }
+}
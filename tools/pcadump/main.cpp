@@ -43,7 +43,12 @@ PcaDump::PcaDump()
     using namespace boost::program_options;
     desc_.add_options()
         ("font-file,f", value<std::string>(), "input dsc file")
+        ("base-font", value<std::string>(), "analyze this subset of the font first, then add the other glyphs")
         ("nfeatures,n", value<unsigned>(), "number of features to extract")
+        ("method,m", value<KG::Ascii::PcaMethod>()->default_value(KG::Ascii::PcaMethod::Auto), "analysis method (auto|covariance|gram|truncated)")
+        ("threads,t", value<unsigned>()->default_value(0), "number of analysis threads (0 = auto)")
+        ("validate", "compare the components with those of the covariance method")
+        ("quant-report", "compare the quantized matchers with the float one")
         ("output-dsc", value<std::string>(), "output reconstructed dsc file")
         ("output-features", value<std::string>(), "output extracted feature masks")
     ;
@@ -63,6 +68,13 @@ int PcaDump::doExecute()
     RenderPcaCommand::Parameters params;
     params.font_file = vm_["font-file"].as<std::string>();
     params.feature_cnt = vm_["nfeatures"].as<unsigned>();
+    if (!vm_["base-font"].empty()) {
+        params.base_font_file = vm_["base-font"].as<std::string>();
+    }
+    params.method = vm_["method"].as<KG::Ascii::PcaMethod>();
+    params.thread_count = vm_["threads"].as<unsigned>();
+    params.validate = vm_.count("validate") > 0;
+    params.quant_report = vm_.count("quant-report") > 0;
     if (!vm_["output-dsc"].empty()) {
         params.reconstructed_font_file = vm_["output-dsc"].as<std::string>();
     }
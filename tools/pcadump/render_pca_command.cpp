@@ -16,16 +16,27 @@
 // along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
 
 #include "render_pca_command.hpp"
+#include <cmath>
 #include <boost/throw_exception.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <kgutil/image_io.hpp>
 #include <kgascii/font_image.hpp>
 #include <kgascii/font_io.hpp>
 #include <kgascii/font_pca.hpp>
+#include <kgascii/matcher_benchmark.hpp>
+#include <kgascii/pca_glyph_matcher.hpp>
 #include <kgascii/pca_reconstruction_font_loader.hpp>
 
 using namespace KG::Ascii;
 using namespace KG::Util;
 
+namespace {
+
+//size of the sample used by the quantization report, the asciitune default
+const unsigned QUANT_REPORT_ROWS = 49;
+const unsigned QUANT_REPORT_COLS = 79;
+
+} // namespace
 
 RenderPcaCommand::RenderPcaCommand(std::ostream& ostr)
     :log_(ostr)
@@ -102,12 +113,51 @@ void RenderPcaCommand::execute(const Parameters& params)
     }
     boost::shared_ptr<FontImageT> image(new FontImageT(font));
 
-    boost::shared_ptr<FontEigendecompositionT> decomposition(new FontEigendecompositionT(image));
+    boost::shared_ptr<FontImageT> base_image = image;
+    if (!params.base_font_file.empty()) {
+        boost::shared_ptr<FontT> base_font(new FontT);
+        if (!base_font->load(params.base_font_file)) {
+            BOOST_THROW_EXCEPTION(std::runtime_error("base font loading error"));
+        }
+        base_image.reset(new FontImageT(base_font));
+    }
+
+    boost::shared_ptr<FontEigendecompositionT> decomposition(new FontEigendecompositionT(base_image));
+    decomposition->setThreadCount(params.thread_count);
+    PcaMethod method = params.method;
+    if (method == PcaMethod::Auto) {
+        method = decomposition->chooseMethod(params.feature_cnt);
+    }
+    boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+    decomposition->analyze(method, params.feature_cnt);
+    boost::posix_time::time_duration analysis_time = boost::posix_time::microsec_clock::universal_time() - start_time;
+
+    boost::posix_time::time_duration update_time;
+    if (base_image != image) {
+        start_time = boost::posix_time::microsec_clock::universal_time();
+        if (!decomposition->update(image)) {
+            BOOST_THROW_EXCEPTION(std::runtime_error("font does not contain all glyphs of the base font"));
+        }
+        update_time = boost::posix_time::microsec_clock::universal_time() - start_time;
+    }
+
     boost::shared_ptr<FontPrincipalComponentsT> pca(new FontPrincipalComponentsT(decomposition, params.feature_cnt));
 
+    log_ << "method: " << method << "\n";
+    log_ << "analysis time: " << analysis_time.total_milliseconds() << " ms\n";
+    if (base_image != image) {
+        log_ << "update time: " << update_time.total_milliseconds() << " ms (" 
+             << image->glyphCount() - base_image->glyphCount() << " glyphs added)\n";
+    }
     log_ << "features: " << pca->featureCount() << "\n";
-    log_ << "energy: " << pca->energies().sum() / decomposition->energies().sum() << "\n";
+    log_ << "energy: " << decomposition->energies().head(pca->featureCount()).sum() / decomposition->totalEnergy() << "\n";
 
+    if (params.validate) {
+        validate(*decomposition, pca->featureCount());
+    }
+    if (params.quant_report) {
+        reportQuantization(boost::shared_ptr<const FontPrincipalComponentsT>(pca));
+    }
     if (!params.features_file.empty()) {
         dumpFeatures(pca, params.features_file);
     }
@@ -115,3 +165,64 @@ void RenderPcaCommand::execute(const Parameters& params)
         dumpDsc(pca, params.reconstructed_font_file);
     }
 }
+
+// Compares the first feature_cnt components with those of the covariance
+// method: the relative difference of their energies and the cosine of the
+// angle between them (its sign is arbitrary). Components of nearly equal
+// energy may be mixed up without harm, the share of the reference energy
+// captured by all of them together shows that.
+template<class TFontEigendecomposition>
+void RenderPcaCommand::validate(const TFontEigendecomposition& decomposition, size_t feature_cnt)
+{
+    TFontEigendecomposition reference(decomposition.font());
+    reference.setThreadCount(decomposition.threadCount());
+    reference.analyze(PcaMethod::Covariance);
+
+    double max_energy_error = 0;
+    double min_alignment = 1;
+    double captured_energy = 0;
+    double reference_energy = 0;
+    for (size_t i = 0; i < feature_cnt && i < reference.componentCount(); ++i) {
+        double ref_energy = reference.energies()[i];
+        double energy_error = std::fabs(decomposition.energies()[i] - ref_energy) / std::max(ref_energy, 1e-12);
+        double alignment = std::fabs(decomposition.features().col(i).dot(reference.features().col(i)));
+        log_ << "component " << i << ": energy " << decomposition.energies()[i] 
+             << " (reference " << ref_energy << "), alignment " << alignment << "\n";
+        max_energy_error = std::max(max_energy_error, energy_error);
+        min_alignment = std::min(min_alignment, alignment);
+        captured_energy += decomposition.energies()[i];
+        reference_energy += ref_energy;
+    }
+    log_ << "max energy error: " << max_energy_error << "\n";
+    log_ << "min alignment: " << min_alignment << "\n";
+    log_ << "captured energy: " << captured_energy / std::max(reference_energy, 1e-12) << "\n";
+}
+
+// Compares the quantized matchers (pca:quant=16 and pca:quant=8) with the
+// float one on the benchmark sample: the fraction of cells for which they
+// pick the same symbol, and the time spent on a cell.
+template<class TFontPrincipalComponents>
+void RenderPcaCommand::reportQuantization(boost::shared_ptr<const TFontPrincipalComponents> pca)
+{
+    typedef typename TFontPrincipalComponents::FontImageT FontImageT;
+    typedef PcaGlyphMatcherFactory<FontImageT> PcaGlyphMatcherFactoryT;
+    typedef DynamicGlyphMatcher<FontImageT> DynamicGlyphMatcherT;
+    typedef boost::shared_ptr<const DynamicGlyphMatcherT> MatcherPtrT;
+    typedef typename MatcherBenchmark<FontImageT>::Result ResultT;
+
+    MatcherBenchmark<FontImageT> bench(pca->font(), QUANT_REPORT_ROWS, QUANT_REPORT_COLS);
+    MatcherPtrT float_matcher(PcaGlyphMatcherFactoryT::create(pca));
+    TextSurface reference;
+    bench.generateReference(float_matcher, reference);
+
+    TextSurface text;
+    ResultT float_res = bench.evaluate(float_matcher, reference, text);
+    ResultT quant16_res = bench.evaluate(MatcherPtrT(PcaGlyphMatcherFactoryT::template createQuantized<boost::int16_t>(pca)), 
+            reference, text);
+    ResultT quant8_res = bench.evaluate(MatcherPtrT(PcaGlyphMatcherFactoryT::template createQuantized<boost::int8_t>(pca)), 
+            reference, text);
+
+    log_ << "float: " << float_res.cellCost * 1e6 << " us/cell\n";
+    log_ << "quant=16: " << quant16_res.cellCost * 1e6 << " us/cell, agreement " << quant16_res.agreement << "\n";
+    log_ << "quant=8: " << quant8_res.cellCost * 1e6 << " us/cell, agreement " << quant8_res.agreement << "\n";
+}
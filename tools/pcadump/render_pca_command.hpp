@@ -21,6 +21,8 @@
 #include <string>
 #include <ostream>
 #include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <kgascii/font_pca.hpp>
 
 
 class RenderPcaCommand: boost::noncopyable
@@ -29,7 +31,12 @@ public:
     struct Parameters
     {
         std::string font_file;
+        std::string base_font_file;
         unsigned feature_cnt;
+        KG::Ascii::PcaMethod method;
+        unsigned thread_count;
+        bool validate;
+        bool quant_report;
         std::string reconstructed_font_file;
         std::string features_file;
     };
@@ -39,6 +46,13 @@ public:
 
     void execute(const Parameters& params);
 
+private:
+    template<class TFontEigendecomposition>
+    void validate(const TFontEigendecomposition& decomposition, size_t feature_cnt);
+
+    template<class TFontPrincipalComponents>
+    void reportQuantization(boost::shared_ptr<const TFontPrincipalComponents> pca);
+
 private:
     std::ostream& log_;
 };
@@ -0,0 +1,272 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/interprocess/creation_tags.hpp>
+#include <boost/interprocess/exceptions.hpp>
+#include <common/cmdline_tool.hpp>
+#include <kgascii/font_image.hpp>
+#include <kgascii/font_io.hpp>
+#include <kgascii/mapped_font.hpp>
+#include <kgascii/dynamic_asciifier.hpp>
+#include <kgascii/text_surface.hpp>
+#include <kgascii/glyph_matcher_context_factory.hpp>
+#include <kgutil/shm_frame_ring.hpp>
+
+using namespace KG::Ascii;
+using namespace KG::Util;
+
+typedef Font<> FontT;
+typedef FontImage<FontT> FontImageT;
+typedef DynamicGlyphMatcher<FontImageT> DynamicGlyphMatcherT;
+typedef DynamicAsciifier<DynamicGlyphMatcherT> DynamicAsciifierT;
+
+class ShmToAscii: public CmdlineTool
+{
+public:
+    ShmToAscii();
+
+protected:
+    bool processArgs();
+
+    int doExecute();
+
+private:
+    std::string inputRing_;
+    std::string outputRing_;
+    unsigned outputSlots_;
+    std::string fontFile_;
+    std::string algorithm_;
+    unsigned threads_;
+    bool control_;
+    bool replace_;
+};
+
+int main(int argc, char* argv[])
+{
+    return ShmToAscii().execute(argc, argv);
+}
+
+ShmToAscii::ShmToAscii()
+    :CmdlineTool("Options")
+{
+    using namespace boost::program_options;
+    desc_.add_options()
+        ("input-ring,i", value(&inputRing_), "shared memory ring with input frames (created by the decoder)")
+        ("output-ring,o", value(&outputRing_), "shared memory ring for text frames (created here)")
+        ("replace", bool_switch(&replace_), "remove an existing output ring of the same name, e.g. left by a crash")
+        ("output-slots", value(&outputSlots_)->default_value(4), "number of text frame slots")
+        ("font-file,f", value(&fontFile_), "font file")
+        ("algorithm,a", value(&algorithm_)->default_value("pca"), "glyph matching algorithm")
+        ("threads", value(&threads_)->default_value(0), "number of worker threads (0 = auto)")
+        ("control", bool_switch(&control_), "read font and algorithm changes from standard input")
+    ;
+}
+
+bool ShmToAscii::processArgs()
+{
+    requireOption("input-ring");
+    requireOption("output-ring");
+    requireOption("font-file");
+    if (outputSlots_ == 0)
+        throw std::logic_error("output-slots must be positive");
+    return true;
+}
+
+namespace {
+
+boost::shared_ptr<const DynamicGlyphMatcherT> buildMatcher(const std::string& font_file, const std::string& algorithm,
+        unsigned cell_width, unsigned cell_height)
+{
+    std::cerr << "loading font " << font_file << "\n";
+    boost::shared_ptr<FontImageT> font_image = loadFontImage<FontImageT>(font_file);
+    //the decoder scales frames for the cell size printed at startup
+    if (cell_width && (font_image->glyphWidth() != cell_width || font_image->glyphHeight() != cell_height))
+        throw std::runtime_error("font " + font_file + " has a different cell size");
+
+    std::cerr << "creating glyph matcher " << algorithm << "\n";
+    boost::shared_ptr<const DynamicGlyphMatcherT> matcher = GlyphMatcherFactory::create(font_image, algorithm);
+    return matcher;
+}
+
+// Commands, one per line:
+//   algorithm NAME   switch to another algorithm of the current font
+//   font FILE        switch to another font with the same cell size
+// The new matcher is built while frames keep being converted with the
+// old one.
+void controlFunc(boost::shared_ptr<DynamicAsciifierT> asciifier, std::string font_file, std::string algorithm)
+{
+    unsigned cell_width = asciifier->matcher()->cellWidth();
+    unsigned cell_height = asciifier->matcher()->cellHeight();
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        std::istringstream sin(line);
+        std::string cmd, arg;
+        if (!(sin >> cmd))
+            continue;
+        if (!(sin >> arg) || (cmd != "algorithm" && cmd != "font")) {
+            std::cerr << "expected 'algorithm NAME' or 'font FILE'\n";
+            continue;
+        }
+
+        std::string new_font = cmd == "font" ? arg : font_file;
+        std::string new_algorithm = cmd == "algorithm" ? arg : algorithm;
+        asciifier->setMatcherAsync(boost::bind(&buildMatcher, new_font, new_algorithm, cell_width, cell_height));
+        try {
+            asciifier->waitMatcher();
+            font_file = new_font;
+            algorithm = new_algorithm;
+            std::cerr << "switched to " << font_file << " " << algorithm << "\n";
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+        }
+    }
+}
+
+} // namespace
+
+int ShmToAscii::doExecute()
+{
+    registerGlyphMatcherFactories<FontImageT>();
+    boost::shared_ptr<const DynamicGlyphMatcherT> matcher;
+    try {
+        matcher = buildMatcher(fontFile_, algorithm_, 0, 0);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return -1;
+    }
+    //shared with the control thread, which may outlive this function
+    boost::shared_ptr<DynamicAsciifierT> asciifier_ptr(new DynamicAsciifierT(matcher));
+    DynamicAsciifierT& asciifier = *asciifier_ptr;
+    if (threads_ == 1) {
+        asciifier.setSequential();
+    } else {
+        asciifier.setParallel(threads_);
+    }
+
+    unsigned char_width = matcher->cellWidth();
+    unsigned char_height = matcher->cellHeight();
+
+    ShmFrameRing input(boost::interprocess::open_only, inputRing_);
+    //every text cell covers at least one pixel, so input slots bound the text size
+    //a ring of that name may belong to another running converter
+    if (replace_) {
+        ShmFrameRing::remove(outputRing_);
+    }
+    boost::scoped_ptr<ShmFrameRing> output_ptr;
+    try {
+        output_ptr.reset(new ShmFrameRing(boost::interprocess::create_only, outputRing_, outputSlots_, input.slotSize()));
+    } catch (const boost::interprocess::interprocess_exception& e) {
+        if (e.get_error_code() != boost::interprocess::already_exists_error)
+            throw;
+        std::cerr << "output ring " << outputRing_ << " already exists, use --replace to remove it\n";
+        return -1;
+    }
+    ShmFrameRing& output = *output_ptr;
+
+    //the decoder has to scale frames to the text resolution
+    std::cout << "cell width " << char_width << "\n";
+    std::cout << "cell height " << char_height << "\n";
+    std::cout << "input ring " << input.name() << " slots " << input.slotCount() << "\n";
+    std::cout << "output ring " << output.name() << " slots " << output.slotCount() << "\n";
+    std::cout.flush();
+
+    if (control_) {
+        //mostly blocked reading the standard input, so it is left running
+        //when the input ring closes
+        boost::thread(boost::bind(&controlFunc, asciifier_ptr, fontFile_, algorithm_)).detach();
+    }
+
+    boost::gil::gray8_image_t convert_buffer;
+    TextSurface text;
+    unsigned frame_count = 0;
+    unsigned skipped_count = 0;
+    boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+
+    ShmFrameHeader in_hdr;
+    const char* in_data = 0;
+    while (input.beginRead(in_hdr, in_data)) {
+        //headers come from another process and are not trusted
+        if (!input.frameFits(in_hdr)) {
+            std::cerr << "frame " << in_hdr.seq << ": invalid frame header\n";
+            input.endRead();
+            skipped_count++;
+            continue;
+        }
+        boost::gil::gray8c_view_t gray_view;
+        if (in_hdr.format == SHM_GRAY8) {
+            //matched straight from shared memory
+            gray_view = shmFrameView<const boost::gil::gray8_pixel_t>(in_hdr, in_data);
+        } else if (in_hdr.format == SHM_BGR8) {
+            convert_buffer.recreate(in_hdr.width, in_hdr.height);
+            boost::gil::copy_and_convert_pixels(
+                    shmFrameView<const boost::gil::bgr8_pixel_t>(in_hdr, in_data),
+                    boost::gil::view(convert_buffer));
+            gray_view = boost::gil::const_view(convert_buffer);
+        } else {
+            std::cerr << "frame " << in_hdr.seq << ": unsupported pixel format " << in_hdr.format << "\n";
+            input.endRead();
+            skipped_count++;
+            continue;
+        }
+
+        text.resize((in_hdr.height + char_height - 1) / char_height,
+                    (in_hdr.width + char_width - 1) / char_width);
+        text.clear();
+        asciifier.generate(gray_view, text);
+        input.endRead();
+
+        //implied by frameFits() as every cell covers a pixel, checked anyway
+        if (static_cast<size_t>(text.rows()) * text.cols() > output.slotSize()) {
+            skipped_count++;
+            continue;
+        }
+        char* out_data = output.beginWrite();
+        if (!out_data)
+            break;
+        for (unsigned r = 0; r < text.rows(); ++r) {
+            const Symbol* row = text.row(r);
+            for (unsigned c = 0; c < text.cols(); ++c) {
+                out_data[r * text.cols() + c] = row[c].charValue();
+            }
+        }
+        ShmFrameHeader out_hdr;
+        out_hdr.width = text.cols();
+        out_hdr.height = text.rows();
+        out_hdr.stride = text.cols();
+        out_hdr.format = SHM_TEXT8;
+        out_hdr.seq = in_hdr.seq;
+        output.endWrite(out_hdr);
+        frame_count++;
+    }
+    output.close();
+
+    double elapsed = (boost::posix_time::microsec_clock::universal_time() - start_time).total_microseconds() / 1e6;
+    std::cout << "processed frames " << frame_count << "\n";
+    std::cout << "skipped frames " << skipped_count << "\n";
+    std::cout << "processing time " << elapsed << "\n";
+    if (frame_count > 0) {
+        std::cout << "processing time / frame " << elapsed / frame_count << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,235 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <common/cmdline_tool.hpp>
+#include <common/remote_algorithm.hpp>
+#include <kgascii/font_io.hpp>
+#include <kgascii/text_surface.hpp>
+#include <kgutil/image_io.hpp>
+#include <kgutil/srgb.hpp>
+#include <kgutil/resample.hpp>
+#include <kgutil/resample/filter/bspline.hpp>
+#include "tile_coordinator.hpp"
+#include "tile_worker.hpp"
+#include "tile_link.hpp"
+
+using namespace KG::Ascii;
+using namespace KG::Util;
+
+typedef Font<> FontT;
+
+
+class TileRender: public CmdlineTool
+{
+public:
+    TileRender();
+
+protected:
+    bool processArgs();
+
+    int doExecute();
+
+private:
+    int serve();
+
+    int render();
+
+private:
+    std::string inputFile_;
+    std::string outputFile_;
+    std::string fontFile_;
+    std::string algorithm_;
+    unsigned maxCols_;
+    unsigned maxRows_;
+    unsigned tileRows_;
+    unsigned tileCols_;
+    std::vector<std::string> workers_;
+    unsigned loopbackCount_;
+    unsigned loopbackFailAfter_;
+    unsigned maxAttempts_;
+    unsigned workerTimeout_;
+    unsigned short servePort_;
+    std::string listenAddress_;
+    unsigned maxSessions_;
+};
+
+int main(int argc, char* argv[])
+{
+    return TileRender().execute(argc, argv);
+}
+
+TileRender::TileRender()
+    :CmdlineTool("Options")
+{
+    using namespace boost::program_options;
+    desc_.add_options()
+        ("serve", value(&servePort_), "run as a worker listening on the given TCP port")
+        ("listen", value(&listenAddress_)->default_value("127.0.0.1"), "address the worker listens on")
+        ("max-sessions", value(&maxSessions_)->default_value(16), "coordinator connections the worker serves at once")
+        ("input-file,i", value(&inputFile_), "input image file")
+        ("output-file,o", value(&outputFile_), "output text file")
+        ("font-file,f", value(&fontFile_), "font file")
+        ("algorithm,a", value(&algorithm_)->default_value("pca"), "glyph matching algorithm")
+        ("cols,c", value(&maxCols_)->default_value(1000), "suggested number of text columns")
+        ("rows,r", value(&maxRows_)->default_value(1000), "suggested number of text rows")
+        ("tile-rows", value(&tileRows_)->default_value(32), "text rows per tile")
+        ("tile-cols", value(&tileCols_)->default_value(128), "text columns per tile")
+        ("worker,w", value(&workers_)->composing(), "worker address host:port")
+        ("loopback", value(&loopbackCount_)->default_value(0), "number of in-process workers")
+        ("loopback-fail-after", value(&loopbackFailAfter_)->default_value(0), "make the first in-process worker die after this many tiles")
+        ("max-attempts", value(&maxAttempts_)->default_value(3), "attempts per tile before giving up")
+        ("worker-timeout", value(&workerTimeout_)->default_value(60), "seconds to wait for a worker before dropping it")
+    ;
+    posDesc_.add("input-file", 1);
+}
+
+bool TileRender::processArgs()
+{
+    if (vm_.count("serve"))
+        return true;
+
+    requireOption("input-file");
+    requireOption("font-file");
+    if (workers_.empty() && loopbackCount_ == 0)
+        throw std::logic_error("no workers, use --worker or --loopback");
+
+    if (!vm_.count("output-file")) {
+        boost::filesystem::path input_path(inputFile_);
+        outputFile_ = input_path.stem().string() + ".txt";
+    }
+    return true;
+}
+
+int TileRender::doExecute()
+{
+    if (vm_.count("serve"))
+        return serve();
+    return render();
+}
+
+int TileRender::serve()
+{
+    boost::shared_ptr<TileWorker> worker(new TileWorker);
+    TcpTileServer server(worker, listenAddress_, servePort_, maxSessions_);
+    std::cerr << "serving tiles on " << listenAddress_ << " port " << servePort_ << "\n";
+    server.run();
+    return 0;
+}
+
+int TileRender::render()
+{
+    //workers reject the rest, better to fail before loading anything
+    checkRemoteAlgorithm(algorithm_);
+
+    std::cerr << "loading font...\n";
+    boost::shared_ptr<FontT> font(new FontT);
+    if (!font->load(fontFile_))
+        return -1;
+
+    TileCoordinator coordinator(font, algorithm_, std::cerr);
+    coordinator.setMaxAttempts(maxAttempts_);
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        std::string::size_type colon = workers_[i].rfind(':');
+        if (colon == std::string::npos) {
+            std::cerr << "bad worker address " << workers_[i] << "\n";
+            return -1;
+        }
+        boost::shared_ptr<TileLink> link(new TcpTileLink(workers_[i].substr(0, colon), workers_[i].substr(colon + 1), 
+                workerTimeout_ * 1000));
+        coordinator.addLink(link);
+    }
+    for (unsigned i = 0; i < loopbackCount_; ++i) {
+        //every in-process worker keeps its own cache, like a remote one
+        boost::shared_ptr<TileWorker> worker(new TileWorker);
+        std::string name = "loopback" + boost::lexical_cast<std::string>(i);
+        boost::shared_ptr<TileLink> link(new LoopbackTileLink(worker, name, i == 0 ? loopbackFailAfter_ : 0));
+        coordinator.addLink(link);
+    }
+
+    std::cerr << "loading image...\n";
+    ImageInfo iinfo;
+    if (!readImageInfo(inputFile_, iinfo)) {
+        return -1;
+    }
+
+    unsigned char_width = coordinator.cellWidth();
+    unsigned char_height = coordinator.cellHeight();
+    unsigned frame_width = iinfo.width;
+    unsigned frame_height = iinfo.height;
+
+    unsigned hint_width = maxCols_ * char_width;
+    unsigned hint_height = maxRows_ * char_height;
+    unsigned out_width, out_height;
+    if (static_cast<unsigned long long>(hint_width) * frame_height / frame_width < hint_height) {
+        out_width = hint_width;
+        out_height = static_cast<unsigned long long>(out_width) * frame_height / frame_width;
+    } else {
+        out_height = hint_height;
+        out_width = static_cast<unsigned long long>(out_height) * frame_width / frame_height;
+    }
+
+    unsigned col_count = (out_width + char_width - 1) / char_width;
+    unsigned row_count = (out_height + char_height - 1) / char_height;
+
+    std::cout << "image width " << frame_width << "\n";
+    std::cout << "image height " << frame_height << "\n";
+    std::cout << "output columns " << col_count << "\n";
+    std::cout << "output rows " << row_count << "\n";
+
+    typedef boost::mpl::vector<
+        boost::gil::gray8_image_t,
+        boost::gil::gray16_image_t,
+        boost::gil::rgb8_image_t,
+        boost::gil::rgb16_image_t,
+        boost::gil::rgba8_image_t,
+        boost::gil::rgba16_image_t
+    >::type input_image_types;
+    boost::gil::any_image<input_image_types> loaded_image;
+    if (!loadImage(inputFile_, loaded_image))
+        return -1;
+
+    boost::gil::rgb_lin16_image_t input_image(frame_width, frame_height);
+    boost::gil::copy_and_convert_pixels(const_view(loaded_image), view(input_image));
+
+    boost::gil::rgb_lin16_image_t scaled_image(out_width, out_height);
+    resample(const_view(input_image), view(scaled_image), Filter::BSplineFilter<>());
+
+    boost::gil::gray8_image_t grayscale_image(out_width, out_height);
+    boost::gil::copy_and_convert_pixels(const_view(scaled_image), view(grayscale_image));
+
+    boost::posix_time::ptime start_time = boost::posix_time::microsec_clock::universal_time();
+    TextSurface text(row_count, col_count);
+    coordinator.render(const_view(grayscale_image), text, tileRows_, tileCols_);
+    double elapsed = (boost::posix_time::microsec_clock::universal_time() - start_time).total_microseconds() / 1e6;
+    std::cout << "rendering time " << elapsed << "\n";
+
+    std::ofstream fout(outputFile_.c_str());
+    for (size_t r = 0; r < text.rows(); ++r) {
+        for (size_t c = 0; c < text.cols(); ++c)
+            fout.put(text(r, c).charValue());
+        fout.put('\n');
+    }
+    fout.close();
+
+    return 0;
+}
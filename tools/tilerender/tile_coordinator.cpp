@@ -0,0 +1,206 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include "tile_coordinator.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+
+using namespace KG::Ascii;
+
+
+TileCoordinator::TileCoordinator(boost::shared_ptr<const FontT> font, const std::string& algorithm, std::ostream& log)
+    :algorithm_(algorithm)
+    ,cellWidth_(font->glyphWidth())
+    ,cellHeight_(font->glyphHeight())
+    ,maxAttempts_(3)
+    ,log_(log)
+    ,remaining_(0)
+    ,liveLinks_(0)
+{
+    TileProtocol::saveFont(*font, fontData_);
+    fontHash_ = TileProtocol::hashData(fontData_);
+}
+
+void TileCoordinator::addLink(boost::shared_ptr<TileLink> link)
+{
+    links_.push_back(link);
+}
+
+void TileCoordinator::setMaxAttempts(unsigned cnt)
+{
+    maxAttempts_ = std::max(cnt, 1u);
+}
+
+unsigned TileCoordinator::cellWidth() const
+{
+    return cellWidth_;
+}
+
+unsigned TileCoordinator::cellHeight() const
+{
+    return cellHeight_;
+}
+
+void TileCoordinator::render(const boost::gil::gray8c_view_t& imgv, TextSurface& text, unsigned tile_rows, unsigned tile_cols)
+{
+    if (links_.empty())
+        throw std::runtime_error("no worker links");
+    tile_rows = std::max(tile_rows, 1u);
+    tile_cols = std::max(tile_cols, 1u);
+
+    pending_.clear();
+    for (unsigned r = 0; r < text.rows(); r += tile_rows) {
+        for (unsigned c = 0; c < text.cols(); c += tile_cols) {
+            Tile tile = { r, c, std::min(tile_rows, text.rows() - r), std::min(tile_cols, text.cols() - c), 0 };
+            pending_.push_back(tile);
+        }
+    }
+    remaining_ = pending_.size();
+    liveLinks_ = links_.size();
+    error_.clear();
+
+    boost::thread_group group;
+    for (size_t i = 0; i < links_.size(); ++i) {
+        group.create_thread(boost::bind(&TileCoordinator::linkFunc, this, i, imgv, boost::ref(text)));
+    }
+    group.join_all();
+
+    //dead links are not reused by later renders
+    links_.erase(std::remove(links_.begin(), links_.end(), boost::shared_ptr<TileLink>()), links_.end());
+
+    if (!error_.empty())
+        throw std::runtime_error(error_);
+}
+
+void TileCoordinator::linkFunc(size_t link_no, const boost::gil::gray8c_view_t& imgv, TextSurface& text)
+{
+    TileLink& link = *links_[link_no];
+    //workers announce missing fonts, until then only the hash is sent
+    bool send_font = false;
+    std::vector<char> request, response;
+    TileProtocol::TileRequest req;
+    TileProtocol::TileResponse resp;
+
+    Tile tile;
+    while (nextTile(tile)) {
+        prepareRequest(tile, imgv, req);
+        try {
+            for (;;) {
+                req.font_data = send_font ? fontData_ : std::string();
+                TileProtocol::encodeRequest(req, request);
+                link.exchange(request, response);
+                TileProtocol::decodeResponse(response, resp);
+                if (resp.status != TileProtocol::TILE_NEED_FONT || send_font)
+                    break;
+                send_font = true;
+            }
+        } catch (const std::exception& e) {
+            linkFailed(link_no, tile, e.what());
+            return;
+        }
+
+        if (resp.status == TileProtocol::TILE_OK && resp.text.size() == tile.rows * tile.cols) {
+            tileDone(tile, resp.text, text);
+        } else {
+            //the same tile would fail on every worker
+            boost::format fmt_err("%1%: %2%");
+            abort(str(fmt_err % link.description() % (resp.error.empty() ? "bad tile response" : resp.error)));
+            return;
+        }
+    }
+}
+
+bool TileCoordinator::nextTile(Tile& tile)
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    //tiles in flight on other links may still come back
+    while (pending_.empty() && remaining_ > 0 && error_.empty()) {
+        tileCondition_.wait(lock);
+    }
+    if (pending_.empty() || !error_.empty())
+        return false;
+    tile = pending_.front();
+    pending_.pop_front();
+    return true;
+}
+
+void TileCoordinator::tileDone(const Tile& tile, const std::string& text_data, TextSurface& text)
+{
+    //tiles do not overlap, no locking needed for the surface
+    for (unsigned r = 0; r < tile.rows; ++r) {
+        Symbol* row = text.row(tile.row + r) + tile.col;
+        for (unsigned c = 0; c < tile.cols; ++c) {
+            row[c] = Symbol(static_cast<unsigned char>(text_data[r * tile.cols + c]));
+        }
+    }
+
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    if (--remaining_ == 0) {
+        tileCondition_.notify_all();
+    }
+}
+
+void TileCoordinator::linkFailed(size_t link_no, Tile tile, const std::string& reason)
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    log_ << "link " << links_[link_no]->description() << " failed: " << reason << "\n";
+    links_[link_no].reset();
+    liveLinks_--;
+
+    tile.attempts++;
+    if (tile.attempts >= maxAttempts_) {
+        boost::format fmt_err("tile %1%,%2% failed %3% times");
+        error_ = str(fmt_err % tile.row % tile.col % tile.attempts);
+    } else if (liveLinks_ == 0) {
+        error_ = "all worker links failed";
+    } else {
+        pending_.push_back(tile);
+    }
+    tileCondition_.notify_all();
+}
+
+void TileCoordinator::abort(const std::string& reason)
+{
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    if (error_.empty()) {
+        error_ = reason;
+    }
+    tileCondition_.notify_all();
+}
+
+void TileCoordinator::prepareRequest(const Tile& tile, const boost::gil::gray8c_view_t& imgv, TileProtocol::TileRequest& req) const
+{
+    int x = tile.col * cellWidth_;
+    int y = tile.row * cellHeight_;
+    int width = std::max(std::min<int>(tile.cols * cellWidth_, imgv.width() - x), 0);
+    int height = std::max(std::min<int>(tile.rows * cellHeight_, imgv.height() - y), 0);
+
+    req.font_hash = fontHash_;
+    req.algorithm = algorithm_;
+    req.rows = tile.rows;
+    req.cols = tile.cols;
+    req.width = width;
+    req.height = height;
+    req.pixels.resize(width * height);
+    if (width > 0 && height > 0) {
+        boost::gil::gray8_view_t band = boost::gil::interleaved_view(width, height,
+                reinterpret_cast<boost::gil::gray8_pixel_t*>(&req.pixels[0]), width);
+        boost::gil::copy_pixels(boost::gil::subimage_view(imgv, x, y, width, height), band);
+    }
+}
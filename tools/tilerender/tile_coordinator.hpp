@@ -0,0 +1,98 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_TOOLS_TILERENDER_TILE_COORDINATOR_HPP
+#define KGASCII_TOOLS_TILERENDER_TILE_COORDINATOR_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <ostream>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/gil/gil_all.hpp>
+#include <kgascii/text_surface.hpp>
+#include "tile_protocol.hpp"
+#include "tile_link.hpp"
+
+
+// Splits the text grid into tiles and converts them on remote workers.
+// Every link is served by its own thread pulling tiles from a shared
+// queue. A tile whose link dies is put back for the remaining links;
+// rendering fails when a tile ran out of attempts or no link is left.
+class TileCoordinator: boost::noncopyable
+{
+public:
+    typedef TileProtocol::FontT FontT;
+
+public:
+    TileCoordinator(boost::shared_ptr<const FontT> font, const std::string& algorithm, std::ostream& log);
+
+    void addLink(boost::shared_ptr<TileLink> link);
+
+    void setMaxAttempts(unsigned cnt);
+
+    unsigned cellWidth() const;
+
+    unsigned cellHeight() const;
+
+    // The image covers the text surface starting at its top left cell.
+    void render(const boost::gil::gray8c_view_t& imgv, KG::Ascii::TextSurface& text, unsigned tile_rows, unsigned tile_cols);
+
+private:
+    struct Tile
+    {
+        unsigned row;
+        unsigned col;
+        unsigned rows;
+        unsigned cols;
+        unsigned attempts;
+    };
+
+    void linkFunc(size_t link_no, const boost::gil::gray8c_view_t& imgv, KG::Ascii::TextSurface& text);
+
+    bool nextTile(Tile& tile);
+
+    void tileDone(const Tile& tile, const std::string& text_data, KG::Ascii::TextSurface& text);
+
+    void linkFailed(size_t link_no, Tile tile, const std::string& reason);
+
+    void abort(const std::string& reason);
+
+    void prepareRequest(const Tile& tile, const boost::gil::gray8c_view_t& imgv, TileProtocol::TileRequest& req) const;
+
+private:
+    std::string algorithm_;
+    std::string fontData_;
+    boost::uint64_t fontHash_;
+    unsigned cellWidth_;
+    unsigned cellHeight_;
+    unsigned maxAttempts_;
+    std::ostream& log_;
+    std::vector<boost::shared_ptr<TileLink> > links_;
+
+    boost::mutex mutex_;
+    boost::condition_variable tileCondition_;
+    std::deque<Tile> pending_;
+    size_t remaining_;
+    size_t liveLinks_;
+    std::string error_;
+};
+
+#endif // KGASCII_TOOLS_TILERENDER_TILE_COORDINATOR_HPP
@@ -0,0 +1,185 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include "tile_link.hpp"
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <boost/array.hpp>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <common/ascii_protocol.hpp>
+#include "tile_worker.hpp"
+
+
+namespace {
+
+void storeResult(boost::system::error_code& result, const boost::system::error_code& err)
+{
+    result = err;
+}
+
+} // namespace
+
+TileLink::~TileLink()
+{
+}
+
+LoopbackTileLink::LoopbackTileLink(boost::shared_ptr<TileWorker> worker, const std::string& name, unsigned fail_after)
+    :worker_(worker)
+    ,name_(name)
+    ,failAfter_(fail_after)
+    ,requestCount_(0)
+{
+}
+
+void LoopbackTileLink::exchange(const std::vector<char>& request, std::vector<char>& response)
+{
+    if (failAfter_ > 0 && requestCount_ >= failAfter_)
+        throw std::runtime_error("loopback link failure");
+    requestCount_++;
+    worker_->handle(request, response);
+}
+
+std::string LoopbackTileLink::description() const
+{
+    return name_;
+}
+
+TcpTileLink::TcpTileLink(const std::string& host, const std::string& port, unsigned timeout_ms)
+    :host_(host)
+    ,port_(port)
+    ,timeout_(boost::posix_time::milliseconds(timeout_ms))
+    ,timedOut_(false)
+    ,socket_(io_)
+    ,timer_(io_)
+{
+    using boost::asio::ip::tcp;
+    tcp::resolver resolver(io_);
+    tcp::resolver::query query(host, port);
+    boost::asio::connect(socket_, resolver.resolve(query));
+    socket_.set_option(tcp::no_delay(true));
+}
+
+void TcpTileLink::exchange(const std::vector<char>& request, std::vector<char>& response)
+{
+    using boost::asio::placeholders::error;
+
+    //blocking socket calls can not time out, so the frames are transferred
+    //asynchronously and the timer closes the socket when it expires
+    boost::system::error_code err;
+    char header[AsciiProtocol::HEADER_SIZE];
+    AsciiProtocol::encodeHeader(request.size(), header);
+    boost::array<boost::asio::const_buffer, 2> frame = {{
+        boost::asio::buffer(header, AsciiProtocol::HEADER_SIZE), boost::asio::buffer(request) }};
+    boost::asio::async_write(socket_, frame, boost::bind(&storeResult, boost::ref(err), error));
+    wait(err);
+
+    boost::asio::async_read(socket_, boost::asio::buffer(header, AsciiProtocol::HEADER_SIZE), 
+            boost::bind(&storeResult, boost::ref(err), error));
+    wait(err);
+    response.resize(AsciiProtocol::decodeHeader(header));
+    boost::asio::async_read(socket_, boost::asio::buffer(response), boost::bind(&storeResult, boost::ref(err), error));
+    wait(err);
+}
+
+// Runs the pending operation of the socket to completion or until the
+// timeout expires; throws in both failure cases.
+void TcpTileLink::wait(boost::system::error_code& err)
+{
+    if (timedOut_)
+        throw std::runtime_error("worker timed out");
+
+    err = boost::asio::error::would_block;
+    timer_.expires_from_now(timeout_);
+    timer_.async_wait(boost::bind(&TcpTileLink::handleTimeout, this, boost::asio::placeholders::error));
+    io_.reset();
+    while (err == boost::asio::error::would_block) {
+        io_.run_one();
+    }
+    //let the cancelled timer handler run, it must not outlive the wait
+    timer_.cancel();
+    io_.reset();
+    io_.run();
+
+    if (timedOut_)
+        throw std::runtime_error("worker timed out");
+    if (err)
+        throw boost::system::system_error(err);
+}
+
+void TcpTileLink::handleTimeout(const boost::system::error_code& err)
+{
+    if (!err) {
+        timedOut_ = true;
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+    }
+}
+
+std::string TcpTileLink::description() const
+{
+    return host_ + ":" + port_;
+}
+
+TcpTileServer::TcpTileServer(boost::shared_ptr<TileWorker> worker, const std::string& address, unsigned short port,
+        unsigned max_sessions)
+    :worker_(worker)
+    ,acceptor_(io_, boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(address), port))
+    ,maxSessions_(std::max(max_sessions, 1u))
+    ,sessionCount_(0)
+{
+}
+
+void TcpTileServer::run()
+{
+    for (;;) {
+        boost::shared_ptr<boost::asio::ip::tcp::socket> socket(new boost::asio::ip::tcp::socket(io_));
+        acceptor_.accept(*socket);
+        {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            if (sessionCount_ >= maxSessions_) {
+                std::cerr << "too many sessions, connection closed\n";
+                continue;
+            }
+            sessionCount_++;
+        }
+        boost::thread session(boost::bind(&TcpTileServer::sessionFunc, this, socket));
+        session.detach();
+    }
+}
+
+void TcpTileServer::sessionFunc(boost::shared_ptr<boost::asio::ip::tcp::socket> socket)
+{
+    std::vector<char> request, response;
+    try {
+        socket->set_option(boost::asio::ip::tcp::no_delay(true));
+        for (;;) {
+            AsciiProtocol::readFrame(*socket, request);
+            worker_->handle(request, response);
+            AsciiProtocol::writeFrame(*socket, response);
+        }
+    } catch (const boost::system::system_error& e) {
+        if (e.code() != boost::asio::error::eof) {
+            std::cerr << "session: " << e.what() << "\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "session: " << e.what() << "\n";
+    }
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    sessionCount_--;
+}
@@ -0,0 +1,110 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_TOOLS_TILERENDER_TILE_LINK_HPP
+#define KGASCII_TOOLS_TILERENDER_TILE_LINK_HPP
+
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/asio.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+class TileWorker;
+
+// Connection from the coordinator to one worker.
+// exchange() sends a request payload and waits for the response; any
+// exception thrown means the link is dead and will not be used again.
+class TileLink: boost::noncopyable
+{
+public:
+    virtual ~TileLink();
+
+    virtual void exchange(const std::vector<char>& request, std::vector<char>& response) = 0;
+
+    virtual std::string description() const = 0;
+};
+
+// In-process worker, for running the distributed mode on one machine.
+// It can be told to die after a number of requests to exercise the
+// coordinator's recovery.
+class LoopbackTileLink: public TileLink
+{
+public:
+    LoopbackTileLink(boost::shared_ptr<TileWorker> worker, const std::string& name, unsigned fail_after=0);
+
+    virtual void exchange(const std::vector<char>& request, std::vector<char>& response);
+
+    virtual std::string description() const;
+
+private:
+    boost::shared_ptr<TileWorker> worker_;
+    std::string name_;
+    unsigned failAfter_;
+    unsigned requestCount_;
+};
+
+// A worker that does not answer within timeout_ms, counted from the start
+// of each read or write, is treated as dead.
+class TcpTileLink: public TileLink
+{
+public:
+    TcpTileLink(const std::string& host, const std::string& port, unsigned timeout_ms);
+
+    virtual void exchange(const std::vector<char>& request, std::vector<char>& response);
+
+    virtual std::string description() const;
+
+private:
+    void wait(boost::system::error_code& err);
+
+    void handleTimeout(const boost::system::error_code& err);
+
+private:
+    std::string host_;
+    std::string port_;
+    boost::posix_time::time_duration timeout_;
+    bool timedOut_;
+    boost::asio::io_service io_;
+    boost::asio::ip::tcp::socket socket_;
+    boost::asio::deadline_timer timer_;
+};
+
+// Serves TileWorker requests over TCP, one thread per connection.
+// Connections past max_sessions are closed right away.
+class TcpTileServer: boost::noncopyable
+{
+public:
+    TcpTileServer(boost::shared_ptr<TileWorker> worker, const std::string& address, unsigned short port,
+            unsigned max_sessions);
+
+    void run();
+
+private:
+    void sessionFunc(boost::shared_ptr<boost::asio::ip::tcp::socket> socket);
+
+private:
+    boost::shared_ptr<TileWorker> worker_;
+    boost::asio::io_service io_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    unsigned maxSessions_;
+    unsigned sessionCount_;
+    boost::mutex mutex_;
+};
+
+#endif // KGASCII_TOOLS_TILERENDER_TILE_LINK_HPP
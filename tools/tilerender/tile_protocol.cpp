@@ -0,0 +1,151 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include "tile_protocol.hpp"
+#include <sstream>
+#include <kgascii/internal/font_file.hpp>
+#include <kgutil/fnv_hash.hpp>
+
+namespace TileProtocol {
+
+using AsciiProtocol::MessageWriter;
+using AsciiProtocol::MessageReader;
+using AsciiProtocol::ProtocolError;
+
+namespace {
+
+const char REQUEST_MAGIC[] = { 'K', 'G', 'T', 1 };
+const char RESPONSE_MAGIC[] = { 'K', 'G', 'S', 1 };
+
+void putUint64(MessageWriter& wr, boost::uint64_t value)
+{
+    wr.putUint(static_cast<unsigned>(value >> 32));
+    wr.putUint(static_cast<unsigned>(value & 0xffffffffu));
+}
+
+boost::uint64_t getUint64(MessageReader& rd)
+{
+    boost::uint64_t high = rd.getUint();
+    boost::uint64_t low = rd.getUint();
+    return (high << 32) | low;
+}
+
+} // namespace
+
+TileRequest::TileRequest()
+    :font_hash(0)
+    ,rows(0)
+    ,cols(0)
+    ,width(0)
+    ,height(0)
+{
+}
+
+TileResponse::TileResponse()
+    :status(TILE_ERROR)
+{
+}
+
+void encodeRequest(const TileRequest& req, std::vector<char>& payload)
+{
+    MessageWriter wr(payload);
+    wr.putBytes(REQUEST_MAGIC, 4);
+    putUint64(wr, req.font_hash);
+    wr.putString(req.algorithm);
+    wr.putString(req.font_data);
+    wr.putUint(req.rows);
+    wr.putUint(req.cols);
+    wr.putUint(req.width);
+    wr.putUint(req.height);
+    wr.putUint(req.pixels.size());
+    if (!req.pixels.empty()) {
+        wr.putBytes(&req.pixels[0], req.pixels.size());
+    }
+}
+
+void decodeRequest(const std::vector<char>& payload, TileRequest& req)
+{
+    MessageReader rd(payload);
+    rd.getMagic(REQUEST_MAGIC);
+    req.font_hash = getUint64(rd);
+    req.algorithm = rd.getString();
+    size_t font_data_size = rd.getUint();
+    if (font_data_size > MAX_FONT_DATA_SIZE)
+        throw ProtocolError("font data too large");
+    const char* font_data = rd.getBytes(font_data_size);
+    req.font_data.assign(font_data, font_data_size);
+    req.rows = rd.getUint();
+    req.cols = rd.getUint();
+    req.width = rd.getUint();
+    req.height = rd.getUint();
+    size_t pixels_size = rd.getUint();
+
+    //each side is bounded first, so that the products can not wrap
+    if (req.rows > MAX_TILE_SIDE || req.cols > MAX_TILE_SIDE
+            || static_cast<size_t>(req.rows) * req.cols > MAX_TILE_CELLS)
+        throw ProtocolError("tile too large");
+    if (req.width > AsciiProtocol::MAX_IMAGE_SIDE || req.height > AsciiProtocol::MAX_IMAGE_SIDE)
+        throw ProtocolError("tile band too large");
+    if (static_cast<size_t>(req.width) * req.height != pixels_size)
+        throw ProtocolError("tile band size mismatch");
+
+    const char* pixels = rd.getBytes(pixels_size);
+    req.pixels.assign(pixels, pixels + pixels_size);
+    rd.finish();
+}
+
+void encodeResponse(const TileResponse& resp, std::vector<char>& payload)
+{
+    MessageWriter wr(payload);
+    wr.putBytes(RESPONSE_MAGIC, 4);
+    wr.putUint(resp.status);
+    wr.putString(resp.error);
+    wr.putString(resp.text);
+}
+
+void decodeResponse(const std::vector<char>& payload, TileResponse& resp)
+{
+    MessageReader rd(payload);
+    rd.getMagic(RESPONSE_MAGIC);
+    resp.status = rd.getUint();
+    resp.error = rd.getString();
+    resp.text = rd.getString();
+    rd.finish();
+}
+
+void saveFont(const FontT& font, std::string& data)
+{
+    std::ostringstream oss;
+    KG::Ascii::Internal::writeFontFile(font, oss);
+    data = oss.str();
+}
+
+void loadFont(const std::string& data, FontT& font)
+{
+    //the binary font format is bounds checked, text archives are not safe
+    //on data from the network
+    if (data.empty() || data.size() > MAX_FONT_DATA_SIZE)
+        throw ProtocolError("bad font data size");
+    KG::Ascii::Internal::readFontFile(font, &data[0], data.size());
+}
+
+boost::uint64_t hashData(const std::string& data)
+{
+    return KG::Util::fnv1aHash(data);
+}
+
+} // namespace TileProtocol
@@ -0,0 +1,96 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_TOOLS_TILERENDER_TILE_PROTOCOL_HPP
+#define KGASCII_TOOLS_TILERENDER_TILE_PROTOCOL_HPP
+
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <kgascii/font.hpp>
+#include <common/ascii_protocol.hpp>
+
+
+// Messages exchanged between the tile coordinator and its workers,
+// framed like the kgasciid protocol.
+// A worker keeps fonts it has seen keyed by their hash; the coordinator
+// sends only the hash and ships the whole font after a TILE_NEED_FONT
+// response.
+namespace TileProtocol {
+
+typedef KG::Ascii::Font<> FontT;
+
+// requests past these limits are rejected before anything is allocated
+// for them
+const unsigned MAX_TILE_SIDE = 4096;
+const size_t MAX_TILE_CELLS = 1 << 20;
+const size_t MAX_FONT_DATA_SIZE = 16 << 20;
+
+enum Status
+{
+    TILE_OK = 0,
+    TILE_NEED_FONT = 1,
+    TILE_ERROR = 2
+};
+
+struct TileRequest
+{
+    TileRequest();
+
+    boost::uint64_t font_hash;
+    std::string algorithm;
+    // font in the .kgf format, empty unless the worker asked for it
+    std::string font_data;
+    // tile size in cells
+    unsigned rows;
+    unsigned cols;
+    // pixel band covered by the tile, gray8 without row padding
+    unsigned width;
+    unsigned height;
+    std::vector<char> pixels;
+};
+
+struct TileResponse
+{
+    TileResponse();
+
+    unsigned status;
+    std::string error;
+    // rows * cols characters, row by row
+    std::string text;
+};
+
+void encodeRequest(const TileRequest& req, std::vector<char>& payload);
+
+void decodeRequest(const std::vector<char>& payload, TileRequest& req);
+
+void encodeResponse(const TileResponse& resp, std::vector<char>& payload);
+
+void decodeResponse(const std::vector<char>& payload, TileResponse& resp);
+
+// Fonts travel in the binary font file format (.kgf); loadFont() validates
+// the data and throws on anything malformed.
+void saveFont(const FontT& font, std::string& data);
+
+void loadFont(const std::string& data, FontT& font);
+
+// 64 bit FNV-1a
+boost::uint64_t hashData(const std::string& data);
+
+} // namespace TileProtocol
+
+#endif // KGASCII_TOOLS_TILERENDER_TILE_PROTOCOL_HPP
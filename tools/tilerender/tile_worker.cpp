@@ -0,0 +1,116 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include "tile_worker.hpp"
+#include <stdexcept>
+#include <kgascii/sequential_asciifier.hpp>
+#include <kgascii/text_surface.hpp>
+#include <kgascii/glyph_matcher_context_factory.hpp>
+#include <common/remote_algorithm.hpp>
+
+using namespace KG::Ascii;
+
+namespace {
+
+//a coordinator uses one font and one algorithm, so a full cache is simply
+//emptied; other coordinators only pay for rebuilding their matchers
+const size_t MAX_FONTS = 8;
+const size_t MAX_MATCHERS = 16;
+
+} // namespace
+
+
+TileWorker::TileWorker()
+{
+    registerGlyphMatcherFactories<FontImageT>();
+}
+
+void TileWorker::handle(const std::vector<char>& request, std::vector<char>& response)
+{
+    TileProtocol::TileResponse resp;
+    try {
+        TileProtocol::TileRequest req;
+        TileProtocol::decodeRequest(request, req);
+        process(req, resp);
+    } catch (const std::exception& e) {
+        resp = TileProtocol::TileResponse();
+        resp.error = e.what();
+    }
+    TileProtocol::encodeResponse(resp, response);
+}
+
+void TileWorker::process(const TileProtocol::TileRequest& req, TileProtocol::TileResponse& resp)
+{
+    typedef SequentialAsciifier<DynamicGlyphMatcherT> SequentialAsciifierT;
+
+    boost::shared_ptr<const DynamicGlyphMatcherT> matcher = findMatcher(req);
+    if (!matcher) {
+        resp.status = TileProtocol::TILE_NEED_FONT;
+        return;
+    }
+    if (req.width > req.cols * matcher->cellWidth() || req.height > req.rows * matcher->cellHeight())
+        throw std::runtime_error("tile band larger than tile");
+
+    TextSurface text(req.rows, req.cols);
+    if (!req.pixels.empty()) {
+        boost::gil::gray8c_view_t band = boost::gil::interleaved_view(req.width, req.height,
+                reinterpret_cast<const boost::gil::gray8_pixel_t*>(&req.pixels[0]), req.width);
+        SequentialAsciifierT asciifier(matcher);
+        asciifier.generate(band, text);
+    }
+
+    resp.status = TileProtocol::TILE_OK;
+    resp.text.resize(req.rows * req.cols);
+    for (unsigned r = 0; r < text.rows(); ++r) {
+        for (unsigned c = 0; c < text.cols(); ++c) {
+            resp.text[r * req.cols + c] = text(r, c).charValue();
+        }
+    }
+}
+
+boost::shared_ptr<const TileWorker::DynamicGlyphMatcherT> TileWorker::findMatcher(const TileProtocol::TileRequest& req)
+{
+    //matchers are built under the lock, a worker serves a single coordinator
+    boost::unique_lock<boost::mutex> lock(mutex_);
+
+    std::string spec = checkRemoteAlgorithm(req.algorithm);
+    MatcherKeyT key(req.font_hash, spec);
+    if (matchers_.count(key))
+        return matchers_[key];
+
+    boost::shared_ptr<const FontImageT> font_image;
+    if (fonts_.count(req.font_hash)) {
+        font_image = fonts_[req.font_hash];
+    } else {
+        if (req.font_data.empty())
+            return boost::shared_ptr<const DynamicGlyphMatcherT>();
+        if (TileProtocol::hashData(req.font_data) != req.font_hash)
+            throw std::runtime_error("font hash mismatch");
+        boost::shared_ptr<FontT> font(new FontT);
+        TileProtocol::loadFont(req.font_data, *font);
+        font_image.reset(new FontImageT(font));
+        if (fonts_.size() >= MAX_FONTS)
+            fonts_.clear();
+        fonts_[req.font_hash] = font_image;
+    }
+
+    boost::shared_ptr<const DynamicGlyphMatcherT> matcher = GlyphMatcherFactory::create(font_image, spec);
+    if (matchers_.size() >= MAX_MATCHERS)
+        matchers_.clear();
+    matchers_[key] = matcher;
+    return matcher;
+}
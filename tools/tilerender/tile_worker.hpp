@@ -0,0 +1,63 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify 
+// it under the terms of the GNU Lesser General Public License as published by 
+// the Free Software Foundation; either version 3 of the License, or 
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful, 
+// but WITHOUT ANY WARRANTY; without even the implied warranty of 
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the 
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License 
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_TOOLS_TILERENDER_TILE_WORKER_HPP
+#define KGASCII_TOOLS_TILERENDER_TILE_WORKER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <kgascii/font_image.hpp>
+#include <kgascii/dynamic_glyph_matcher.hpp>
+#include "tile_protocol.hpp"
+
+
+// Converts tiles sent by a coordinator. Fonts and glyph matchers are kept
+// for later tiles, keyed by font hash and algorithm; algorithms are checked
+// with checkRemoteAlgorithm() like those sent to kgasciid.
+class TileWorker: boost::noncopyable
+{
+public:
+    typedef TileProtocol::FontT FontT;
+    typedef KG::Ascii::FontImage<FontT> FontImageT;
+    typedef KG::Ascii::DynamicGlyphMatcher<FontImageT> DynamicGlyphMatcherT;
+
+public:
+    TileWorker();
+
+    // Thread safe, never throws; failures are reported in the response.
+    void handle(const std::vector<char>& request, std::vector<char>& response);
+
+private:
+    void process(const TileProtocol::TileRequest& req, TileProtocol::TileResponse& resp);
+
+    boost::shared_ptr<const DynamicGlyphMatcherT> findMatcher(const TileProtocol::TileRequest& req);
+
+private:
+    typedef std::pair<boost::uint64_t, std::string> MatcherKeyT;
+
+    boost::mutex mutex_;
+    std::map<boost::uint64_t, boost::shared_ptr<const FontImageT> > fonts_;
+    std::map<MatcherKeyT, boost::shared_ptr<const DynamicGlyphMatcherT> > matchers_;
+};
+
+#endif // KGASCII_TOOLS_TILERENDER_TILE_WORKER_HPP
@@ -15,11 +15,20 @@
 // You should have received a copy of the GNU Lesser General Public License 
 // along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
 
+//comes first, so that it can keep Eigen's assertions live
+#ifdef KGASCII_CHECK_ALLOCATIONS
+#include <kgutil/allocation_counter.hpp>
+
+KGUTIL_DEFINE_ALLOCATION_COUNTER
+#endif
+
 #include <iostream>
 #include <limits>
 #include <cmath>
 #include <boost/lexical_cast.hpp>
 #include <boost/optional.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <common/cmdline_tool.hpp>
@@ -27,8 +36,12 @@
 #include <common/console.hpp>
 #include <common/video_player.hpp>
 #include <common/cast_surface.hpp>
+#include <common/quality_controller.hpp>
+#include <common/tuning_profile.hpp>
+#include "transcode_video_command.hpp"
 #include <kgascii/font_image.hpp>
 #include <kgascii/font_io.hpp>
+#include <kgascii/mapped_font.hpp>
 #include <kgascii/dynamic_asciifier.hpp>
 #include <kgascii/text_surface.hpp>
 #include <kgascii/glyph_matcher_context_factory.hpp>
@@ -66,6 +79,12 @@ private:
     bool renderAll_;
     bool showVideo_;
     std::string algorithm_;
+    std::string fallbackAlgorithms_;
+    std::string outputFile_;
+    unsigned segments_;
+    std::string profileFile_;
+    TuningProfile profile_;
+    unsigned rowsPerTask_;
 };
 
 int main(int argc, char* argv[])
@@ -76,6 +95,7 @@ int main(int argc, char* argv[])
 
 VideoToAscii::VideoToAscii()
     :CmdlineTool("Options")
+    ,rowsPerTask_(1)
 {
     using namespace boost::program_options;
     desc_.add_options()
@@ -93,6 +113,10 @@ VideoToAscii::VideoToAscii()
         ("render-all", bool_switch(&renderAll_), "render all frames")
         ("show-video", bool_switch(&showVideo_), "show original video")
         ("algorithm,a", value(&algorithm_)->default_value("pca"), "glyph matching algorithm")
+        ("fallback-algorithms", value(&fallbackAlgorithms_), "comma separated cheaper algorithms to switch to when playback falls behind")
+        ("output-file,o", value(&outputFile_), "output text file (offline transcoding)")
+        ("segments", value(&segments_)->default_value(0), "number of concurrently transcoded segments (0 = auto)")
+        ("profile,p", value(&profileFile_), "tuning profile written by asciitune")
     ;
     posDesc_.add("input-file", 1);
 }
@@ -112,22 +136,53 @@ bool VideoToAscii::processArgs()
     conflictingOptions("end-frame", "max-frames");
     conflictingOptions("end-frame", "max-time");
 
+    conflictingOptions("output-file", "show-video");
+
     if (startTime_ && endTime_ && *startTime_ > *endTime_)
         throw std::logic_error("invalid time range");
     if (startFrame_ && endFrame_ && *startFrame_ > *endFrame_)
         throw std::logic_error("invalid frame number range");
 
+    //explicitly given options take precedence over the profile
+    if (!profileFile_.empty()) {
+        profile_.load(profileFile_);
+        if (vm_["algorithm"].defaulted()) {
+            algorithm_ = profile_.algorithm;
+        }
+        if (vm_["threads"].defaulted()) {
+            threads_ = profile_.threadCount;
+        }
+        rowsPerTask_ = profile_.rowsPerTask;
+    }
+
     return true;
 }
 
 class MyVideoPlayer: public VideoPlayer
 {
 public:
-    explicit MyVideoPlayer(const VideoToAscii* ctx, DynamicAsciifierT* asc, Console* con)
+    typedef std::vector<boost::shared_ptr<const DynamicGlyphMatcherT> > MatcherVectorT;
+
+    // All quality levels share the asciifier, a level change only swaps
+    // its matcher.
+    explicit MyVideoPlayer(const VideoToAscii* ctx, DynamicAsciifierT* asciifier, const MatcherVectorT& levels, 
+            QualityController* qc, Console* con)
         :matcher_(ctx)
-        ,asciifier_(asc)
+        ,levels_(levels)
+        ,asciifier_(asciifier)
+        ,quality_(qc)
         ,console_(con)
+        ,levelWarmup_(levels.size(), 0)
+        ,allocatingFrames_(0)
+    {
+        assert(levels_.size() == quality_->levelCount());
+    }
+
+    // Frames that allocated memory in the asciifier after its warm-up;
+    // only counted in builds with KGASCII_CHECK_ALLOCATIONS.
+    unsigned allocatingFrames() const
     {
+        return allocatingFrames_;
     }
 
 protected:
@@ -220,17 +275,16 @@ protected:
 
     virtual void onFrameRead(cv::Mat frm, double tm_left)
     {
-        (void)tm_left;
-        cv::Mat scaled_frame;
+        //scaledFrame_ and grayFrame_ keep their buffers between frames
         if (frameWidth() == outWidth_ && frameHeight() == outHeight_) {
-            scaled_frame = frm;
+            cv::cvtColor(frm, grayFrame_, CV_BGR2GRAY);
         } else {
-            cv::resize(frm, scaled_frame, cv::Size(outWidth_, outHeight_));
+            cv::resize(frm, scaledFrame_, cv::Size(outWidth_, outHeight_));
+            cv::cvtColor(scaledFrame_, grayFrame_, CV_BGR2GRAY);
         }
 
         //cv::GaussianBlur(scaled_frame, scaled_frame, cv::Size(7,7), 1.5, 1.5);
 
-        cv::cvtColor(scaled_frame, grayFrame_, CV_BGR2GRAY);
         //cv::equalizeHist(gray_frame, gray_frame);
 
         assert(grayFrame_.dims == 2);
@@ -241,8 +295,38 @@ protected:
         boost::gil::gray8c_view_t gray_surface =
                 castSurface<const boost::gil::gray8_pixel_t>(grayFrame_);
 
+        bool deadlines = !matcher_->renderAll_ && levels_.size() > 1;
+        if (deadlines && asciifier_->matcher() != levels_[quality_->level()]) {
+            asciifier_->setMatcher(levels_[quality_->level()]);
+            //the workers create new contexts for the matcher
+            levelWarmup_[quality_->level()] = 0;
+        }
+
+        boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+#ifdef KGASCII_CHECK_ALLOCATIONS
+        unsigned& warmup = levelWarmup_[deadlines ? quality_->level() : 0];
+        bool steady = warmup >= ALLOCATION_WARMUP_FRAMES;
+        {
+            KG::Util::AllocationScope alloc_scope;
+            KG::Util::EigenMallocScope eigen_scope(steady);
+            text_.clear();
+            asciifier_->generate(gray_surface, text_);
+            if (steady && alloc_scope.allocations() > 0) {
+                allocatingFrames_++;
+            }
+        }
+        if (!steady) {
+            warmup++;
+        }
+#else
         text_.clear();
         asciifier_->generate(gray_surface, text_);
+#endif
+        boost::posix_time::ptime end = boost::posix_time::microsec_clock::universal_time();
+
+        if (deadlines) {
+            quality_->update((end - start).total_microseconds() / 1e6, tm_left);
+        }
     }
 
     virtual void onFrameDisplay(cv::Mat frm)
@@ -255,46 +339,82 @@ protected:
     }
 
 private:
+    static const unsigned ALLOCATION_WARMUP_FRAMES = 4;
+
     const VideoToAscii* matcher_;
+    MatcherVectorT levels_;
     DynamicAsciifierT* asciifier_;
+    QualityController* quality_;
     Console* console_;
     TextSurface text_;
     unsigned outWidth_;
     unsigned outHeight_;
     unsigned cols_;
     unsigned rows_;
+    cv::Mat scaledFrame_;
     cv::Mat grayFrame_;
+    std::vector<unsigned> levelWarmup_;
+    unsigned allocatingFrames_;
 };
 
 int VideoToAscii::doExecute()
 {
     try {
         std::cout << "loading font\n";
-        boost::shared_ptr<FontT> font(new FontT);
-        if (!font->load(fontFile_)) {
-            std::cerr << "problem loading font\n";
-            return 1;
+        boost::shared_ptr<FontImageT> font_image = loadFontImage<FontImageT>(fontFile_);
+        if (profile_.cellWidth && (profile_.cellWidth != font_image->glyphWidth() || profile_.cellHeight != font_image->glyphHeight())) {
+            std::cerr << "warning: profile was tuned for a different cell size\n";
         }
-        boost::shared_ptr<FontImageT> font_image(new FontImageT(font));
-        std::cout << "creating glyph matcher\n";
+        std::cout << "creating glyph matcher " << algorithm_ << "\n";
 
         registerGlyphMatcherFactories<FontImageT>();
         boost::shared_ptr<DynamicGlyphMatcherT> matcher_ctx = GlyphMatcherFactory::create(font_image, algorithm_);
         assert(matcher_ctx);
 
+        if (!outputFile_.empty()) {
+            TranscodeVideoCommand::Parameters params;
+            params.input_file = inputFile_;
+            params.output_file = outputFile_;
+            params.max_cols = maxCols_;
+            params.max_rows = maxRows_;
+            params.start_frame = startFrame_;
+            params.end_frame = endFrame_;
+            params.max_frames = maxFrames_;
+            params.start_time = startTime_;
+            params.end_time = endTime_;
+            params.max_time = maxTime_;
+            params.segment_count = segments_;
+
+            std::cout << "transcoding video\n";
+            TranscodeVideoCommand cmd(matcher_ctx, std::cout);
+            cmd.execute(params);
+            return 0;
+        }
+
+        MyVideoPlayer::MatcherVectorT level_matchers(1, matcher_ctx);
+        std::vector<std::string> fallback_algorithms;
+        if (!fallbackAlgorithms_.empty()) {
+            boost::algorithm::split(fallback_algorithms, fallbackAlgorithms_, boost::algorithm::is_any_of(","));
+        }
+        for (size_t i = 0; i < fallback_algorithms.size(); ++i) {
+            std::cout << "creating fallback glyph matcher " << fallback_algorithms[i] << "\n";
+            level_matchers.push_back(GlyphMatcherFactory::create(font_image, fallback_algorithms[i]));
+        }
+
         DynamicAsciifierT asciifier(matcher_ctx);
         assert(asciifier.matcher() == matcher_ctx);
         if (threads_ == 1) {
             asciifier.setSequential();
         } else {
-            asciifier.setParallel(threads_);
+            asciifier.setParallel(threads_, rowsPerTask_);
         }
+        QualityController quality(level_matchers.size());
 
         Console con;
 
         std::cout << "loading video\n";
 
-        MyVideoPlayer vplayer(this, &asciifier, &con);
+        MyVideoPlayer vplayer(this, &asciifier, level_matchers, &quality, &con);
         if (!vplayer.load(inputFile_))
             return -1;
 
@@ -309,6 +429,22 @@ int VideoToAscii::doExecute()
         std::cout << "total video time " << frm_tm_spn << "\n";
         std::cout << "processing time " << plr_tm_spn << "\n";
         std::cout << "processing time / frame " << plr_tm_spn / vplayer.readFrames() << "\n";
+        if (quality.levelCount() > 1) {
+            std::cout << "final quality level " << quality.level() << "\n";
+            std::cout << "quality downgrades " << quality.downgrades() << "\n";
+            std::cout << "quality upgrades " << quality.upgrades() << "\n";
+            for (unsigned i = 0; i < quality.levelCount(); ++i) {
+                std::cout << "quality level " << i << " frames " << quality.levelFrames(i)
+                          << " cost " << quality.levelCost(i) << "\n";
+            }
+        }
+#ifdef KGASCII_CHECK_ALLOCATIONS
+        std::cout << "allocating frames " << vplayer.allocatingFrames() << "\n";
+        if (vplayer.allocatingFrames() > 0) {
+            std::cerr << "error: frames allocated memory after warm-up\n";
+            return 1;
+        }
+#endif
     } catch (std::exception& e) {
         std::cerr << "error: " << e.what() << "\n";
         return 1;
@@ -0,0 +1,284 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#include "transcode_video_command.hpp"
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/thread.hpp>
+#include <boost/throw_exception.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <common/cast_surface.hpp>
+#include <kgascii/dynamic_asciifier.hpp>
+#include <kgascii/text_surface.hpp>
+
+using namespace KG::Ascii;
+
+
+TranscodeVideoCommand::TranscodeVideoCommand(boost::shared_ptr<const DynamicGlyphMatcherT> matcher, std::ostream& ostr)
+    :matcher_(matcher)
+    ,log_(ostr)
+    ,outWidth_(0)
+    ,outHeight_(0)
+    ,cols_(0)
+    ,rows_(0)
+{
+}
+
+void TranscodeVideoCommand::execute(const Parameters& params)
+{
+    using namespace boost::posix_time;
+
+    cv::VideoCapture video;
+    if (!video.open(params.input_file)) {
+        BOOST_THROW_EXCEPTION(std::runtime_error("problem opening video"));
+    }
+
+    //some containers and streams report no frame count, or a negative one
+    double reported_frame_count = video.get(CV_CAP_PROP_FRAME_COUNT);
+    unsigned frame_count = reported_frame_count > 0 ? static_cast<unsigned>(reported_frame_count) : 0;
+    bool sequential = frame_count == 0;
+    unsigned frame_width = static_cast<unsigned>(video.get(CV_CAP_PROP_FRAME_WIDTH));
+    unsigned frame_height = static_cast<unsigned>(video.get(CV_CAP_PROP_FRAME_HEIGHT));
+    double frame_rate = video.get(CV_CAP_PROP_FPS);
+    if (frame_rate <= 0 && (params.start_time || params.end_time || params.max_time)) {
+        BOOST_THROW_EXCEPTION(std::runtime_error("unknown frame rate, use frame numbers"));
+    }
+
+    unsigned first_frame = 0;
+    if (params.start_frame) {
+        first_frame = params.start_frame.get();
+    } else if (params.start_time) {
+        first_frame = static_cast<unsigned>(params.start_time.get() * frame_rate);
+    }
+    unsigned end_frame = sequential ? std::numeric_limits<unsigned>::max() : frame_count;
+    if (params.end_frame) {
+        end_frame = std::min(end_frame, params.end_frame.get());
+    } else if (params.end_time) {
+        end_frame = std::min(end_frame, static_cast<unsigned>(params.end_time.get() * frame_rate));
+    }
+    if (params.max_frames) {
+        end_frame = std::min(end_frame, first_frame + params.max_frames.get());
+    } else if (params.max_time) {
+        end_frame = std::min(end_frame, first_frame + static_cast<unsigned>(params.max_time.get() * frame_rate));
+    }
+    if (end_frame <= first_frame) {
+        BOOST_THROW_EXCEPTION(std::runtime_error("empty frame range"));
+    }
+    video.release();
+
+    unsigned char_width = matcher_->cellWidth();
+    unsigned char_height = matcher_->cellHeight();
+
+    unsigned hint_width = params.max_cols * char_width;
+    unsigned hint_height = params.max_rows * char_height;
+    if (hint_width * frame_height / frame_width < hint_height) {
+        outWidth_ = hint_width;
+        outHeight_ = outWidth_ * frame_height / frame_width;
+    } else {
+        outHeight_ = hint_height;
+        outWidth_ = outHeight_ * frame_width / frame_height;
+    }
+
+    cols_ = (outWidth_ + char_width - 1) / char_width;
+    rows_ = (outHeight_ + char_height - 1) / char_height;
+
+    unsigned frame_span = end_frame - first_frame;
+    unsigned segment_count = params.segment_count;
+    if (segment_count == 0) {
+        segment_count = std::max(boost::thread::hardware_concurrency(), 1u);
+    }
+    segment_count = sequential ? 1 : std::min(segment_count, frame_span);
+
+    log_ << "video width " << frame_width << "\n";
+    log_ << "video height " << frame_height << "\n";
+    if (sequential) {
+        log_ << "video frame count unknown, decoding sequentially\n";
+    } else {
+        log_ << "video frame count " << frame_count << "\n";
+    }
+    log_ << "output width " << outWidth_ << "\n";
+    log_ << "output height " << outHeight_ << "\n";
+    log_ << "output columns " << cols_ << "\n";
+    log_ << "output rows " << rows_ << "\n";
+    if (end_frame == std::numeric_limits<unsigned>::max()) {
+        log_ << "transcoded frames " << first_frame << "-\n";
+    } else {
+        log_ << "transcoded frames " << first_frame << "-" << end_frame << "\n";
+    }
+    log_ << "segments " << segment_count << "\n";
+
+    std::vector<Segment> segments(segment_count);
+    for (unsigned i = 0; i < segment_count; ++i) {
+        Segment& seg = segments[i];
+        seg.first_frame = first_frame + static_cast<unsigned>(static_cast<unsigned long long>(frame_span) * i / segment_count);
+        seg.end_frame = first_frame + static_cast<unsigned>(static_cast<unsigned long long>(frame_span) * (i + 1) / segment_count);
+        //the reported count may be a little off, only the last segment may
+        //run into the real end of the video
+        seg.to_end = i + 1 == segment_count && (sequential || end_frame == frame_count);
+        seg.sequential = sequential;
+        seg.part_file = str(boost::format("%1%.part%2%") % params.output_file % i);
+        seg.written_frames = 0;
+    }
+
+    ptime start_time = microsec_clock::universal_time();
+
+    boost::thread_group group;
+    for (unsigned i = 0; i < segment_count; ++i) {
+        group.create_thread(boost::bind(&TranscodeVideoCommand::transcodeSegment,
+            this, boost::cref(params), boost::ref(segments[i])));
+    }
+    group.join_all();
+
+    double elapsed = (microsec_clock::universal_time() - start_time).total_microseconds() / 1e6;
+
+    joinSegments(params, segments);
+
+    unsigned written_frames = 0;
+    for (unsigned i = 0; i < segment_count; ++i) {
+        written_frames += segments[i].written_frames;
+    }
+
+    log_ << "written frames " << written_frames << "\n";
+    log_ << "processing time " << elapsed << "\n";
+    if (written_frames > 0) {
+        log_ << "processing time / frame " << elapsed / written_frames << "\n";
+    }
+    if (frame_rate > 0 && elapsed > 0) {
+        log_ << "speed " << written_frames / frame_rate / elapsed << "x real time\n";
+    }
+}
+
+void TranscodeVideoCommand::transcodeSegment(const Parameters& params, Segment& seg) const
+{
+    typedef DynamicAsciifier<DynamicGlyphMatcherT> DynamicAsciifierT;
+
+    try {
+        cv::VideoCapture video;
+        seekSegment(video, params, seg);
+
+        std::ofstream fout(seg.part_file.c_str(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+        if (!fout)
+            throw std::runtime_error("problem creating output file");
+
+        //segments already run in parallel, one worker per segment is enough
+        DynamicAsciifierT asciifier(matcher_);
+        TextSurface text(rows_, cols_);
+        cv::Mat frame;
+        cv::Mat scaled_frame;
+        cv::Mat gray_frame;
+
+        for (unsigned frm_no = seg.first_frame; frm_no < seg.end_frame; ++frm_no) {
+            if (!video.read(frame)) {
+                if (seg.to_end)
+                    break;
+                boost::format fmt_err("video ended at frame %1%, expected frames up to %2%");
+                throw std::runtime_error(str(fmt_err % frm_no % seg.end_frame));
+            }
+
+            if (static_cast<unsigned>(frame.cols) == outWidth_ && static_cast<unsigned>(frame.rows) == outHeight_) {
+                scaled_frame = frame;
+            } else {
+                cv::resize(frame, scaled_frame, cv::Size(outWidth_, outHeight_));
+            }
+            cv::cvtColor(scaled_frame, gray_frame, CV_BGR2GRAY);
+            assert(gray_frame.type() == CV_8UC1);
+
+            boost::gil::gray8c_view_t gray_surface =
+                    castSurface<const boost::gil::gray8_pixel_t>(gray_frame);
+
+            text.clear();
+            asciifier.generate(gray_surface, text);
+
+            for (size_t r = 0; r < text.rows(); ++r) {
+                for (size_t c = 0; c < text.cols(); ++c)
+                    fout.put(text(r, c).charValue());
+                fout.put('\n');
+            }
+            fout.put('\n');
+            seg.written_frames++;
+        }
+
+        if (!fout)
+            throw std::runtime_error("problem writing output file");
+    } catch (const std::exception& e) {
+        seg.error = e.what();
+    }
+}
+
+// Opens the video at the first frame of the segment. Seeking is not
+// frame accurate with every codec, so the position is checked afterwards;
+// a seek that falls short is completed by decoding the missing frames, an
+// overshoot or a failed seek restarts decoding from the beginning.
+void TranscodeVideoCommand::seekSegment(cv::VideoCapture& video, const Parameters& params, const Segment& seg) const
+{
+    if (!video.open(params.input_file))
+        throw std::runtime_error("problem opening video");
+    if (seg.first_frame == 0)
+        return;
+
+    double position = 0;
+    if (!seg.sequential) {
+        position = video.set(CV_CAP_PROP_POS_FRAMES, seg.first_frame) ? video.get(CV_CAP_PROP_POS_FRAMES) : -1;
+        if (position < 0 || position > seg.first_frame) {
+            video.release();
+            if (!video.open(params.input_file))
+                throw std::runtime_error("problem opening video");
+            position = 0;
+        }
+    }
+    for (unsigned frm_no = static_cast<unsigned>(position); frm_no < seg.first_frame; ++frm_no) {
+        if (!video.grab()) {
+            boost::format fmt_err("video ended at frame %1% before the start frame %2%");
+            throw std::runtime_error(str(fmt_err % frm_no % seg.first_frame));
+        }
+    }
+}
+
+void TranscodeVideoCommand::joinSegments(const Parameters& params, const std::vector<Segment>& segments) const
+{
+    for (size_t i = 0; i < segments.size(); ++i) {
+        if (!segments[i].error.empty()) {
+            for (size_t j = 0; j < segments.size(); ++j) {
+                std::remove(segments[j].part_file.c_str());
+            }
+            boost::format fmt_err("segment %1%: %2%");
+            BOOST_THROW_EXCEPTION(std::runtime_error(str(fmt_err % i % segments[i].error)));
+        }
+    }
+
+    std::ofstream fout(params.output_file.c_str(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+    if (!fout) {
+        BOOST_THROW_EXCEPTION(std::runtime_error("problem creating output file"));
+    }
+    for (size_t i = 0; i < segments.size(); ++i) {
+        std::ifstream fin(segments[i].part_file.c_str(), std::ios_base::in | std::ios_base::binary);
+        if (fin.peek() != std::ifstream::traits_type::eof()) {
+            fout << fin.rdbuf();
+        }
+        fin.close();
+        std::remove(segments[i].part_file.c_str());
+    }
+    if (!fout) {
+        BOOST_THROW_EXCEPTION(std::runtime_error("problem writing output file"));
+    }
+}
@@ -0,0 +1,97 @@
+// This file is part of KG::Ascii.
+//
+// Copyright (C) 2011 Robert Konklewski <nythil@gmail.com>
+//
+// KG::Ascii is free software; you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation; either version 3 of the License, or
+// (at your option) any later version.
+//
+// KG::Ascii is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with KG::Ascii. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef KGASCII_TOOLS_TRANSCODE_VIDEO_COMMAND_HPP
+#define KGASCII_TOOLS_TRANSCODE_VIDEO_COMMAND_HPP
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <boost/noncopyable.hpp>
+#include <boost/optional.hpp>
+#include <boost/shared_ptr.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <kgascii/font.hpp>
+#include <kgascii/font_image.hpp>
+#include <kgascii/dynamic_glyph_matcher.hpp>
+
+
+// Offline conversion of a whole video into a text file.
+// The requested frame range is split into time segments, each decoded
+// by its own cv::VideoCapture and asciified by its own asciifier;
+// the segments run concurrently and are joined in order at the end.
+// Videos that do not report their frame count are decoded sequentially
+// as a single segment.
+class TranscodeVideoCommand: boost::noncopyable
+{
+public:
+    typedef KG::Ascii::Font<> FontT;
+    typedef KG::Ascii::FontImage<FontT> FontImageT;
+    typedef KG::Ascii::DynamicGlyphMatcher<FontImageT> DynamicGlyphMatcherT;
+
+    struct Parameters
+    {
+        std::string input_file;
+        std::string output_file;
+        unsigned max_cols;
+        unsigned max_rows;
+        boost::optional<unsigned> start_frame;
+        boost::optional<unsigned> end_frame;
+        boost::optional<unsigned> max_frames;
+        boost::optional<double> start_time;
+        boost::optional<double> end_time;
+        boost::optional<double> max_time;
+        unsigned segment_count;
+    };
+
+public:
+    TranscodeVideoCommand(boost::shared_ptr<const DynamicGlyphMatcherT> matcher, std::ostream& ostr);
+
+    void execute(const Parameters& params);
+
+private:
+    struct Segment
+    {
+        unsigned first_frame;
+        unsigned end_frame;
+        // the video may end before end_frame; otherwise a shorter segment
+        // is an error
+        bool to_end;
+        // skip to first_frame by decoding instead of seeking
+        bool sequential;
+        std::string part_file;
+        unsigned written_frames;
+        std::string error;
+    };
+
+    void transcodeSegment(const Parameters& params, Segment& seg) const;
+
+    void seekSegment(cv::VideoCapture& video, const Parameters& params, const Segment& seg) const;
+
+    void joinSegments(const Parameters& params, const std::vector<Segment>& segments) const;
+
+private:
+    boost::shared_ptr<const DynamicGlyphMatcherT> matcher_;
+    std::ostream& log_;
+    unsigned outWidth_;
+    unsigned outHeight_;
+    unsigned cols_;
+    unsigned rows_;
+};
+
+
+#endif /* KGASCII_TOOLS_TRANSCODE_VIDEO_COMMAND_HPP */